@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "Batch.hpp"
+#include "Parser.hpp"
+
+using namespace std;
+
+typedef struct
+{
+  vector<batch_job_t> *jobs;		// biggest dumps first
+  int in_flight;
+  uint64_t in_flight_bytes;
+  uint64_t memory_budget;
+  ostream *os;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} batch_state_t;
+
+void *batchWorker(void *arg);
+int pickBatchJob(batch_state_t *state);
+bool compareJobsBySize(const batch_job_t &a, const batch_job_t &b);
+void printFleetReport(ostream &os, vector<batch_job_t> &jobs);
+
+/****************************** Batch *********************************/
+
+int runBatch(char *input, FlashGeometry &geometry, int threads_num, uint64_t memory_budget,
+  ostream &os)
+{
+  vector<batch_job_t> jobs;
+  vector<string> paths;
+  struct stat st;
+
+  if(listBatchInputs(input, paths) < 0)
+    return -1;
+
+  for(int i=0; i<(int)paths.size(); i++)
+  {
+    batch_job_t job;
+    job.name = job.path = paths[i];
+    job.index = i;
+    job.chunks = NULL;
+    job.geometry = geometry;
+    job.size = (stat(paths[i].c_str(), &st) == 0) ? st.st_size : 0;
+    jobs.push_back(job);
+  }
+
+  printSummaryHeader(os);
+  if(runBatchJobs(jobs, threads_num, memory_budget, os) < 0)
+    return -1;
+
+  printFleetReport(os, jobs);
+  return 0;
+}
+
+/**
+ * Summarize every job, biggest first, print a summary row for each as
+ * soon as it is done
+ */
+int runBatchJobs(vector<batch_job_t> &jobs, int threads_num, uint64_t memory_budget,
+  ostream &os)
+{
+  batch_state_t state;
+  vector<pthread_t> threads;
+
+  for(int i=0; i<(int)jobs.size(); i++)
+    jobs[i].started = jobs[i].ok = false;
+
+  // the biggest dumps start first so that none is left alone at the end
+  stable_sort(jobs.begin(), jobs.end(), compareJobsBySize);
+
+  state.jobs = &jobs;
+  state.in_flight = 0;
+  state.in_flight_bytes = 0;
+  state.memory_budget = memory_budget;
+  state.os = &os;
+  pthread_mutex_init(&state.lock, NULL);
+  pthread_cond_init(&state.cond, NULL);
+
+  if(threads_num < 1)
+    threads_num = 1;
+  if(threads_num > (int)jobs.size())
+    threads_num = max(1, (int)jobs.size());
+
+  for(int i=0; i<threads_num; i++)
+  {
+    pthread_t t;
+    if(pthread_create(&t, NULL, batchWorker, &state))
+    {
+      cerr << "Error creating batch worker thread" << endl;
+      break;
+    }
+    threads.push_back(t);
+  }
+
+  for(int i=0; i<(int)threads.size(); i++)
+    pthread_join(threads[i], NULL);
+
+  pthread_cond_destroy(&state.cond);
+  pthread_mutex_destroy(&state.lock);
+
+  if(threads.empty())
+    return -1;
+  return 0;
+}
+
+/**
+ * Fill res with the dumps to process : the regular files of input if it
+ * is a directory, else the paths listed in input, one per line
+ */
+int listBatchInputs(char *input, vector<string> &res)
+{
+  struct stat st;
+
+  if(stat(input, &st))
+  {
+    cerr << "Can't open " << input << endl;
+    return -1;
+  }
+
+  if(S_ISDIR(st.st_mode))
+  {
+    DIR *dir = opendir(input);
+    struct dirent *entry;
+
+    if(dir == NULL)
+    {
+      cerr << "Can't open directory " << input << endl;
+      return -1;
+    }
+
+    while((entry = readdir(dir)) != NULL)
+    {
+      string path = string(input) + "/" + entry->d_name;
+      if(entry->d_name[0] == '.' || stat(path.c_str(), &st) || !S_ISREG(st.st_mode))
+	continue;
+      res.push_back(path);
+    }
+    closedir(dir);
+    sort(res.begin(), res.end());
+  }
+  else
+  {
+    ifstream manifest(input);
+    string line;
+
+    while(getline(manifest, line))
+      if(!line.empty() && line[0] != '#')
+	res.push_back(line);
+  }
+
+  return 0;
+}
+
+/**
+ * Process jobs until there is none left
+ */
+void *batchWorker(void *arg)
+{
+  batch_state_t *state = (batch_state_t *)arg;
+
+  pthread_mutex_lock(&state->lock);
+  while(true)
+  {
+    int j = pickBatchJob(state);
+    if(j == -1)
+      break;
+    if(j == -2)
+    {
+      pthread_cond_wait(&state->cond, &state->lock);
+      continue;
+    }
+
+    batch_job_t &job = (*state->jobs)[j];
+    job.started = true;
+    state->in_flight++;
+    state->in_flight_bytes += job.size;
+    pthread_mutex_unlock(&state->lock);
+
+    vector<Chunk *> parsed;
+    vector<Chunk *> &chunks = (job.chunks != NULL) ? *job.chunks : parsed;
+    vector<char> path(job.path.begin(), job.path.end());
+    path.push_back('\0');
+    if(job.chunks != NULL || parseFile(&path[0], parsed, job.geometry) == 0)
+    {
+      FileSet fs(chunks, false);
+      job.ok = (computeDumpSummary(chunks, fs, job.geometry, job.summary) == 0);
+    }
+    for(int i=0; i<(int)parsed.size(); i++)
+      delete parsed[i];
+
+    pthread_mutex_lock(&state->lock);
+    if(job.ok)
+      printSummaryRow(*(state->os), job.name, job.summary);
+    else
+      cerr << "Error processing " << job.name << endl;
+    state->in_flight--;
+    state->in_flight_bytes -= job.size;
+    pthread_cond_broadcast(&state->cond);
+  }
+  pthread_mutex_unlock(&state->lock);
+
+  return NULL;
+}
+
+/**
+ * Called with the lock held. Return the index of the biggest pending
+ * job fitting in the memory budget, -1 if no job is pending and -2 if
+ * the pending ones must wait for memory
+ */
+int pickBatchJob(batch_state_t *state)
+{
+  bool pending = false;
+
+  for(int i=0; i<(int)state->jobs->size(); i++)
+  {
+    batch_job_t &job = (*state->jobs)[i];
+    if(job.started)
+      continue;
+    pending = true;
+    if(state->memory_budget == 0 || state->in_flight == 0 ||
+      state->in_flight_bytes + job.size <= state->memory_budget)
+      return i;
+  }
+
+  return pending ? -2 : -1;
+}
+
+bool compareJobsBySize(const batch_job_t &a, const batch_job_t &b)
+{
+  return a.size > b.size;
+}
+
+/**
+ * Distributions over all the dumps processed successfully
+ */
+void printFleetReport(ostream &os, vector<batch_job_t> &jobs)
+{
+  double frag_bounds[] = {1.0, 1.1, 1.25, 1.5, 2.0, 3.0};
+  double gc_bounds[] = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9};
+  double percents[] = {50, 90, 99, 100};
+  vector<double> frag, gc, read_amp;
+  int failed = 0;
+
+  for(int i=0; i<(int)jobs.size(); i++)
+  {
+    if(!jobs[i].ok)
+    {
+      failed++;
+      continue;
+    }
+    frag.push_back(getFragmentationFactor(jobs[i].summary));
+    gc.push_back(getGCPressure(jobs[i].summary));
+    read_amp.push_back(getReadAmplification(jobs[i].summary));
+  }
+
+  os << endl << "Fleet report : " << frag.size() << " dumps";
+  if(failed)
+    os << " (" << failed << " failed)";
+  os << endl;
+
+  printHistogram(os, "Fragmentation factor", frag, frag_bounds, 6);
+  printHistogram(os, "GC pressure", gc, gc_bounds, 9);
+
+  sort(frag.begin(), frag.end());
+  sort(read_amp.begin(), read_amp.end());
+  os << "Percentiles :" << endl;
+  for(int i=0; i<4; i++)
+    os << "  p" << left << setw(4) << percents[i] << right << " frag. factor : "
+      << getPercentile(frag, percents[i]) << ", read amplification : "
+      << getPercentile(read_amp, percents[i]) << endl;
+}
@@ -0,0 +1,40 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "Summary.hpp"
+
+/**
+ * One dump to summarize : parsed from path, or already parsed in chunks
+ */
+typedef struct
+{
+  std::string name;				// printed in the summary row
+  int index;				// position in the input list, the jobs get sorted
+  std::string path;
+  std::vector<Chunk *> *chunks;		// NULL to parse path, not freed
+  FlashGeometry geometry;		// used to parse path
+  uint64_t size;			// memory footprint estimate, in dump bytes
+  bool started;
+  bool ok;
+  dump_summary_t summary;
+} batch_job_t;
+
+/**
+ * Batch analysis of many dumps : each dump is parsed and summarized by
+ * one of threads_num workers, a summary row is written as soon as a
+ * dump is done, then the fleet-wide distributions.
+ * memory_budget bounds the total size of the dumps being processed at
+ * the same time (0 for no bound), a dump bigger than the budget is
+ * processed alone.
+ */
+int runBatch(char *input, FlashGeometry &geometry, int threads_num, uint64_t memory_budget,
+  std::ostream &os);
+int runBatchJobs(std::vector<batch_job_t> &jobs, int threads_num, uint64_t memory_budget,
+  std::ostream &os);
+int listBatchInputs(char *input, std::vector<std::string> &res);
+
+#endif /* BATCH_HPP */
@@ -0,0 +1,190 @@
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/resource.h>
+
+#include "Benchmark.hpp"
+#include "Parser.hpp"
+#include "File.hpp"
+#include "DirTree.hpp"
+#include "Summary.hpp"
+#include "FlashIndex.hpp"
+#include "MountScan.hpp"
+#include "Query.hpp"
+#include "Stats.hpp"
+
+using namespace std;
+
+#define BENCHMARK_QUERY				"by=frag,top=10"
+
+/*************************** DumpBenchmark ****************************/
+
+DumpBenchmark::DumpBenchmark(gen_params_t &params, FlashGeometry &geometry, char *scratch_path)
+{
+  _params = params;
+  _geometry = geometry;
+  _scratch_path = scratch_path;
+}
+
+int DumpBenchmark::run(vector<int> &scales, ostream &os)
+{
+  int ret = 0;
+
+  os << "{" << endl;
+  os << "  \"page_size\": " << _geometry.getFlashPageSize() << "," << endl;
+  os << "  \"pages_per_block\": " << _geometry.getNumPagesPerBlock() << "," << endl;
+  os << "  \"generator\": {\"mean_file_size\": " << _params.mean_file_size
+    << ", \"writers\": " << _params.writers_num << ", \"overwrite\": " << _params.overwrite_ratio
+    << ", \"delete\": " << _params.delete_ratio << ", \"dup\": " << _params.duplicate_ratio
+    << ", \"seed\": " << _params.seed << "}," << endl;
+  os << "  \"runs\": [" << endl;
+
+  // a run is written once complete, so a failed one leaves valid JSON
+  for(int i=0; i<(int)scales.size() && ret == 0; i++)
+  {
+    stringstream run;
+
+    ret = runScale(scales[i], run);
+    if(ret == 0)
+      os << ((i > 0) ? ",\n" : "") << run.str();
+  }
+
+  os << endl << "  ]" << endl << "}" << endl;
+  remove(_scratch_path.c_str());
+
+  return ret;
+}
+
+/**
+ * One JSON object with the size of the dump, the time of each phase and
+ * the peak memory of the process so far
+ */
+int DumpBenchmark::runScale(int files_num, ostream &os)
+{
+  gen_params_t params = _params;
+  vector<phase_time_t> phases;
+  vector<Chunk *> chunks;
+  uint64_t lines_num, dump_size;
+  struct rusage usage;
+  double t, start;
+  int ret = 0;
+
+  params.files_num = files_num;
+  params.raw = false;
+  start = t = getMonotonicTime();
+
+#define END_PHASE(phase_name) \
+  { \
+    phase_time_t p; \
+    double now = getMonotonicTime(); \
+    p.name = phase_name; \
+    p.seconds = now - t; \
+    phases.push_back(p); \
+    t = now; \
+  }
+
+  {
+    ofstream out(_scratch_path.c_str());
+    DumpGenerator gen(params, _geometry);
+    if(!out || gen.write(out) < 0)
+    {
+      cerr << "Error generating " << _scratch_path << endl;
+      return -1;
+    }
+    lines_num = gen.getLinesNum();
+    dump_size = gen.getSize();
+  }
+  END_PHASE("generate");
+
+  // the same calls as the other modes, --stats splits them further
+  if(parseFile(&_scratch_path[0], chunks, _geometry) < 0)
+  {
+    cerr << "Error parsing " << _scratch_path << endl;
+    ret = -1;
+  }
+  END_PHASE("parse");
+
+  if(ret == 0)
+  {
+    FileSet fs(chunks, false);
+    END_PHASE("fileset");
+
+    DirTree tree(fs);
+    if(tree.getEntriesNum() > 0)
+      tree.getSubtreeStats(0);
+    END_PHASE("tree");
+
+    dump_summary_t summary;
+    computeDumpSummary(chunks, fs, _geometry, summary);
+    END_PHASE("summary");
+
+    FlashIndex index(chunks, fs, _geometry);
+    END_PHASE("index");
+
+    MountScan ms(chunks, _geometry, 50.0);
+    END_PHASE("mount");
+
+    query_t query;
+    vector<query_result_t> results;
+    char query_str[] = BENCHMARK_QUERY;
+    parseQuery(query_str, query);
+    runQuery(tree, query, results);
+    END_PHASE("query");
+
+    getrusage(RUSAGE_SELF, &usage);
+    os << "    {\"files\": " << files_num << ", \"lines\": " << lines_num
+      << ", \"chunks\": " << chunks.size() << ", \"flash_bytes\": " << dump_size
+      << ", \"fileset_files\": " << fs.getFilesNum() << "," << endl << "     \"seconds\": {";
+    for(int i=0; i<(int)phases.size(); i++)
+      os << ((i) ? ", " : "") << "\"" << phases[i].name << "\": " << phases[i].seconds;
+    os << ", \"total\": " << t - start << "}," << endl
+      << "     \"max_rss_kb\": " << usage.ru_maxrss << "}";
+  }
+#undef END_PHASE
+
+  for(int i=0; i<(int)chunks.size(); i++)
+    delete chunks[i];
+
+  return ret;
+}
+
+/**
+ * Parse a list like 1000,10K of numbers of files, K and M suffixes
+ * accepted as in parseGenParams
+ */
+int parseScaleList(char *list, vector<int> &res)
+{
+  string content = list;
+  string item;
+
+  for(int i=0; i<(int)content.size(); i++)
+    if(content[i] == ',')
+      content[i] = ' ';
+
+  stringstream ss(content);
+  while(ss >> item)
+  {
+    char *end;
+    double value = strtod(item.c_str(), &end);
+
+    if(*end == 'K' || *end == 'k')
+      value *= 1024, end++;
+    else if(*end == 'M')
+      value *= 1024*1024, end++;
+    if(*end != '\0' || value < 1)
+    {
+      cerr << "Error, invalid scale : " << item << endl;
+      return -1;
+    }
+    res.push_back((int)value);
+  }
+
+  if(res.empty())
+  {
+    cerr << "Error, empty scale list" << endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "Generator.hpp"
+
+/**
+ * Times each phase of the analysis on generated dumps of several sizes :
+ * generation, parse (parseFile), file set build, then each report. The
+ * results are written as JSON so that runs of two versions can be
+ * compared.
+ */
+class DumpBenchmark
+{
+  public:
+    DumpBenchmark(gen_params_t &params, FlashGeometry &geometry, char *scratch_path);
+    int run(std::vector<int> &scales, std::ostream &os);
+
+  private:
+    typedef struct
+    {
+      std::string name;
+      double seconds;
+    } phase_time_t;
+
+    gen_params_t _params;
+    FlashGeometry _geometry;
+    std::string _scratch_path;
+
+    int runScale(int files_num, std::ostream &os);
+};
+
+int parseScaleList(char *list, std::vector<int> &res);
+
+#endif /* BENCHMARK_HPP */
@@ -2,9 +2,12 @@
 #include <sstream>
 #include <cstdlib>
 #include <assert.h>
+#include <algorithm>
 
 #include "ChunkModel.hpp"
 
+using namespace std;
+
 /************************* Chunk **************************************/
 
 Chunk::Chunk(){}
@@ -15,6 +18,7 @@ int Chunk::build(string line)
   string free_space_start = "Empty space";
   string data_node_start = "         Inode";
   string dirent_node_start = "         Dirent";
+  string summary_node_start = "         Summary";
   
   if(!line.compare(0, free_space_start.size(), free_space_start))
     _type = FREE_SPACE;
@@ -22,6 +26,8 @@ int Chunk::build(string line)
     _type = DATA_NODE;
   else if(!line.compare(0, dirent_node_start.size(), dirent_node_start))
     _type = DIRENT_NODE;
+  else if(!line.compare(0, summary_node_start.size(), summary_node_start))
+    _type = SUMMARY_NODE;
   else
   {
     cerr << "ERROR : cant build chunk from this line :" << endl;
@@ -40,7 +46,7 @@ chunk_type Chunk::getType()
 
 FreeSpaceChunk::FreeSpaceChunk() : Chunk(){}
 
-int FreeSpaceChunk::build(string line)
+int FreeSpaceChunk::build(string line, FlashGeometry &geometry)
 {
   Chunk::build(line);
   // get on-flash start and end offsets
@@ -78,27 +84,128 @@ int FreeSpaceChunk::build(string line)
   ss << std::hex << res[1];
   ss >> end_offset;
   
-  _start = FlashAddr(start_offset + FlashAddr::getPartitionOffset());
-  _end = FlashAddr(end_offset + FlashAddr::getPartitionOffset());
+  _start = FlashAddr(start_offset + geometry.getPartitionOffset(), geometry);
+  _end = FlashAddr(end_offset + geometry.getPartitionOffset(), geometry);
   
    // cout << "Free space" << endl << "  start_offset : " << start_offset << endl <<
-  				  // "  end_offset : " << end_offset << endl;
+				  // "  end_offset : " << end_offset << endl;
   
   regfree(&exp);
   return 0;
 
 }
 
+/**
+ * Size in bytes, the end offset is not part of the chunk
+ */
+uint64_t FreeSpaceChunk::getSize()
+{
+  return _end.getFlashOffset() - _start.getFlashOffset();
+}
+
+FlashAddr FreeSpaceChunk::getStart()
+{
+  return _start;
+}
+
+FlashAddr FreeSpaceChunk::getEnd()
+{
+  return _end;
+}
+
 ostream& operator<<(ostream& os, FreeSpaceChunk& fsc )
 {
   os << "Free space " << fsc._start << " -> " << fsc._end;
   return os;
 }
 
+/************************* SummaryNode ********************************/
+
+SummaryNode::SummaryNode() : Chunk(){}
+int SummaryNode::build(string line, FlashGeometry &geometry)
+{
+  Chunk::build(line);
+  // Get flash offset, flash size & number of entries
+  regex_t exp;
+  string summary_regex = "node at 0x([0-9a-f]*).*totlen 0x([0-9a-f]*).*sum_num[ ]*([0-9]*)";
+  regmatch_t matches[4];
+  string flash_offset, flash_size, entries_num;
+  
+  // compile regex
+  if(regcomp(&exp, summary_regex.c_str(), REG_EXTENDED))
+  {
+    cerr << "Error compiling regexp " << summary_regex << endl;
+    regfree(&exp);
+    return -1;
+  }
+  
+  // execute regex
+  if(regexec(&exp, line.c_str(), 4, matches, 0))
+  {
+    cerr << "Error executing summary node regexp " << summary_regex << " on :" << endl;
+    cerr << line << endl;
+    regfree(&exp);
+    return -1;
+  }
+  
+  flash_offset = line.substr(matches[1].rm_so, matches[1].rm_eo - matches[1].rm_so);
+  flash_size = line.substr(matches[2].rm_so, matches[2].rm_eo - matches[2].rm_so);
+  entries_num = line.substr(matches[3].rm_so, matches[3].rm_eo - matches[3].rm_so);
+  
+  // convert hex to uint when needed
+  uint64_t flash_offset_tmp;
+  stringstream ss;
+  ss << std::hex << flash_offset;
+  ss >> flash_offset_tmp;
+  _flash_offset = FlashAddr(flash_offset_tmp + geometry.getPartitionOffset(), geometry);
+  ss.clear();
+  ss << std::hex << flash_size;
+  ss >> _flash_size;
+  _entries_num = atoi(entries_num.c_str());
+  
+  regfree(&exp);
+  return 0;
+}
+
+FlashAddr SummaryNode::getFlashAddr()
+{
+  return _flash_offset;
+}
+
+uint32_t SummaryNode::getFlashSize()
+{
+  return _flash_size;
+}
+
+uint32_t SummaryNode::getFirstFlashPage()
+{
+  return _flash_offset.getFlashPage();
+}
+
+uint32_t SummaryNode::getLastFlashPage()
+{
+  assert(_flash_size != 0);
+  return _flash_offset.getGeometry().getPage(_flash_offset.getFlashOffset() + _flash_size-1);
+}
+
+int SummaryNode::getEntriesNum()
+{
+  return _entries_num;
+}
+
+ostream& operator<<(ostream& os, SummaryNode& sn )
+{
+  FlashAddr end(sn._flash_offset.getFlashOffset() + sn._flash_size -1, sn._flash_offset.getGeometry());
+  
+  os << "Summary node " << sn._flash_offset << " -> " << end;
+  os << " entries:" << sn._entries_num;
+  return os;
+}
+
 /************************* Node ***************************************/
 
 Node::Node() : Chunk(){}
-int Node::build(string line)
+int Node::build(string line, FlashGeometry &geometry)
 {
   Chunk::build(line);
   // Get flash offset, flash size, inode & version num
@@ -155,7 +262,7 @@ int Node::build(string line)
   stringstream ss;
   ss << std::hex << flash_offset;
   ss >> flash_offset_tmp;
-  _flash_offset = FlashAddr(flash_offset_tmp + FlashAddr::getPartitionOffset());
+  _flash_offset = FlashAddr(flash_offset_tmp + geometry.getPartitionOffset(), geometry);
   ss.clear();
   ss << std::hex << flash_size;
   ss >> _flash_size;
@@ -186,6 +293,33 @@ uint32_t Node::getVersionNum()
   return _version_num;
 }
 
+FlashAddr Node::getFlashAddr()
+{
+  return _flash_offset;
+}
+
+FlashGeometry & Node::getGeometry()
+{
+  return _flash_offset.getGeometry();
+}
+
+/**
+ * Index of the flash page holding the first byte of the node
+ */
+uint32_t Node::getFirstFlashPage()
+{
+  return _flash_offset.getFlashPage();
+}
+
+/**
+ * Index of the flash page holding the last byte of the node
+ */
+uint32_t Node::getLastFlashPage()
+{
+  assert(_flash_size != 0);
+  return _flash_offset.getGeometry().getPage(_flash_offset.getFlashOffset() + _flash_size-1);
+}
+
 /**
  * TODO comm here
  */
@@ -195,8 +329,8 @@ vector<int> Node::getConcernedPagesIndexes()
   
   assert(_flash_size != 0);
   
-  int first_page = _flash_offset.getFlashOffset() / FlashAddr::getFlashPageSize();
-  int last_page = (_flash_offset.getFlashOffset() + _flash_size-1) / FlashAddr::getFlashPageSize();
+  int first_page = getFirstFlashPage();
+  int last_page = getLastFlashPage();
   int total_page_num = last_page - first_page + 1;
   
   assert(total_page_num > 0);
@@ -210,9 +344,9 @@ vector<int> Node::getConcernedPagesIndexes()
 /************************* DataNode************************************/
 
 DataNode::DataNode() : Node(){}
-int DataNode::build(string line)
+int DataNode::build(string line, FlashGeometry &geometry)
 {
-  Node::build(line);
+  Node::build(line, geometry);
   string file_size, compressed_size, data_size, offset;
   regex_t exp;
   string datanode_regexp = "isize[ ]*([0-9]*).*csize[ ]*([0-9]*).*dsize[ ]*([0-9]*).*offset[ ]*([0-9]*)";
@@ -262,7 +396,7 @@ int DataNode::build(string line)
 int DataNode::getConcernedPageAtOffset(uint32_t offset)
 {
   assert(offset < _data_size);
-  return ((_flash_offset.getFlashOffset() + offset)/FlashAddr::getFlashPageSize());
+  return _flash_offset.getGeometry().getPage(_flash_offset.getFlashOffset() + offset);
 }
 
 uint32_t DataNode::getFileSize()
@@ -272,7 +406,7 @@ uint32_t DataNode::getFileSize()
 
 ostream& operator<<(ostream& os, DataNode& dn )
 {
-  FlashAddr end(dn._flash_offset.getFlashOffset() + dn._flash_size -1);
+  FlashAddr end(dn._flash_offset.getFlashOffset() + dn._flash_size -1, dn._flash_offset.getGeometry());
   
   os <<  "Data node " << dn._flash_offset << " -> " << end << " ";
   os << dn._inode_num << "v" << dn._version_num;
@@ -295,12 +429,26 @@ uint32_t DataNode::getDataSize()
   return _data_size;
 }
 
+uint32_t DataNode::getCompressedSize()
+{
+  return _compressed_size;
+}
+
+/**
+ * jffs2dump does not give the compressor, a node is taken as compressed
+ * if its payload is smaller than its data
+ */
+bool DataNode::isCompressed()
+{
+  return _compressed_size < _data_size;
+}
+
 /************************* DirentNode *********************************/
 
 DirentNode::DirentNode() : Node(){}
-int DirentNode::build(string line)
+int DirentNode::build(string line, FlashGeometry &geometry)
 {
-  Node::build(line);
+  Node::build(line, geometry);
   
   string parent_inode_num, name_size, name;
   regex_t exp;
@@ -352,7 +500,7 @@ string DirentNode::getName()
 
 ostream& operator<<(ostream& os, DirentNode& dn )
 {
-  FlashAddr end(dn._flash_offset.getFlashOffset() + dn._flash_size -1);
+  FlashAddr end(dn._flash_offset.getFlashOffset() + dn._flash_size -1, dn._flash_offset.getGeometry());
   
   os << "Dirent node " << dn._flash_offset << " -> " << end ;
   os << " \"" << dn._name << "\"v" << dn._version_num;
@@ -360,37 +508,30 @@ ostream& operator<<(ostream& os, DirentNode& dn )
   return os;
 }
 
+bool compareDataNodesByVersion(DataNode *a, DataNode *b)
+{
+  return a->getVersionNum() > b->getVersionNum();
+}
+
 /**
- * Sort data nodes in the array by version num
+ * Sort the data nodes by decreasing version, the other chunks keeping
+ * their slots. Stable so the nodes of a same version keep their order.
  */
 int sortChunkArray(vector<Chunk *> &vec)
 {
-  bool swap_done;
-  do
-  {
-    swap_done = false;
-    for(int i=0; i<((int)vec.size()-1); i++)
-      if(vec[i]->getType() == DATA_NODE)
-      {
-	DataNode *first = static_cast<DataNode *>(vec[i]);
-	
-	// find next DN
-	int j=i+1;
-	while(j < (int)vec.size() && vec[j]->getType() != DATA_NODE)
-	  j++;
-	if(j == (int)vec.size())
-	  continue;
-	  
-	DataNode *second = static_cast<DataNode *>(vec[j]);
-	
-	if(first->getVersionNum() < second->getVersionNum())
-	{
-	  vec[i] = second;
-	  vec[j] = first;
-	  swap_done = true;
-	}
-      }
-  } while(swap_done == true);
+  vector<int> slots;
+  vector<DataNode *> data_nodes;
+  
+  for(int i=0; i<(int)vec.size(); i++)
+    if(vec[i]->getType() == DATA_NODE)
+    {
+      slots.push_back(i);
+      data_nodes.push_back(static_cast<DataNode *>(vec[i]));
+    }
+  
+  stable_sort(data_nodes.begin(), data_nodes.end(), compareDataNodesByVersion);
+  for(int i=0; i<(int)slots.size(); i++)
+    vec[slots[i]] = data_nodes[i];
       
   return 0;
 }
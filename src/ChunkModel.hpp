@@ -4,21 +4,17 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 #include "FlashAddr.hpp"
 
-using namespace std;
-
-typedef unsigned long long int 		uint64_t;
-typedef unsigned int 			uint32_t;
-
-typedef enum {FREE_SPACE, DATA_NODE, DIRENT_NODE} chunk_type;
+typedef enum {FREE_SPACE, DATA_NODE, DIRENT_NODE, SUMMARY_NODE} chunk_type;
 
 class Chunk
 {
   public:
     Chunk();
-    int build(string line);
+    int build(std::string line);
     chunk_type getType();
     
   private:
@@ -29,25 +25,56 @@ class FreeSpaceChunk : public Chunk
 {
   public:
     FreeSpaceChunk();
-    int build(string line);
+    int build(std::string line, FlashGeometry &geometry);
+    uint64_t getSize();
+    FlashAddr getStart();
+    FlashAddr getEnd();
     
   private:
     // valid after parsing
     FlashAddr 	_start;		// start offset for the free space chunk
     FlashAddr	_end;			// end
     
-  friend ostream& operator<<(ostream& os, FreeSpaceChunk& fsc );
+  friend std::ostream& operator<<(std::ostream& os, FreeSpaceChunk& fsc );
+};
+
+/**
+ * Erase block summary, written at the end of a block so that the mount
+ * scan can skip reading the rest of the block
+ */
+class SummaryNode : public Chunk
+{
+  public:
+    SummaryNode();
+    int build(std::string line, FlashGeometry &geometry);
+    FlashAddr getFlashAddr();
+    uint32_t getFlashSize();
+    uint32_t getFirstFlashPage();
+    uint32_t getLastFlashPage();
+    int getEntriesNum();
+    
+  private:
+    // valid after parsing
+    FlashAddr 	_flash_offset;		// location on flash
+    uint32_t 	_flash_size;			// size on flash for the node
+    int		_entries_num;			// number of nodes summarized
+    
+  friend std::ostream& operator<<(std::ostream& os, SummaryNode& sn );
 };
 
 class Node : public Chunk
 {
   public:
     Node();
-    int build(string line);
+    int build(std::string line, FlashGeometry &geometry);
     uint64_t getInodeNum();
     uint32_t getVersionNum();
-    vector<int> getConcernedPagesIndexes();
+    std::vector<int> getConcernedPagesIndexes();
     uint32_t getFlashSize();
+    FlashAddr getFlashAddr();
+    FlashGeometry &getGeometry();
+    uint32_t getFirstFlashPage();
+    uint32_t getLastFlashPage();
     
   protected:
     // valid after parsing
@@ -61,12 +88,14 @@ class DataNode : public Node
 {
   public:
     DataNode();
-    int build(string line);
+    int build(std::string line, FlashGeometry &geometry);
     uint32_t getFileSize();
     uint32_t getDataOffset();
     uint32_t getDataSize();
+    uint32_t getCompressedSize();
+    bool isCompressed();
     int getConcernedPageAtOffset(uint32_t offset);
-    vector<int> getContainingPages();
+    std::vector<int> getContainingPages();
     
   private:
     // valid after parsing
@@ -75,26 +104,26 @@ class DataNode : public Node
     uint32_t 	_data_size;			// uncompressed data size
     uint32_t 	_offset;				// location of the data in the corresponding file
     
-  friend ostream& operator<<(ostream& os, DataNode& dn );
+  friend std::ostream& operator<<(std::ostream& os, DataNode& dn );
 };
 
 class DirentNode : public Node
 {
   public:
     DirentNode();
-    int build(string line);
+    int build(std::string line, FlashGeometry &geometry);
     uint64_t getParentInodeNum();
-    string getName();
+    std::string getName();
     
   private:
     // valid after parsing
     uint64_t	_parent_inode_num;		// inode num of parent dir at the moment this node was created
     int		_name_size;			// size of the name in bytes at the moment this node was created
-    string 	_name;				// name of the corresponding file at the moment this node was created
+    std::string	_name;			// name of the corresponding file at the moment this node was created
     
-  friend ostream& operator<<(ostream& os, DirentNode& dn );
+  friend std::ostream& operator<<(std::ostream& os, DirentNode& dn );
 };
 
-int sortChunkArray(vector<Chunk *> &vec);
+int sortChunkArray(std::vector<Chunk *> &vec);
 
 #endif /* CHUNK_MODEL_HPP */
@@ -0,0 +1,194 @@
+#include "Compression.hpp"
+#include "Summary.hpp"
+
+using namespace std;
+
+#define JFFS2_DATANODE_METADATA_SIZE		68
+
+void printCompressionStats(ostream &os, compression_stats_t &s);
+
+/************************* Compression stats **************************/
+
+void initCompressionStats(compression_stats_t &s)
+{
+  s.nodes_num = s.compressed_nodes_num = 0;
+  s.compressed_bytes = s.data_bytes = 0;
+  s.readpages_num = 0;
+  s.io_us = s.cpu_us = s.uncompressed_io_us = 0.0;
+}
+
+void addCompressionStats(compression_stats_t &to, compression_stats_t &from)
+{
+  to.nodes_num += from.nodes_num;
+  to.compressed_nodes_num += from.compressed_nodes_num;
+  to.compressed_bytes += from.compressed_bytes;
+  to.data_bytes += from.data_bytes;
+  to.readpages_num += from.readpages_num;
+  to.io_us += from.io_us;
+  to.cpu_us += from.cpu_us;
+  to.uncompressed_io_us += from.uncompressed_io_us;
+}
+
+/**
+ * The flash pages read by a readpage depend on the compressed size of
+ * the nodes, the decompression time on their uncompressed size : the
+ * kernel decompresses the whole node even if only a part of it is
+ * needed. The uncompressed estimate takes each node read with its data
+ * stored as is from the same flash offset, its pages counted once per
+ * readpage like the compressed ones. In the kernel readpage model each
+ * fragment is charged, with the CRC of its whole node.
+ */
+int computeCompressionStats(File &f, read_cost_params_t &params, compression_stats_t &res)
+{
+  vector<DataNode *> &valid = f.getValidDataNodes();
+
+  initCompressionStats(res);
+
+  for(int i=0; i<(int)valid.size(); i++)
+  {
+    res.nodes_num++;
+    if(valid[i]->isCompressed())
+      res.compressed_nodes_num++;
+    res.compressed_bytes += valid[i]->getCompressedSize();
+    res.data_bytes += valid[i]->getDataSize();
+  }
+
+  if(f.isDeleted() || f.getSize() == 0)
+    return 0;
+
+  res.readpages_num = f.getLinuxPagesNum();
+  for(int i=0; i<res.readpages_num; i++)
+  {
+    vector<DataNode *> nodes = f.getDataNodesReadForLinuxPage(i);
+    int last_page = -1, pages = 0;
+    int last_uncompressed_page = -1, uncompressed_pages = 0;
+    double cpu_us = 0.0;
+
+    for(int j=0; j<(int)nodes.size(); j++)
+    {
+      DataNode *dn = nodes[j];
+      uint64_t node_bytes = dn->getDataSize() + JFFS2_DATANODE_METADATA_SIZE;
+      int last_uncompressed = dn->getGeometry().getPage(dn->getFlashAddr().getFlashOffset() +
+	node_bytes - 1);
+
+      // same accounting as getFlashPagesReadForLinuxPage
+      for(int p=dn->getFirstFlashPage(); p<=(int)dn->getLastFlashPage(); p++)
+	if(p != last_page)
+	{
+	  pages++;
+	  last_page = p;
+	}
+      for(int p=dn->getFirstFlashPage(); p<=last_uncompressed; p++)
+	if(p != last_uncompressed_page)
+	{
+	  uncompressed_pages++;
+	  last_uncompressed_page = p;
+	}
+
+      if(dn->isCompressed())
+	cpu_us += (double)dn->getDataSize() / params.decompress_mbps;
+      if(getReadpageModel() == READPAGE_KERNEL)
+	res.uncompressed_io_us += (double)(JFFS2_NODE_HEADER_CRC_SIZE + dn->getDataSize()) /
+	  params.crc_mbps;
+    }
+
+    if(getReadpageModel() == READPAGE_KERNEL)
+    {
+      readpage_work_t work;
+      f.getLinuxPageReadWork(i, work);
+      pages = work.flash_pages;
+      cpu_us = (double)work.decompressed_bytes / params.decompress_mbps +
+	(double)work.crc_bytes / params.crc_mbps;
+    }
+    res.io_us += pages * params.page_read_us;
+    res.uncompressed_io_us += uncompressed_pages * params.page_read_us;
+    res.cpu_us += cpu_us;
+  }
+
+  return 0;
+}
+
+double getCompressionRatio(compression_stats_t &s)
+{
+  if(s.data_bytes == 0)
+    return 1.0;
+  return (double)s.compressed_bytes / (double)s.data_bytes;
+}
+
+/************************* CompressionReport **************************/
+
+CompressionReport::CompressionReport(DirTree &tree, read_cost_params_t &params) : _tree(tree)
+{
+  const vector<int> &order = tree.getTopDownOrder();
+
+  _params = params;
+  _stats.resize(tree.getEntriesNum());
+  initCompressionStats(_global);
+
+  for(int i=0; i<tree.getEntriesNum(); i++)
+  {
+    File *f = tree.getFile(i);
+    vector<DataNode *> &valid = f->getValidDataNodes();
+
+    computeCompressionStats(*f, _params, _stats[i]);
+    addCompressionStats(_global, _stats[i]);
+    for(int j=0; j<(int)valid.size(); j++)
+      if(valid[j]->getDataSize() > 0)
+	_ratios.push_back((double)valid[j]->getCompressedSize() / valid[j]->getDataSize());
+  }
+
+  // bottom-up aggregation over the subtrees
+  for(int i=(int)order.size()-1; i>=0; i--)
+    if(tree.getParent(order[i]) != -1)
+      addCompressionStats(_stats[tree.getParent(order[i])], _stats[order[i]]);
+}
+
+compression_stats_t & CompressionReport::getStats(int entry)
+{
+  return _stats[entry];
+}
+
+compression_stats_t & CompressionReport::getGlobalStats()
+{
+  return _global;
+}
+
+ostream& operator<<(ostream& os, CompressionReport& cr)
+{
+  double ratio_bounds[] = {0.2, 0.4, 0.6, 0.8, 1.0};
+  const vector<int> &order = cr._tree.getTopDownOrder();
+
+  os << "Compression report (page read " << cr._params.page_read_us << " us, decompression "
+    << cr._params.decompress_mbps << " MB/s";
+  if(getReadpageModel() == READPAGE_KERNEL)
+    os << ", kernel readpage model, CRC " << cr._params.crc_mbps << " MB/s";
+  os << ") :" << endl;
+  for(int i=0; i<(int)order.size(); i++)
+  {
+    int entry = order[i];
+    if(cr._tree.getFile(entry)->isDeleted())
+      continue;
+    os << ((cr._tree.isDirectory(entry)) ? "  D: \"" : "  F: \"") << cr._tree.getPath(entry) << "\" ";
+    printCompressionStats(os, cr._stats[entry]);
+  }
+
+  os << "Global : ";
+  printCompressionStats(os, cr._global);
+  printHistogram(os, "Compression ratio of the valid data nodes", cr._ratios, ratio_bounds, 5);
+
+  return os;
+}
+
+void printCompressionStats(ostream &os, compression_stats_t &s)
+{
+  double compressed_us = s.io_us + s.cpu_us;
+
+  os << s.data_bytes << " -> " << s.compressed_bytes << " bytes (ratio "
+    << getCompressionRatio(s) << ", saved " << (int64_t)(s.data_bytes - s.compressed_bytes)
+    << "), " << s.compressed_nodes_num << "/" << s.nodes_num << " nodes compressed" << endl;
+  if(s.readpages_num == 0)
+    return;
+  os << "    " << s.readpages_num << " readpages : io " << s.io_us << " us + cpu " << s.cpu_us
+    << " us = " << compressed_us << " us, uncompressed " << s.uncompressed_io_us << " us, "
+    << "compression " << ((compressed_us <= s.uncompressed_io_us) ? "helps" : "hurts") << endl;
+}
@@ -0,0 +1,63 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <iostream>
+#include <vector>
+
+#include "File.hpp"
+#include "DirTree.hpp"
+
+/**
+ * Read cost model parameters
+ */
+typedef struct
+{
+  double page_read_us;			// time to read one flash page
+  double decompress_mbps;		// decompressor output throughput (MB/s)
+  double crc_mbps;			// CRC throughput, kernel readpage model only
+} read_cost_params_t;
+
+/**
+ * Compression figures for the valid data nodes of a file or a subtree,
+ * and the time spent reading all its linux pages (readpage)
+ */
+typedef struct
+{
+  int nodes_num;
+  int compressed_nodes_num;
+  uint64_t compressed_bytes;		// csize, what is stored on flash
+  uint64_t data_bytes;			// dsize, what is read by the user
+  int readpages_num;
+  double io_us;				// flash pages reads
+  double cpu_us;			// decompression, and CRC in the kernel readpage model
+  double uncompressed_io_us;		// flash reads if stored uncompressed, and CRC in the
+					// kernel readpage model
+} compression_stats_t;
+
+void initCompressionStats(compression_stats_t &s);
+void addCompressionStats(compression_stats_t &to, compression_stats_t &from);
+int computeCompressionStats(File &f, read_cost_params_t &params, compression_stats_t &res);
+double getCompressionRatio(compression_stats_t &s);
+
+/**
+ * Compression statistics of every file, aggregated per directory and
+ * globally, with the distribution of the nodes compression ratio
+ */
+class CompressionReport
+{
+  public:
+    CompressionReport(DirTree &tree, read_cost_params_t &params);
+    compression_stats_t &getStats(int entry);
+    compression_stats_t &getGlobalStats();
+
+  private:
+    DirTree &_tree;
+    read_cost_params_t _params;
+    std::vector<compression_stats_t> _stats;	// per DirTree entry, whole subtree
+    compression_stats_t _global;
+    std::vector<double> _ratios;		// per compressed valid node
+
+  friend std::ostream& operator<<(std::ostream& os, CompressionReport& cr);
+};
+
+#endif /* COMPRESSION_HPP */
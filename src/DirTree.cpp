@@ -0,0 +1,352 @@
+#include <assert.h>
+#include <sstream>
+#include <algorithm>
+
+#include "DirTree.hpp"
+
+using namespace std;
+
+/**************************** DirTree *********************************/
+
+/**
+ * Build the hierarchy in time linear in the number of files: link each
+ * entry to its parent and resolve the paths top-down. The per-file costs
+ * are aggregated bottom-up on the first stats request.
+ */
+DirTree::DirTree(FileSet &fs)
+{
+  for(int i=0; i<fs.getFilesNum(); i++)
+  {
+    dir_entry_t entry;
+    entry.file = fs.getFile(i);
+    entry.parent = -1;
+    entry.depth = 0;
+    _entries.push_back(entry);
+    _inode_index[entry.file->getInodeNum()] = i;
+  }
+
+  _stats_aggregated = false;
+  link_entries();
+  resolve_paths();
+}
+
+/**
+ * Set the parent and children of each entry. Entries whose parent
+ * directory is not in the set are kept as orphans, at the top level
+ */
+int DirTree::link_entries()
+{
+  for(int i=0; i<(int)_entries.size(); i++)
+  {
+    File *f = _entries[i].file;
+    map<uint64_t, int>::iterator it;
+
+    if(f->getInodeNum() == 1)
+    {
+      _roots.insert(_roots.begin(), i);
+      continue;
+    }
+
+    it = _inode_index.find(f->getParentInodeNum());
+    if(it == _inode_index.end() || it->second == i)
+    {
+      _roots.push_back(i);
+      continue;
+    }
+
+    _entries[i].parent = it->second;
+    _entries[it->second].children.push_back(i);
+  }
+
+  return 0;
+}
+
+/**
+ * Sort the entries top-down (a parent always comes before its children)
+ * and memoize the full path of every entry, its names escaped by
+ * escapeName.
+ * A parent loop (corrupted dump) is not reachable from any root, it is
+ * broken by detaching one of its entries, which becomes an orphan.
+ */
+int DirTree::resolve_paths()
+{
+  vector<bool> reached(_entries.size(), false);
+  int next_root = 0;
+
+  while(true)
+  {
+    for(; next_root<(int)_roots.size(); next_root++)
+    {
+      int start = _order.size();
+      _order.push_back(_roots[next_root]);
+      reached[_roots[next_root]] = true;
+
+      // breadth first, _order doubles as the queue
+      for(int i=start; i<(int)_order.size(); i++)
+      {
+	vector<int> &children = _entries[_order[i]].children;
+	for(int j=0; j<(int)children.size(); j++)
+	  if(!reached[children[j]])
+	  {
+	    reached[children[j]] = true;
+	    _order.push_back(children[j]);
+	  }
+      }
+    }
+
+    if(_order.size() == _entries.size())
+      break;
+
+    // an unreached entry hangs below a loop or is part of it, walk up the
+    // parents until an entry repeats: it is on the loop, only its parent
+    // edge is cut so that the rest of the subtree keeps its path
+    int cut = 0;
+    vector<bool> walked(_entries.size(), false);
+
+    while(reached[cut])
+      cut++;
+    while(!walked[cut])
+    {
+      walked[cut] = true;
+      cut = _entries[cut].parent;
+    }
+
+    vector<int> &siblings = _entries[_entries[cut].parent].children;
+
+    cerr << "Warning, parent loop detected on inode "
+      << _entries[cut].file->getInodeNum() << endl;
+    siblings.erase(find(siblings.begin(), siblings.end(), cut));
+    _entries[cut].parent = -1;
+    _roots.push_back(cut);
+  }
+
+  for(int i=0; i<(int)_order.size(); i++)
+  {
+    dir_entry_t &e = _entries[_order[i]];
+    File *f = e.file;
+
+    if(f->getInodeNum() == 1)
+      e.path = "/";
+    else if(e.parent == -1)
+    {
+      stringstream ss;
+      ss << "?" << f->getParentInodeNum() << "/" << escapeName(f->getName());
+      e.path = ss.str();
+    }
+    else
+    {
+      dir_entry_t &p = _entries[e.parent];
+      e.depth = p.depth + 1;
+      e.path = ((p.path == "/") ? "" : p.path) + "/" + escapeName(f->getName());
+    }
+
+    // a deleted entry may share its path with the file that replaced it
+    map<string, int>::iterator it = _path_index.find(e.path);
+    if(it == _path_index.end() || _entries[it->second].file->isDeleted())
+      _path_index[e.path] = _order[i];
+  }
+
+  return 0;
+}
+
+/**
+ * Compute the stats of each file then add them to the ancestors,
+ * processing entries bottom-up
+ */
+int DirTree::aggregate_stats()
+{
+  if(_stats_aggregated)
+    return 0;
+  _stats_aggregated = true;
+
+  for(int i=0; i<(int)_entries.size(); i++)
+  {
+    subtree_stats_t &s = _entries[i].stats;
+    File *f = _entries[i].file;
+
+    s.files_num = 1;
+    s.deleted_files_num = f->isDeleted() ? 1 : 0;
+    s.size = f->getSize();
+    s.actual_page_num = f->getConcernedPages().getPagesNum();
+    s.theoritical_page_num = f->getTheoriticalPageNum();
+    s.sequential_read_cost = f->getSequentialReadCost();
+  }
+
+  for(int i=(int)_order.size()-1; i>=0; i--)
+  {
+    dir_entry_t &e = _entries[_order[i]];
+    if(e.parent == -1)
+      continue;
+
+    subtree_stats_t &p = _entries[e.parent].stats;
+    p.files_num += e.stats.files_num;
+    p.deleted_files_num += e.stats.deleted_files_num;
+    p.size += e.stats.size;
+    p.actual_page_num += e.stats.actual_page_num;
+    p.theoritical_page_num += e.stats.theoritical_page_num;
+    p.sequential_read_cost += e.stats.sequential_read_cost;
+  }
+
+  return 0;
+}
+
+/**
+ * Return the entry for slash, or -1 if it is not in the set
+ */
+int DirTree::getRootEntry() const
+{
+  if(_roots.empty() || _entries[_roots[0]].file->getInodeNum() != 1)
+    return -1;
+  return _roots[0];
+}
+
+int DirTree::getEntriesNum() const
+{
+  return _entries.size();
+}
+
+/**
+ * Return the entry corresponding to the full path, -1 if not found
+ */
+int DirTree::findPath(string path) const
+{
+  map<string, int>::const_iterator it;
+
+  // ignore a trailing slash
+  if(path.size() > 1 && path[path.size()-1] == '/')
+    path.erase(path.size()-1);
+
+  it = _path_index.find(path);
+  if(it == _path_index.end())
+    return -1;
+  return it->second;
+}
+
+/**
+ * Return the entry for the file with that inode number, -1 if not found
+ */
+int DirTree::findInode(uint64_t inode_num) const
+{
+  map<uint64_t, int>::const_iterator it = _inode_index.find(inode_num);
+  if(it == _inode_index.end())
+    return -1;
+  return it->second;
+}
+
+string DirTree::getPath(int entry) const
+{
+  return _entries[entry].path;
+}
+
+File * DirTree::getFile(int entry) const
+{
+  return _entries[entry].file;
+}
+
+/**
+ * -1 for slash and the orphans
+ */
+int DirTree::getParent(int entry) const
+{
+  return _entries[entry].parent;
+}
+
+const vector<int> & DirTree::getTopDownOrder() const
+{
+  return _order;
+}
+
+/**
+ * jffs2dump does not give the inode mode so only the directories
+ * holding at least one entry are identified
+ */
+bool DirTree::isDirectory(int entry) const
+{
+  return (_entries[entry].file->getInodeNum() == 1 ||
+    !_entries[entry].children.empty());
+}
+
+const vector<int> & DirTree::getChildren(int entry) const
+{
+  return _entries[entry].children;
+}
+
+subtree_stats_t & DirTree::getSubtreeStats(int entry)
+{
+  aggregate_stats();
+  return _entries[entry].stats;
+}
+
+/**
+ * Print the subtree rooted at entry, depth first
+ */
+void DirTree::printSubtree(ostream &os, int entry)
+{
+  vector<int> stack;
+
+  aggregate_stats();
+  stack.push_back(entry);
+  while(!stack.empty())
+  {
+    int cur = stack.back();
+    stack.pop_back();
+
+    for(int i=0; i<_entries[cur].depth - _entries[entry].depth; i++)
+      os << "  ";
+    printEntry(os, cur);
+
+    vector<int> &children = _entries[cur].children;
+    for(int i=(int)children.size()-1; i>=0; i--)
+      stack.push_back(children[i]);
+  }
+}
+
+void DirTree::printEntry(ostream &os, int entry)
+{
+  subtree_stats_t &s = _entries[entry].stats;
+
+  if(isDirectory(entry))
+    os << "  D: \"" << _entries[entry].path << "\" files:" << s.files_num-1
+      << " (deleted:" << s.deleted_files_num << ")";
+  else
+    os << "  F: \"" << _entries[entry].path << "\""
+      << ((_entries[entry].file->isDeleted()) ? " [DELETED]" : "");
+
+  os << ", size:" << s.size << ", frag:" << getFragmentationFactor(s)
+    << ", seq. read cost:" << s.sequential_read_cost << endl;
+}
+
+/**
+ * Same definition as for a single file: pages holding the valid data
+ * nodes over the minimal number of pages needed to store them
+ */
+double getFragmentationFactor(subtree_stats_t &stats)
+{
+  if(stats.theoritical_page_num == 0)
+    return 0.0;
+  return (double)stats.actual_page_num / (double)stats.theoritical_page_num;
+}
+
+/**
+ * A dirent name as one path component : '%' and '/' are written %25 and
+ * %2F, and the names that are not a plain component, "", "." and "..",
+ * %00, %2E and %2E%2E, so that no path of the tree leaves its parent
+ */
+string escapeName(const string &name)
+{
+  string res;
+
+  if(name.empty())
+    return "%00";
+  if(name == "." || name == "..")
+    return (name == ".") ? "%2E" : "%2E%2E";
+
+  for(int i=0; i<(int)name.size(); i++)
+    if(name[i] == '%')
+      res += "%25";
+    else if(name[i] == '/')
+      res += "%2F";
+    else
+      res += name[i];
+  return res;
+}
@@ -0,0 +1,75 @@
+#ifndef DIR_TREE_HPP
+#define DIR_TREE_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+
+#include "File.hpp"
+
+/**
+ * Costs aggregated over a file or over a whole subtree
+ */
+typedef struct
+{
+  int files_num;			// number of entries, the subtree root included
+  int deleted_files_num;		// number of deleted entries
+  uint64_t size;			// total size in bytes
+  int actual_page_num;			// flash pages containing valid data nodes
+  int theoritical_page_num;		// minimal number of flash pages needed
+  int sequential_read_cost;		// flash pages read when reading every file sequentially
+} subtree_stats_t;
+
+double getFragmentationFactor(subtree_stats_t &stats);
+std::string escapeName(const std::string &name);
+
+/**
+ * Directory hierarchy of a FileSet, built from the dirents parent inode
+ * numbers. Full paths, their names escaped by escapeName, are resolved
+ * once at construction time, the subtree stats, which compute the costs
+ * of every file, only when first needed.
+ */
+class DirTree
+{
+  public:
+    DirTree(FileSet &fs);
+
+    int getRootEntry() const;
+    int getEntriesNum() const;
+    int findPath(std::string path) const;
+    int findInode(uint64_t inode_num) const;
+    std::string getPath(int entry) const;
+    File *getFile(int entry) const;
+    int getParent(int entry) const;
+    const std::vector<int> &getTopDownOrder() const;
+    bool isDirectory(int entry) const;
+    const std::vector<int> &getChildren(int entry) const;
+    subtree_stats_t &getSubtreeStats(int entry);
+    void printSubtree(std::ostream &os, int entry);
+
+  private:
+    typedef struct
+    {
+      File *file;
+      int parent;			// -1 for slash and orphans
+      int depth;
+      std::vector<int> children;
+      std::string path;
+      subtree_stats_t stats;		// stats for the subtree rooted here
+    } dir_entry_t;
+
+    std::vector<dir_entry_t> _entries;
+    std::vector<int> _roots;			// slash first, then orphans
+    std::map<std::string, int> _path_index;
+    std::map<uint64_t, int> _inode_index;
+    std::vector<int> _order;			// a parent always comes before its children
+    bool _stats_aggregated;
+
+    int link_entries();
+    int resolve_paths();
+    int aggregate_stats();
+    void printEntry(std::ostream &os, int entry);
+};
+
+#endif /* DIR_TREE_HPP */
@@ -0,0 +1,343 @@
+#include <assert.h>
+
+#include "DumpDiff.hpp"
+
+using namespace std;
+
+node_key_t getNodeKey(Node *n);
+void initFileDiff(file_diff_t &fd, uint64_t inode_num);
+void setFileCosts(File *f, uint32_t &size, int &pages, int &min_pages, int &seq_cost, bool &deleted);
+double getFragmentationFactor(int pages, int min_pages);
+
+/**************************** DumpDiff ********************************/
+
+/**
+ * Walk the two node sets sorted by key, side by side. A file is
+ * finalized again only if one of its nodes appeared, was erased or
+ * moved, or if a deletion dirent for its name came or went.
+ */
+DumpDiff::DumpDiff(vector<Chunk *> &old_chunks, vector<Chunk *> &new_chunks)
+{
+  map<node_key_t, Node *> old_nodes, new_nodes;
+  map<node_key_t, Node *>::iterator o, n;
+  map<uint64_t, file_diff_t> node_counts;
+  set<uint64_t> changed;
+  set<string> names;
+  vector<Chunk *> old_sub, new_sub;
+
+  _new_nodes = _erased_nodes = _moved_nodes = _obsoleted_nodes = 0;
+
+  index_nodes(old_chunks, old_nodes);
+  index_nodes(new_chunks, new_nodes);
+
+  o = old_nodes.begin();
+  n = new_nodes.begin();
+  while(o != old_nodes.end() || n != new_nodes.end())
+  {
+    Node *old_node = NULL, *new_node = NULL;
+
+    if(n == new_nodes.end() || (o != old_nodes.end() && o->first < n->first))
+      old_node = (o++)->second;
+    else if(o == old_nodes.end() || n->first < o->first)
+      new_node = (n++)->second;
+    else
+    {
+      old_node = (o++)->second;
+      new_node = (n++)->second;
+      if(old_node->getFlashAddr().getFlashOffset() == new_node->getFlashAddr().getFlashOffset())
+	continue;
+    }
+
+    Node *node = (old_node != NULL) ? old_node : new_node;
+    uint64_t owner = node->getInodeNum();
+
+    if(owner == 0)
+      names.insert(static_cast<DirentNode *>(node)->getName());
+    else
+    {
+      changed.insert(owner);
+      if(node_counts.find(owner) == node_counts.end())
+	initFileDiff(node_counts[owner], owner);
+    }
+
+    file_diff_t &fd = node_counts[owner];
+    if(new_node == NULL)
+    {
+      _erased_nodes++;
+      fd.erased_nodes++;
+    }
+    else if(old_node == NULL)
+    {
+      _new_nodes++;
+      fd.new_nodes++;
+    }
+    else
+    {
+      _moved_nodes++;
+      fd.moved_nodes++;
+    }
+  }
+  node_counts.erase(0);
+
+  find_renamed_inodes(old_chunks, names, changed);
+  find_renamed_inodes(new_chunks, names, changed);
+
+  extract_chunks(old_chunks, changed, old_sub);
+  extract_chunks(new_chunks, changed, new_sub);
+
+  FileSet old_fs(old_sub);
+  FileSet new_fs(new_sub);
+
+  compare_files(old_fs, new_fs, changed, node_counts, new_nodes);
+}
+
+/**
+ * Index the data and dirent nodes by key. When a key is present twice
+ * the first node is kept, as the parser does for data nodes.
+ */
+int DumpDiff::index_nodes(vector<Chunk *> &chunks, map<node_key_t, Node *> &nodes)
+{
+  for(int i=0; i<(int)chunks.size(); i++)
+    if(chunks[i]->getType() == DATA_NODE || chunks[i]->getType() == DIRENT_NODE)
+    {
+      Node *n = static_cast<Node *>(chunks[i]);
+      nodes.insert(make_pair(getNodeKey(n), n));
+    }
+
+  return 0;
+}
+
+/**
+ * A deleted file is found by the name of its last dirent, so adding or
+ * erasing a deletion dirent changes the files having this name
+ */
+int DumpDiff::find_renamed_inodes(vector<Chunk *> &chunks, set<string> &names, set<uint64_t> &changed)
+{
+  map<uint64_t, DirentNode *> last_dirents;
+
+  if(names.empty())
+    return 0;
+
+  for(int i=0; i<(int)chunks.size(); i++)
+    if(chunks[i]->getType() == DIRENT_NODE)
+    {
+      DirentNode *dn = static_cast<DirentNode *>(chunks[i]);
+      DirentNode *&last = last_dirents[dn->getInodeNum()];
+      if(dn->getInodeNum() != 0 && (last == NULL || last->getVersionNum() < dn->getVersionNum()))
+	last = dn;
+    }
+
+  for(map<uint64_t, DirentNode *>::iterator it = last_dirents.begin(); it != last_dirents.end(); ++it)
+    if(it->second != NULL && names.find(it->second->getName()) != names.end())
+      changed.insert(it->first);
+
+  return 0;
+}
+
+/**
+ * Keep the nodes of the changed files, plus all the deletion dirents
+ * as any of them may apply to a changed file
+ */
+int DumpDiff::extract_chunks(vector<Chunk *> &chunks, set<uint64_t> &changed, vector<Chunk *> &res)
+{
+  for(int i=0; i<(int)chunks.size(); i++)
+    if(chunks[i]->getType() == DATA_NODE || chunks[i]->getType() == DIRENT_NODE)
+    {
+      uint64_t inode_num = static_cast<Node *>(chunks[i])->getInodeNum();
+      if(inode_num == 0 || changed.find(inode_num) != changed.end())
+	res.push_back(chunks[i]);
+    }
+
+  return 0;
+}
+
+/**
+ * Compute the costs of the changed files on both sides, and count the
+ * nodes still present but no longer valid
+ */
+int DumpDiff::compare_files(FileSet &old_fs, FileSet &new_fs, set<uint64_t> &changed,
+  map<uint64_t, file_diff_t> &node_counts, map<node_key_t, Node *> &new_nodes)
+{
+  map<uint64_t, File *> old_files, new_files;
+
+  for(int i=0; i<old_fs.getFilesNum(); i++)
+    old_files[old_fs.getFile(i)->getInodeNum()] = old_fs.getFile(i);
+  for(int i=0; i<new_fs.getFilesNum(); i++)
+    new_files[new_fs.getFile(i)->getInodeNum()] = new_fs.getFile(i);
+
+  for(set<uint64_t>::iterator it = changed.begin(); it != changed.end(); ++it)
+  {
+    file_diff_t fd;
+    File *old_f = (old_files.count(*it)) ? old_files[*it] : NULL;
+    File *new_f = (new_files.count(*it)) ? new_files[*it] : NULL;
+
+    if(node_counts.find(*it) != node_counts.end())
+      fd = node_counts[*it];
+    else
+      initFileDiff(fd, *it);
+
+    // files without any dirent are discarded by the FileSet
+    if(old_f == NULL && new_f == NULL)
+      continue;
+
+    fd.in_old = (old_f != NULL);
+    fd.in_new = (new_f != NULL);
+    fd.name = (new_f != NULL) ? new_f->getName() : old_f->getName();
+    if(old_f != NULL)
+      setFileCosts(old_f, fd.size_old, fd.pages_old, fd.min_pages_old, fd.seq_cost_old, fd.deleted_old);
+    if(new_f != NULL)
+      setFileCosts(new_f, fd.size_new, fd.pages_new, fd.min_pages_new, fd.seq_cost_new, fd.deleted_new);
+
+    if(old_f != NULL)
+    {
+      set<node_key_t> new_valid;
+      vector<DataNode *> &old_valid = old_f->getValidDataNodes();
+
+      if(new_f != NULL)
+      {
+	vector<DataNode *> &valid = new_f->getValidDataNodes();
+	for(int i=0; i<(int)valid.size(); i++)
+	  new_valid.insert(getNodeKey(valid[i]));
+      }
+
+      // valid before, still on flash but not valid any more
+      for(int i=0; i<(int)old_valid.size(); i++)
+      {
+	node_key_t key = getNodeKey(old_valid[i]);
+	if(new_valid.find(key) == new_valid.end() && new_nodes.find(key) != new_nodes.end())
+	  fd.obsoleted_nodes++;
+      }
+    }
+
+    _obsoleted_nodes += fd.obsoleted_nodes;
+    _file_diffs.push_back(fd);
+  }
+
+  return 0;
+}
+
+int DumpDiff::getNewNodesNum()
+{
+  return _new_nodes;
+}
+
+int DumpDiff::getErasedNodesNum()
+{
+  return _erased_nodes;
+}
+
+int DumpDiff::getMovedNodesNum()
+{
+  return _moved_nodes;
+}
+
+int DumpDiff::getObsoletedNodesNum()
+{
+  return _obsoleted_nodes;
+}
+
+vector<file_diff_t> & DumpDiff::getFileDiffs()
+{
+  return _file_diffs;
+}
+
+ostream& operator<<(ostream& os, DumpDiff& diff)
+{
+  int pages_old = 0, pages_new = 0, min_pages_old = 0, min_pages_new = 0;
+  int seq_cost_old = 0, seq_cost_new = 0;
+
+  for(int i=0; i<(int)diff._file_diffs.size(); i++)
+  {
+    file_diff_t &fd = diff._file_diffs[i];
+    pages_old += fd.pages_old;
+    pages_new += fd.pages_new;
+    min_pages_old += fd.min_pages_old;
+    min_pages_new += fd.min_pages_new;
+    seq_cost_old += fd.seq_cost_old;
+    seq_cost_new += fd.seq_cost_new;
+  }
+
+  os << "DumpDiff :" << endl;
+  os << "  Nodes : " << diff._new_nodes << " new, " << diff._erased_nodes << " erased, "
+    << diff._moved_nodes << " moved, " << diff._obsoleted_nodes << " obsoleted" << endl;
+  os << "  Changed files : " << diff._file_diffs.size() << endl;
+  os << "  Fragmentation factor (changed files) : " << getFragmentationFactor(pages_old, min_pages_old)
+    << " -> " << getFragmentationFactor(pages_new, min_pages_new) << endl;
+  os << "  Seq. read cost (changed files) : " << seq_cost_old << " -> " << seq_cost_new
+    << " (" << showpos << seq_cost_new - seq_cost_old << noshowpos << ")" << endl;
+
+  for(int i=0; i<(int)diff._file_diffs.size(); i++)
+  {
+    file_diff_t &fd = diff._file_diffs[i];
+
+    os << "  F: \"" << fd.name << "\" ino:" << fd.inode_num;
+    if(!fd.in_old)
+      os << " [CREATED]";
+    else if(!fd.in_new)
+      os << " [VANISHED]";
+    else if(fd.deleted_new && !fd.deleted_old)
+      os << " [DELETED]";
+    os << ", size: " << fd.size_old << " -> " << fd.size_new
+      << ", frag: " << getFragmentationFactor(fd.pages_old, fd.min_pages_old)
+      << " -> " << getFragmentationFactor(fd.pages_new, fd.min_pages_new)
+      << ", seq. read cost: " << fd.seq_cost_old << " -> " << fd.seq_cost_new
+      << " (" << showpos << fd.seq_cost_new - fd.seq_cost_old << noshowpos << ")" << endl;
+    os << "    nodes : " << fd.new_nodes << " new, " << fd.erased_nodes << " erased, "
+      << fd.moved_nodes << " moved, " << fd.obsoleted_nodes << " obsoleted" << endl;
+  }
+
+  return os;
+}
+
+/****************************** Tools *********************************/
+
+bool operator<(const node_key_t &a, const node_key_t &b)
+{
+  if(a.type != b.type)
+    return a.type < b.type;
+  if(a.inode_num != b.inode_num)
+    return a.inode_num < b.inode_num;
+  return a.version_num < b.version_num;
+}
+
+node_key_t getNodeKey(Node *n)
+{
+  node_key_t key;
+
+  key.type = n->getType();
+  key.version_num = n->getVersionNum();
+  if(key.type == DIRENT_NODE)
+    key.inode_num = static_cast<DirentNode *>(n)->getParentInodeNum();
+  else
+    key.inode_num = n->getInodeNum();
+
+  return key;
+}
+
+void initFileDiff(file_diff_t &fd, uint64_t inode_num)
+{
+  fd.inode_num = inode_num;
+  fd.in_old = fd.in_new = false;
+  fd.deleted_old = fd.deleted_new = false;
+  fd.size_old = fd.size_new = 0;
+  fd.pages_old = fd.pages_new = 0;
+  fd.min_pages_old = fd.min_pages_new = 0;
+  fd.seq_cost_old = fd.seq_cost_new = 0;
+  fd.new_nodes = fd.erased_nodes = fd.moved_nodes = fd.obsoleted_nodes = 0;
+}
+
+void setFileCosts(File *f, uint32_t &size, int &pages, int &min_pages, int &seq_cost, bool &deleted)
+{
+  size = f->getSize();
+  pages = f->getConcernedPages().getPagesNum();
+  min_pages = f->getTheoriticalPageNum();
+  seq_cost = f->getSequentialReadCost();
+  deleted = f->isDeleted();
+}
+
+double getFragmentationFactor(int pages, int min_pages)
+{
+  if(min_pages == 0)
+    return 0.0;
+  return (double)pages / (double)min_pages;
+}
@@ -0,0 +1,73 @@
+#ifndef DUMP_DIFF_HPP
+#define DUMP_DIFF_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+
+#include "ChunkModel.hpp"
+#include "File.hpp"
+
+/**
+ * Identifies a node across dumps : (ino, version) for a data node,
+ * (pino, version) for a dirent as dirent versions are per directory
+ */
+typedef struct
+{
+  chunk_type type;
+  uint64_t inode_num;
+  uint32_t version_num;
+} node_key_t;
+
+bool operator<(const node_key_t &a, const node_key_t &b);
+
+/**
+ * Per file costs, before and after
+ */
+typedef struct
+{
+  uint64_t inode_num;
+  std::string name;
+  bool in_old, in_new;			// file present in the old/new dump
+  bool deleted_old, deleted_new;
+  uint32_t size_old, size_new;
+  int pages_old, pages_new;		// flash pages holding valid data
+  int min_pages_old, min_pages_new;	// minimal number of pages needed
+  int seq_cost_old, seq_cost_new;
+  int new_nodes, erased_nodes, moved_nodes, obsoleted_nodes;
+} file_diff_t;
+
+/**
+ * Difference between two dumps of the same partition. Nodes are
+ * matched by key then by flash offset, and only the files whose node
+ * set changed are finalized, on both sides.
+ */
+class DumpDiff
+{
+  public:
+    DumpDiff(std::vector<Chunk *> &old_chunks, std::vector<Chunk *> &new_chunks);
+
+    int getNewNodesNum();
+    int getErasedNodesNum();
+    int getMovedNodesNum();
+    int getObsoletedNodesNum();
+    std::vector<file_diff_t> &getFileDiffs();
+
+  private:
+    int _new_nodes, _erased_nodes, _moved_nodes, _obsoleted_nodes;
+    std::vector<file_diff_t> _file_diffs;
+
+    int index_nodes(std::vector<Chunk *> &chunks, std::map<node_key_t, Node *> &nodes);
+    int find_renamed_inodes(std::vector<Chunk *> &chunks, std::set<std::string> &names,
+      std::set<uint64_t> &changed);
+    int extract_chunks(std::vector<Chunk *> &chunks, std::set<uint64_t> &changed,
+      std::vector<Chunk *> &res);
+    int compare_files(FileSet &old_fs, FileSet &new_fs, std::set<uint64_t> &changed,
+      std::map<uint64_t, file_diff_t> &node_counts, std::map<node_key_t, Node *> &new_nodes);
+
+  friend std::ostream& operator<<(std::ostream& os, DumpDiff& diff);
+};
+
+#endif /* DUMP_DIFF_HPP */
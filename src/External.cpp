@@ -0,0 +1,376 @@
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <queue>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "External.hpp"
+#include "Parser.hpp"
+#include "File.hpp"
+#include "Input.hpp"
+#include "Hash.hpp"
+
+using namespace std;
+
+bool compareFilesByInode(File *a, File *b);
+
+/************************** ExternalFileMap ***************************/
+
+ExternalFileMap::ExternalFileMap(FlashGeometry &geometry, uint64_t memory_budget)
+{
+  _geometry = geometry;
+  _memory_budget = max(memory_budget, (uint64_t)1);
+  _buckets_num = 0;
+  _files_num = 0;
+}
+
+ExternalFileMap::~ExternalFileMap()
+{
+  for(int i=0; i<(int)_spill_paths.size(); i++)
+    remove(_spill_paths[i].c_str());
+  for(int i=0; i<(int)_result_paths.size(); i++)
+    remove(_result_paths[i].c_str());
+  if(!_dir.empty())
+    rmdir(_dir.c_str());
+}
+
+int ExternalFileMap::getBucketsNum()
+{
+  return _buckets_num;
+}
+
+/**
+ * Print the filemap of the dump at path, "-" for stdin
+ */
+int ExternalFileMap::run(char *path, ostream &os)
+{
+  const char *tmp_dir = getenv("TMPDIR");
+  string dir_template = string((tmp_dir != NULL) ? tmp_dir : "/tmp") + "/jffs2dparser.XXXXXX";
+  vector<char> dir(dir_template.begin(), dir_template.end());
+  istream *in = openDump(path);
+  struct stat st;
+  int ret;
+
+  if(in == NULL)
+    return -1;
+  // the size of a compressed dump says little about its nodes
+  if(!strcmp(path, "-") || dynamic_cast<DecompressedStream *>(in) != NULL ||
+    stat(path, &st) < 0)
+    _buckets_num = EXTERNAL_STDIN_BUCKETS_NUM;
+  else
+    _buckets_num = min((uint64_t)EXTERNAL_MAX_BUCKETS_NUM,
+      (st.st_size * EXTERNAL_BYTES_PER_DUMP_BYTE) / _memory_budget + 1);
+
+  dir.push_back('\0');
+  if(mkdtemp(&dir[0]) == NULL)
+  {
+    cerr << "Can't create a spill directory in " << ((tmp_dir != NULL) ? tmp_dir : "/tmp")
+      << endl;
+    closeDump(in);
+    return -1;
+  }
+  _dir = &dir[0];
+  for(int i=0; i<=_buckets_num; i++)
+  {
+    stringstream ss;
+    ss << _dir << "/bucket" << i;
+    _spill_paths.push_back(ss.str());
+  }
+
+  ret = spill(*in);
+  if(closeDump(in) < 0 || ret < 0)
+    return -1;
+
+  if(finalizeBuckets() < 0)
+    return -1;
+
+  return merge(os);
+}
+
+/**
+ * Write each node line to the bucket of its inode, the free space and
+ * the summaries don't matter to the files and are dropped
+ */
+int ExternalFileMap::spill(istream &in)
+{
+  vector<ofstream *> buckets;
+  string line;
+  int ret = 0;
+
+  for(int i=0; i<=_buckets_num; i++)
+  {
+    buckets.push_back(new ofstream(_spill_paths[i].c_str()));
+    if(!*buckets[i])
+    {
+      cerr << "Can't create " << _spill_paths[i] << endl;
+      ret = -1;
+      break;
+    }
+  }
+
+  while(ret == 0 && getline(in, line))
+  {
+    Chunk *c = NULL;
+
+    if(line.empty() || line[0] == '#' || line[0] == 'W')
+      continue;
+    if(parseChunk(line, &c, _geometry) < 0)
+    {
+      cerr << "Error parsing this line :" << endl;
+      cerr << "  \"" << line << "\"" << endl;
+      ret = -1;
+      break;
+    }
+
+    if(c->getType() == DATA_NODE || c->getType() == DIRENT_NODE)
+    {
+      uint64_t ino = static_cast<Node *>(c)->getInodeNum();
+      int bucket = (ino == 0) ? _buckets_num : getInodeBucket(ino, _buckets_num);
+      *buckets[bucket] << line << '\n';
+    }
+    delete c;
+  }
+
+  for(int i=0; i<(int)buckets.size(); i++)
+  {
+    if(ret == 0 && !buckets[i]->flush())
+    {
+      cerr << "Error writing " << _spill_paths[i] << endl;
+      ret = -1;
+    }
+    delete buckets[i];
+  }
+
+  return ret;
+}
+
+/**
+ * Finalize every bucket, held in memory along with the deletions bucket,
+ * spilling again to smaller buckets the ones too big for the budget
+ */
+int ExternalFileMap::finalizeBuckets()
+{
+  struct stat st;
+  uint64_t deletions_bytes = 0;
+
+  if(stat(_spill_paths[_buckets_num].c_str(), &st) == 0)
+    deletions_bytes = st.st_size * EXTERNAL_BYTES_PER_DUMP_BYTE;
+  if(deletions_bytes >= _memory_budget)
+    cerr << "Warning, the deletion dirents alone need more than the memory budget" << endl;
+
+  for(int i=0; i<_buckets_num; i++)
+  {
+    uint64_t bytes = 0;
+    int parts_num = 1;
+
+    if(stat(_spill_paths[i].c_str(), &st) == 0)
+      bytes = st.st_size * EXTERNAL_BYTES_PER_DUMP_BYTE;
+    if(deletions_bytes < _memory_budget)
+      parts_num = min((uint64_t)EXTERNAL_MAX_BUCKETS_NUM,
+	bytes / (_memory_budget - deletions_bytes) + 1);
+
+    if(parts_num == 1)
+    {
+      if(finalizeBucket(_spill_paths[i]) < 0)
+	return -1;
+    }
+    else if(splitBucket(i, parts_num) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Spill a bucket again to parts_num buckets and finalize them. An inode
+ * of this bucket hashed over the buckets_num * parts_num buckets lands in
+ * one whose number is this one modulo buckets_num, the quotient is its part.
+ */
+int ExternalFileMap::splitBucket(int bucket, int parts_num)
+{
+  vector<ofstream *> parts;
+  ifstream in(_spill_paths[bucket].c_str());
+  int first_part = _spill_paths.size();
+  string line;
+  int ret = 0;
+
+  if(!in)
+  {
+    cerr << "Can't open " << _spill_paths[bucket] << endl;
+    return -1;
+  }
+  for(int i=0; i<parts_num && ret == 0; i++)
+  {
+    stringstream ss;
+    ss << _spill_paths[bucket] << "." << i;
+    _spill_paths.push_back(ss.str());
+    parts.push_back(new ofstream(ss.str().c_str()));
+    if(!*parts.back())
+    {
+      cerr << "Can't create " << ss.str() << endl;
+      ret = -1;
+    }
+  }
+
+  while(ret == 0 && getline(in, line))
+  {
+    Chunk *c = NULL;
+
+    if(parseChunk(line, &c, _geometry) < 0)
+    {
+      cerr << "Error parsing " << _spill_paths[bucket] << endl;
+      ret = -1;
+      break;
+    }
+    *parts[getInodeBucket(static_cast<Node *>(c)->getInodeNum(), _buckets_num * parts_num) /
+      _buckets_num] << line << '\n';
+    delete c;
+  }
+  in.close();
+  remove(_spill_paths[bucket].c_str());
+
+  for(int i=0; i<(int)parts.size(); i++)
+  {
+    if(ret == 0 && !parts[i]->flush())
+    {
+      cerr << "Error writing " << _spill_paths[first_part + i] << endl;
+      ret = -1;
+    }
+    delete parts[i];
+  }
+
+  for(int i=0; i<parts_num && ret == 0; i++)
+    ret = finalizeBucket(_spill_paths[first_part + i]);
+
+  return ret;
+}
+
+/**
+ * Build the files of one bucket, with every deletion dirent, and write
+ * their filemap blocks to a new result file as "<ino> <length>" lines
+ * each followed by the block
+ */
+int ExternalFileMap::finalizeBucket(string &spill_path)
+{
+  vector<Chunk *> chunks;
+  vector<File *> files;
+  int ret = 0;
+
+  if(loadBucket(spill_path, chunks) < 0 || loadBucket(_spill_paths[_buckets_num], chunks) < 0)
+    ret = -1;
+  remove(spill_path.c_str());
+
+  if(ret == 0)
+  {
+    FileSet fs(chunks, false);
+    stringstream path;
+
+    path << _dir << "/result" << _result_paths.size();
+    _result_paths.push_back(path.str());
+    ofstream out(_result_paths.back().c_str());
+
+    for(int i=0; i<fs.getFilesNum(); i++)
+      if(fs.getFile(i)->getInodeNum() != 1)
+	files.push_back(fs.getFile(i));
+    sort(files.begin(), files.end(), compareFilesByInode);
+
+    for(int i=0; i<(int)files.size(); i++)
+    {
+      stringstream ss;
+      ss << *files[i];
+      out << files[i]->getInodeNum() << " " << ss.str().size() << '\n' << ss.str();
+      _files_num++;
+    }
+    if(!out.flush())
+    {
+      cerr << "Error writing " << _result_paths.back() << endl;
+      ret = -1;
+    }
+  }
+
+  for(int i=0; i<(int)chunks.size(); i++)
+    delete chunks[i];
+
+  return ret;
+}
+
+int ExternalFileMap::loadBucket(string &path, vector<Chunk *> &res)
+{
+  ifstream in(path.c_str());
+  string line;
+
+  if(!in)
+  {
+    cerr << "Can't open " << path << endl;
+    return -1;
+  }
+  while(getline(in, line))
+    if(parseLine(line, res, _geometry) < 0)
+    {
+      cerr << "Error parsing " << path << endl;
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * Print the blocks of every result file by increasing inode number
+ */
+int ExternalFileMap::merge(ostream &os)
+{
+  typedef pair<uint64_t, int> head_t;	// inode of the next block, bucket
+  priority_queue<head_t, vector<head_t>, greater<head_t> > heads;
+  vector<ifstream *> results;
+  vector<uint64_t> lengths(_result_paths.size(), 0);
+  vector<char> buf;
+  int ret = 0;
+
+  os << "FileSet with " << _files_num + 1 << " files :" << endl;
+  os << "  F: \"slash\"" << endl;
+
+  for(int i=0; i<(int)_result_paths.size(); i++)
+  {
+    uint64_t ino;
+    results.push_back(new ifstream(_result_paths[i].c_str()));
+    if(*results[i] >> ino >> lengths[i])
+      heads.push(make_pair(ino, i));
+  }
+
+  while(!heads.empty() && ret == 0)
+  {
+    int bucket = heads.top().second;
+    ifstream &in = *results[bucket];
+    uint64_t ino;
+
+    heads.pop();
+    buf.resize(lengths[bucket]);
+    in.get();				// end of the header line
+    if(!in.read(&buf[0], buf.size()))
+    {
+      cerr << "Error reading " << _result_paths[bucket] << endl;
+      ret = -1;
+      break;
+    }
+    os.write(&buf[0], buf.size());
+    os << endl;
+    if(in >> ino >> lengths[bucket])
+      heads.push(make_pair(ino, bucket));
+  }
+
+  for(int i=0; i<(int)results.size(); i++)
+    delete results[i];
+
+  return ret;
+}
+
+/****************************** Tools *********************************/
+
+bool compareFilesByInode(File *a, File *b)
+{
+  return a->getInodeNum() < b->getInodeNum();
+}
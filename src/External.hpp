@@ -0,0 +1,55 @@
+#ifndef EXTERNAL_HPP
+#define EXTERNAL_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "ChunkModel.hpp"
+
+#define EXTERNAL_BYTES_PER_DUMP_BYTE		8	// memory used per byte of dump text, estimated
+#define EXTERNAL_STDIN_BUCKETS_NUM		64	// when the dump size is not known, first guess
+#define EXTERNAL_MAX_BUCKETS_NUM		512	// each is an open file while spilling
+
+/**
+ * Filemap report of a dump larger than the memory : while parsing, the
+ * nodes are spilled as dump lines to on-disk buckets chosen by a hash of
+ * their inode number, so that every node of a file lands in the same
+ * bucket. The deletion dirents, which apply by name to any inode, are
+ * kept in a bucket of their own read along with each of the others.
+ * Each bucket is then loaded and finalized alone, its files written to a
+ * result file in inode order, and the result files merged. The number of
+ * buckets follows from the size of the dump and the memory budget, or is
+ * a guess for stdin and compressed dumps : a bucket that turns out bigger
+ * than the budget, the deletions bucket included, is spilled again to
+ * smaller ones before it is finalized. The block of each file is the one
+ * of the in-memory filemap, files are listed by inode number instead of
+ * flash order. One file bigger than the budget still has to fit in
+ * memory, as do the deletion dirents.
+ */
+class ExternalFileMap
+{
+  public:
+    ExternalFileMap(FlashGeometry &geometry, uint64_t memory_budget);
+    ~ExternalFileMap();
+    int run(char *path, std::ostream &os);
+    int getBucketsNum();
+
+  private:
+    FlashGeometry _geometry;
+    uint64_t _memory_budget;
+    int _buckets_num;
+    std::string _dir;			// spill directory, removed by the destructor
+    std::vector<std::string> _spill_paths;	// the deletions bucket after the buckets
+    std::vector<std::string> _result_paths;	// one per bucket finalized
+    uint64_t _files_num;		// slash excluded
+
+    int spill(std::istream &in);
+    int finalizeBuckets();
+    int splitBucket(int bucket, int parts_num);
+    int finalizeBucket(std::string &spill_path);
+    int merge(std::ostream &os);
+    int loadBucket(std::string &path, std::vector<Chunk *> &res);
+};
+
+#endif /* EXTERNAL_HPP */
@@ -0,0 +1,705 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "Extract.hpp"
+#include "Generator.hpp"
+#include "Stats.hpp"
+
+using namespace std;
+
+#define JFFS2_MAGIC				0x1985
+#define JFFS2_NODETYPE_INODE			0xe002
+#define JFFS2_RAW_INODE_SIZE			68
+#define JFFS2_MAX_NODE_SIZE			(64*1024)	// far more than a linux page of data
+#define LZO_M2_MAX_OFFSET			0x0800
+#define LZO_M4_BASE_OFFSET			0x4000
+
+bool compareNodesByVersion(DataNode *a, DataNode *b);
+int makeDirs(const string &path);
+int pwriteAll(int fd, const unsigned char *buf, uint32_t len, uint64_t offset);
+int copyRange(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint32_t len);
+uint32_t get16(const unsigned char *p);
+uint32_t get32(const unsigned char *p);
+
+/*************************** FileExtractor ****************************/
+
+FileExtractor::FileExtractor(DirTree &tree, FlashGeometry &geometry) : _tree(tree)
+{
+  _geometry = geometry;
+  _image_fd = -1;
+  _check_crc = true;
+  _next = 0;
+  _seconds = 0.0;
+  memset(&_stats, 0, sizeof(_stats));
+}
+
+/**
+ * Extract every live file of the tree from the image at image_path to
+ * out_dir, with threads_num workers
+ */
+int FileExtractor::run(const char *image_path, const char *out_dir, int threads_num,
+  bool check_crc)
+{
+  const vector<int> &order = _tree.getTopDownOrder();
+  vector<pthread_t> threads;
+  double start = getMonotonicTime();
+  char real_out_dir[PATH_MAX];
+
+  _out_dir = out_dir;
+  while(_out_dir.size() > 1 && _out_dir[_out_dir.size()-1] == '/')
+    _out_dir.erase(_out_dir.size()-1);
+  _check_crc = check_crc;
+  _image_fd = open(image_path, O_RDONLY);
+  if(_image_fd < 0)
+  {
+    cerr << "Can't open " << image_path << endl;
+    return -1;
+  }
+  if(makeDirs(_out_dir) < 0 || realpath(_out_dir.c_str(), real_out_dir) == NULL)
+  {
+    close(_image_fd);
+    return -1;
+  }
+  _real_out_dir = real_out_dir;
+
+  // parents come first, so only the orphans need their missing parents
+  for(int i=0; i<(int)order.size(); i++)
+  {
+    File *f = _tree.getFile(order[i]);
+    string path = getOutputPath(order[i]);
+
+    if(f == NULL || f->isDeleted() || f->getInodeNum() == 1)
+      continue;
+    if(_tree.isDirectory(order[i]))
+    {
+      if(makeOutputDirs(path) == 0)
+	_stats.dirs_num++;
+      continue;
+    }
+    if(_tree.getParent(order[i]) == -1 || _tree.getFile(_tree.getParent(order[i]))->isDeleted())
+      makeOutputDirs(path.substr(0, path.rfind('/')));
+    _files.push_back(order[i]);
+  }
+
+  _next = 0;
+  pthread_mutex_init(&_lock, NULL);
+  threads_num = max(1, min(threads_num, (int)_files.size()));
+  for(int i=0; i<threads_num; i++)
+  {
+    pthread_t t;
+    if(pthread_create(&t, NULL, worker, this))
+    {
+      cerr << "Error creating extraction worker thread" << endl;
+      break;
+    }
+    threads.push_back(t);
+  }
+
+  for(int i=0; i<(int)threads.size(); i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&_lock);
+  close(_image_fd);
+  _image_fd = -1;
+  _seconds = getMonotonicTime() - start;
+
+  if(threads.empty())
+    return -1;
+  return 0;
+}
+
+extract_stats_t &FileExtractor::getStats()
+{
+  return _stats;
+}
+
+/**
+ * Path of an entry under the output directory, the orphans go to
+ * lost+found/<parent inode>/. The tree escapes the names, so a crafted
+ * one can not leave the output directory.
+ */
+string FileExtractor::getOutputPath(int entry)
+{
+  string path = _tree.getPath(entry);
+
+  if(!path.empty() && path[0] == '?')
+    return _out_dir + "/" + EXTRACT_ORPHANS_DIR + "/" + path.substr(1);
+  return _out_dir + path;
+}
+
+/**
+ * True if path names an entry of the output tree : its last component is
+ * a plain name and its parent directory, symlinks resolved, is the
+ * output directory or one below it. The parent must exist.
+ */
+bool FileExtractor::isInOutDir(const string &path)
+{
+  size_t slash = path.rfind('/');
+  char real_parent[PATH_MAX];
+  string name, parent, root;
+
+  if(slash == string::npos)
+    return false;
+  name = path.substr(slash + 1);
+  parent = (slash == 0) ? "/" : path.substr(0, slash);
+  if(name.empty() || name == "." || name == ".." || realpath(parent.c_str(), real_parent) == NULL)
+    return false;
+
+  root = (_real_out_dir == "/") ? "" : _real_out_dir;
+  return real_parent == _real_out_dir ||
+    string(real_parent).compare(0, root.size() + 1, root + "/") == 0;
+}
+
+/**
+ * Create the directories of path below the output directory, refusing
+ * any that would not be in it
+ */
+int FileExtractor::makeOutputDirs(const string &path)
+{
+  size_t pos = _out_dir.size();
+
+  while(pos != string::npos)
+  {
+    pos = path.find('/', pos + 1);
+    string dir = path.substr(0, pos);
+    if(!isInOutDir(dir))
+    {
+      cerr << "Not creating " << dir << ", outside of " << _out_dir << endl;
+      return -1;
+    }
+    if(mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+      cerr << "Can't create " << dir << " : " << strerror(errno) << endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void *FileExtractor::worker(void *arg)
+{
+  FileExtractor *fe = (FileExtractor *)arg;
+  vector<unsigned char> cbuf(JFFS2_MAX_NODE_SIZE), dbuf(JFFS2_MAX_NODE_SIZE);
+  extract_stats_t stats;
+
+  memset(&stats, 0, sizeof(stats));
+  while(true)
+  {
+    int i;
+
+    pthread_mutex_lock(&fe->_lock);
+    i = fe->_next++;
+    pthread_mutex_unlock(&fe->_lock);
+
+    if(i >= (int)fe->_files.size())
+      break;
+    fe->extractFile(fe->_files[i], cbuf, dbuf, stats);
+  }
+
+  pthread_mutex_lock(&fe->_lock);
+  fe->_stats.files_num += stats.files_num;
+  fe->_stats.nodes_num += stats.nodes_num;
+  fe->_stats.data_bytes += stats.data_bytes;
+  fe->_stats.copied_bytes += stats.copied_bytes;
+  fe->_stats.bad_nodes_num += stats.bad_nodes_num;
+  fe->_stats.unsupported_nodes_num += stats.unsupported_nodes_num;
+  fe->_stats.failed_files_num += stats.failed_files_num;
+  pthread_mutex_unlock(&fe->_lock);
+
+  return NULL;
+}
+
+/**
+ * Write the valid data nodes of a file by increasing version, then cut it
+ * to its size. A bad node leaves its range as the older nodes wrote it.
+ */
+int FileExtractor::extractFile(int entry, vector<unsigned char> &cbuf,
+  vector<unsigned char> &dbuf, extract_stats_t &stats)
+{
+  File *f = _tree.getFile(entry);
+  string path = getOutputPath(entry);
+  vector<DataNode *> nodes = f->getValidDataNodes();
+  int fd;
+
+  sort(nodes.begin(), nodes.end(), compareNodesByVersion);
+  if(!isInOutDir(path))
+  {
+    cerr << "Not writing " << path << ", outside of " << _out_dir << endl;
+    stats.failed_files_num++;
+    return -1;
+  }
+  // a symlink left in the output directory is not followed either
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+  if(fd < 0)
+  {
+    cerr << "Can't create " << path << " : " << strerror(errno) << endl;
+    stats.failed_files_num++;
+    return -1;
+  }
+
+  for(int i=0; i<(int)nodes.size(); i++)
+    if(extractNode(fd, nodes[i], cbuf, dbuf, stats) < 0)
+      cerr << "Error extracting node at 0x" << hex << nodes[i]->getFlashAddr().getFlashOffset()
+	<< dec << " of " << path << endl;
+
+  if(ftruncate(fd, f->getSize()) < 0 || close(fd) < 0)
+  {
+    cerr << "Error writing " << path << " : " << strerror(errno) << endl;
+    stats.failed_files_num++;
+    return -1;
+  }
+  stats.files_num++;
+
+  return 0;
+}
+
+/**
+ * Check the raw inode of a data node against the dump, then write its
+ * data at its offset. Return -1 for a bad or unsupported node.
+ */
+int FileExtractor::extractNode(int out_fd, DataNode *dn, vector<unsigned char> &cbuf,
+  vector<unsigned char> &dbuf, extract_stats_t &stats)
+{
+  uint64_t pos = dn->getFlashAddr().getFlashOffset() - _geometry.getPartitionOffset();
+  unsigned char hdr[JFFS2_RAW_INODE_SIZE];
+  uint32_t offset, csize, dsize;
+  int compr, ret;
+
+  if(pread(_image_fd, hdr, sizeof(hdr), pos) != (ssize_t)sizeof(hdr) ||
+    get16(hdr) != JFFS2_MAGIC || get16(hdr+2) != JFFS2_NODETYPE_INODE ||
+    get32(hdr+64) != jffs2Crc32(0, hdr, 60))
+  {
+    stats.bad_nodes_num++;
+    return -1;
+  }
+
+  offset = get32(hdr+44);
+  csize = get32(hdr+48);
+  dsize = get32(hdr+52);
+  compr = hdr[56];
+  if(get32(hdr+12) != dn->getInodeNum() || get32(hdr+16) != dn->getVersionNum() ||
+    offset != dn->getDataOffset() || dsize != dn->getDataSize() ||
+    JFFS2_RAW_INODE_SIZE + csize > get32(hdr+4) || csize > cbuf.size() || dsize > dbuf.size())
+  {
+    stats.bad_nodes_num++;
+    return -1;
+  }
+  stats.nodes_num++;
+  if(dsize == 0)
+    return 0;
+
+  if(compr == JFFS2_COMPR_ZERO)
+  {
+    memset(&dbuf[0], 0, dsize);
+    ret = pwriteAll(out_fd, &dbuf[0], dsize, offset);
+  }
+  else if(!_check_crc && (compr == JFFS2_COMPR_NONE || compr == JFFS2_COMPR_COPY) &&
+    csize == dsize && (ret = copyRange(_image_fd, pos + JFFS2_RAW_INODE_SIZE, out_fd, offset, dsize)) != 1)
+  {
+    if(ret == 0)
+      stats.copied_bytes += dsize;
+  }
+  else
+  {
+    if(pread(_image_fd, &cbuf[0], csize, pos + JFFS2_RAW_INODE_SIZE) != (ssize_t)csize ||
+      get32(hdr+60) != jffs2Crc32(0, &cbuf[0], csize))
+    {
+      stats.bad_nodes_num++;
+      return -1;
+    }
+    ret = decompressNode(compr, &cbuf[0], csize, &dbuf[0], dsize);
+    if(ret != 0)
+    {
+      if(ret > 0)
+	stats.unsupported_nodes_num++;
+      else
+	stats.bad_nodes_num++;
+      return -1;
+    }
+    ret = pwriteAll(out_fd, &dbuf[0], dsize, offset);
+  }
+
+  if(ret < 0)
+    return -1;
+  stats.data_bytes += dsize;
+  return 0;
+}
+
+ostream& operator<<(ostream& os, FileExtractor& fe)
+{
+  extract_stats_t &s = fe._stats;
+
+  os << "Extracted " << s.files_num << " files and " << s.dirs_num << " directories to "
+    << fe._out_dir << " in " << fe._seconds << " s" << endl;
+  os << " - data nodes : " << s.nodes_num << endl;
+  os << " - data bytes : " << s.data_bytes << ", " << s.copied_bytes
+    << " of them copied without a buffer" << endl;
+  os << " - throughput : " << ((fe._seconds > 0) ? s.data_bytes / fe._seconds / 1e6 : 0.0)
+    << " MB/s" << endl;
+  os << " - bad nodes : " << s.bad_nodes_num << endl;
+  os << " - unsupported nodes : " << s.unsupported_nodes_num << endl;
+  os << " - failed files : " << s.failed_files_num << endl;
+
+  return os;
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Decompress a node payload to exactly out_len bytes. Return 0, -1 for a
+ * corrupted payload or 1 for an unsupported compressor.
+ */
+int decompressNode(int compr, const unsigned char *in, uint32_t in_len, unsigned char *out,
+  uint32_t out_len)
+{
+  switch(compr)
+  {
+    case JFFS2_COMPR_NONE:
+    case JFFS2_COMPR_COPY:
+      if(in_len != out_len)
+	return -1;
+      memcpy(out, in, out_len);
+      return 0;
+    case JFFS2_COMPR_ZERO:
+      memset(out, 0, out_len);
+      return 0;
+    case JFFS2_COMPR_RTIME:
+      return decompressRtime(in, in_len, out, out_len);
+    case JFFS2_COMPR_ZLIB:
+      return decompressZlib(in, in_len, out, out_len);
+    case JFFS2_COMPR_LZO:
+      return decompressLzo(in, in_len, out, out_len);
+    default:
+      return 1;
+  }
+}
+
+/**
+ * Compress a payload as the kernel does, rtime and zlib only. Return -1
+ * if the compressed payload is not smaller, the node is then written
+ * uncompressed.
+ */
+int compressNode(int compr, const unsigned char *in, uint32_t in_len, vector<unsigned char> &out)
+{
+  out.resize(in_len + in_len / 1000 + 64);
+
+  if(compr == JFFS2_COMPR_RTIME)
+  {
+    unsigned short positions[256];
+    uint32_t pos = 0, outpos = 0;
+
+    memset(positions, 0, sizeof(positions));
+    while(pos < in_len && outpos + 2 <= in_len)
+    {
+      unsigned char value = in[pos];
+      uint32_t backpos = positions[value];
+      int runlen = 0;
+
+      out[outpos++] = in[pos++];
+      positions[value] = pos;
+      while(backpos < pos && pos < in_len && in[pos] == in[backpos++] && runlen < 255)
+      {
+	pos++;
+	runlen++;
+      }
+      out[outpos++] = runlen;
+    }
+    if(pos < in_len || outpos >= in_len)
+      return -1;
+    out.resize(outpos);
+    return 0;
+  }
+
+  if(compr == JFFS2_COMPR_ZLIB)
+  {
+    uLongf len = out.size();
+
+    if(compress2(&out[0], &len, in, in_len, 3) != Z_OK || len >= in_len)
+      return -1;
+    out.resize(len);
+    return 0;
+  }
+
+  return -1;
+}
+
+/**
+ * Each literal byte is followed by the length of a copy from just after
+ * the previous occurrence of the same byte
+ */
+int decompressRtime(const unsigned char *in, uint32_t in_len, unsigned char *out, uint32_t out_len)
+{
+  unsigned short positions[256];
+  uint32_t pos = 0, outpos = 0;
+
+  memset(positions, 0, sizeof(positions));
+  while(outpos < out_len)
+  {
+    unsigned char value;
+    uint32_t backoffs, repeat;
+
+    if(pos + 2 > in_len)
+      return -1;
+    value = in[pos++];
+    out[outpos++] = value;
+    repeat = in[pos++];
+    backoffs = positions[value];
+    positions[value] = outpos;
+    if(outpos + repeat > out_len)
+      return -1;
+    while(repeat--)
+      out[outpos++] = out[backoffs++];
+  }
+
+  return 0;
+}
+
+/**
+ * The kernel skips the zlib header when there is a valid one and inflates
+ * the raw deflate stream, without checking the adler32
+ */
+int decompressZlib(const unsigned char *in, uint32_t in_len, unsigned char *out, uint32_t out_len)
+{
+  z_stream strm;
+  int wbits = MAX_WBITS, ret;
+
+  memset(&strm, 0, sizeof(strm));
+  if(in_len >= 2 && (in[0] & 0x0f) == Z_DEFLATED && (in[0] >> 4) <= 7 &&
+    ((in[0] << 8) + in[1]) % 31 == 0 && !(in[1] & 0x20))
+  {
+    wbits = -((in[0] >> 4) + 8);
+    in += 2;
+    in_len -= 2;
+  }
+  if(inflateInit2(&strm, wbits) != Z_OK)
+    return -1;
+
+  strm.next_in = (Bytef *)in;
+  strm.avail_in = in_len;
+  strm.next_out = out;
+  strm.avail_out = out_len;
+  ret = inflate(&strm, Z_FINISH);
+  inflateEnd(&strm);
+
+  if((ret != Z_STREAM_END && ret != Z_OK && ret != Z_BUF_ERROR) || strm.total_out != out_len)
+    return -1;
+  return 0;
+}
+
+/**
+ * LZO1X, as lzo1x_decompress_safe : every read and copy is bounds checked.
+ * state is the number of literals copied after the last match, 4 after a
+ * literal run, which changes the meaning of the instructions below 16.
+ */
+int decompressLzo(const unsigned char *in, uint32_t in_len, unsigned char *out, uint32_t out_len)
+{
+  uint32_t ip = 0, op = 0, t, state = 0;
+
+  if(in_len == 0)
+    return -1;
+  if(in[0] > 17)
+  {
+    t = in[ip++] - 17;
+    if(ip + t > in_len || op + t > out_len)
+      return -1;
+    memcpy(out + op, in + ip, t);
+    ip += t;
+    op += t;
+    state = (t < 4) ? t : 4;
+  }
+
+  while(true)
+  {
+    uint32_t len, dist;
+
+    if(ip >= in_len)
+      return -1;
+    t = in[ip++];
+
+    if(t < 16 && state == 0)
+    {
+      // literal run
+      len = t;
+      if(len == 0)
+      {
+	while(ip < in_len && in[ip] == 0)
+	  len += 255, ip++;
+	if(ip >= in_len)
+	  return -1;
+	len += 15 + in[ip++];
+      }
+      len += 3;
+      if(ip + len > in_len || op + len > out_len)
+	return -1;
+      memcpy(out + op, in + ip, len);
+      ip += len;
+      op += len;
+      state = 4;
+      continue;
+    }
+
+    if(t < 16)
+    {
+      // short match, farther right after a literal run
+      if(ip >= in_len)
+	return -1;
+      dist = 1 + (t >> 2) + (in[ip++] << 2);
+      len = 2;
+      if(state == 4)
+	dist += LZO_M2_MAX_OFFSET, len = 3;
+    }
+    else if(t >= 64)
+    {
+      if(ip >= in_len)
+	return -1;
+      dist = 1 + ((t >> 2) & 7) + (in[ip++] << 3);
+      len = (t >> 5) + 1;
+    }
+    else
+    {
+      uint32_t mask = (t >= 32) ? 31 : 7;
+
+      len = t & mask;
+      if(len == 0)
+      {
+	while(ip < in_len && in[ip] == 0)
+	  len += 255, ip++;
+	if(ip >= in_len)
+	  return -1;
+	len += mask + in[ip++];
+      }
+      len += 2;
+      if(ip + 2 > in_len)
+	return -1;
+      dist = (in[ip] >> 2) + (in[ip+1] << 6);
+      ip += 2;
+      if(t >= 32)
+	dist += 1;
+      else
+      {
+	dist += (t & 8) << 11;
+	if(dist == 0)
+	  break;			// end of stream
+	dist += LZO_M4_BASE_OFFSET;
+      }
+    }
+
+    if(dist > op || op + len > out_len)
+      return -1;
+    for(uint32_t i=0; i<len; i++, op++)
+      out[op] = out[op - dist];
+
+    // up to 3 literals follow a match
+    state = in[ip-2] & 3;
+    if(ip + state > in_len || op + state > out_len)
+      return -1;
+    memcpy(out + op, in + ip, state);
+    ip += state;
+    op += state;
+  }
+
+  if(ip != in_len || op != out_len)
+    return -1;
+  return 0;
+}
+
+const char *getComprName(int compr)
+{
+  switch(compr)
+  {
+    case JFFS2_COMPR_NONE: return "none";
+    case JFFS2_COMPR_ZERO: return "zero";
+    case JFFS2_COMPR_RTIME: return "rtime";
+    case JFFS2_COMPR_RUBINMIPS: return "rubinmips";
+    case JFFS2_COMPR_COPY: return "copy";
+    case JFFS2_COMPR_DYNRUBIN: return "dynrubin";
+    case JFFS2_COMPR_ZLIB: return "zlib";
+    case JFFS2_COMPR_LZO: return "lzo";
+    default: return "unknown";
+  }
+}
+
+bool compareNodesByVersion(DataNode *a, DataNode *b)
+{
+  return a->getVersionNum() < b->getVersionNum();
+}
+
+/**
+ * mkdir -p
+ */
+int makeDirs(const string &path)
+{
+  size_t pos = 0;
+
+  while(pos != string::npos)
+  {
+    pos = path.find('/', pos + 1);
+    string dir = path.substr(0, pos);
+    if(!dir.empty() && mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+      cerr << "Can't create " << dir << " : " << strerror(errno) << endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int pwriteAll(int fd, const unsigned char *buf, uint32_t len, uint64_t offset)
+{
+  while(len > 0)
+  {
+    ssize_t n = pwrite(fd, buf, len, offset);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return -1;
+    buf += n;
+    len -= n;
+    offset += n;
+  }
+
+  return 0;
+}
+
+/**
+ * In-kernel copy between the image and an output file. Return 1 when
+ * the filesystems don't support it, for the caller to copy through a
+ * buffer instead.
+ */
+int copyRange(int in_fd, uint64_t in_offset, int out_fd, uint64_t out_offset, uint32_t len)
+{
+  loff_t in_off = in_offset, out_off = out_offset;
+
+  while(len > 0)
+  {
+    ssize_t n = copy_file_range(in_fd, &in_off, out_fd, &out_off, len, 0);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP) &&
+      (uint64_t)in_off == in_offset)
+      return 1;
+    if(n <= 0)
+      return -1;
+    len -= n;
+  }
+
+  return 0;
+}
+
+uint32_t get16(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+uint32_t get32(const unsigned char *p)
+{
+  return get16(p) | (get16(p+2) << 16);
+}
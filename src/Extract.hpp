@@ -0,0 +1,93 @@
+#ifndef EXTRACT_HPP
+#define EXTRACT_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <pthread.h>
+
+#include "DirTree.hpp"
+#include "FlashGeometry.hpp"
+
+#define JFFS2_COMPR_NONE			0x00
+#define JFFS2_COMPR_ZERO			0x01
+#define JFFS2_COMPR_RTIME			0x02
+#define JFFS2_COMPR_RUBINMIPS			0x03
+#define JFFS2_COMPR_COPY			0x04
+#define JFFS2_COMPR_DYNRUBIN			0x05
+#define JFFS2_COMPR_ZLIB			0x06
+#define JFFS2_COMPR_LZO				0x07
+
+#define EXTRACT_ORPHANS_DIR			"lost+found"	// files whose parent is unknown
+
+/**
+ * Counters of an extraction, per worker then summed
+ */
+typedef struct
+{
+  uint64_t files_num;
+  uint64_t dirs_num;
+  uint64_t nodes_num;
+  uint64_t data_bytes;			// decompressed bytes written
+  uint64_t copied_bytes;		// part of them copied from the image without a buffer
+  uint64_t bad_nodes_num;		// header or data CRC errors, inode or version mismatches
+  uint64_t unsupported_nodes_num;	// rubin compressors
+  uint64_t failed_files_num;		// output file errors
+} extract_stats_t;
+
+/**
+ * Rebuilds the contents of the live files from the raw image of the
+ * partition the dump was made from. Each valid data node of a file is
+ * read at its flash offset, checked against the dump, decompressed and
+ * written at its data offset, older versions first so that the newer
+ * ones overwrite them, then the file is truncated to its size. Every
+ * payload is read in a per worker buffer, its data CRC checked, then
+ * decompressed if needed and written with pwrite. Only if the data CRCs
+ * are not checked on purpose, the uncompressed payloads are copied from
+ * the image to the output file by the kernel with copy_file_range. The
+ * directories are created first, then several workers take the files
+ * one at a time. Empty directories are not told apart from empty files
+ * by the dump, they are extracted as empty files.
+ */
+class FileExtractor
+{
+  public:
+    FileExtractor(DirTree &tree, FlashGeometry &geometry);
+    int run(const char *image_path, const char *out_dir, int threads_num, bool check_crc);
+    extract_stats_t &getStats();
+
+  private:
+    DirTree &_tree;
+    FlashGeometry _geometry;
+    std::string _out_dir;
+    std::string _real_out_dir;		// symlinks resolved
+    int _image_fd;
+    bool _check_crc;			// data CRC of every node, else uncompressed ones are copied
+    std::vector<int> _files;			// DirTree entries to extract
+    int _next;				// next file to extract
+    pthread_mutex_t _lock;
+    extract_stats_t _stats;
+    double _seconds;
+
+    std::string getOutputPath(int entry);
+    bool isInOutDir(const std::string &path);
+    int makeOutputDirs(const std::string &path);
+    int extractFile(int entry, std::vector<unsigned char> &cbuf, std::vector<unsigned char> &dbuf,
+      extract_stats_t &stats);
+    int extractNode(int out_fd, DataNode *dn, std::vector<unsigned char> &cbuf,
+      std::vector<unsigned char> &dbuf, extract_stats_t &stats);
+    static void *worker(void *arg);
+
+  friend std::ostream& operator<<(std::ostream& os, FileExtractor& fe);
+};
+
+int decompressNode(int compr, const unsigned char *in, uint32_t in_len, unsigned char *out,
+  uint32_t out_len);
+int compressNode(int compr, const unsigned char *in, uint32_t in_len,
+  std::vector<unsigned char> &out);
+int decompressRtime(const unsigned char *in, uint32_t in_len, unsigned char *out, uint32_t out_len);
+int decompressZlib(const unsigned char *in, uint32_t in_len, unsigned char *out, uint32_t out_len);
+int decompressLzo(const unsigned char *in, uint32_t in_len, unsigned char *out, uint32_t out_len);
+const char *getComprName(int compr);
+
+#endif /* EXTRACT_HPP */
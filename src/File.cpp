@@ -1,14 +1,65 @@
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "File.hpp"
+#include "Stats.hpp"
+#include "Hash.hpp"
+
+using namespace std;
+
+#define FILESET_MIN_CHUNKS_PER_THREAD		4096
+
+/**
+ * Range of a chunk list inserted in an InodeTable by one thread
+ */
+typedef struct
+{
+  InodeTable *table;
+  vector<Chunk *> *chunk_list;
+  int begin;
+  int end;
+} insert_job_t;
+
+/**
+ * Shared by the threads putting the grouped nodes in their files
+ */
+typedef struct
+{
+  FileSet *fs;
+  vector<inode_nodes_t *> *inodes;	// of each file
+  int next_shard;
+  pthread_mutex_t lock;
+} regroup_state_t;
+
+/**
+ * Shared by the threads finalizing a FileSet
+ */
+typedef struct
+{
+  FileSet *fs;
+  vector<Chunk *> *chunk_list;
+  vector<int> results;			// File::finalize return per file
+  int next_shard;
+  int done_num;
+  bool verbose;
+  pthread_mutex_t lock;
+} finalize_state_t;
+
+static int fileset_threads_num = 1;
+static readpage_model_t readpage_model = READPAGE_SIMPLE;
+
+void *insertWorker(void *arg);
+bool compareInodesByFirstRank(inode_nodes_t *a, inode_nodes_t *b);
+int getWorkersNum(int shards_num, int files_num);
+void runWorkers(void *(*worker)(void *), void *arg, int threads_num);
 
 #define JFFS2_MAX_DATANODE_DATA_SIZE		4096
 #define JFFS2_DATANODE_METADATA_SIZE		68
 #define JFFS2_MAX_DATANODE_SIZE			(JFFS2_MAX_DATANODE_DATA_SIZE+JFFS2_DATANODE_METADATA_SIZE)
-#define LINUX_PAGE_SIZE				4096
 
-bool addToArrayIfNotAlreadyPresent(int val, vector<int> &vec);
 bool addToArrayIfDifferentFromLastElement(int val, vector<int> &vec);
 
 /**************************** File ************************************/
@@ -21,6 +72,22 @@ File::File(uint64_t inode_num)
   _sequential_cost = -1;
   
   _valid_dirent_node = NULL;
+  invalidateMetrics();
+}
+
+/**
+ * Drop the cached metrics, to be called whenever the nodes of the file
+ * or its deleted state change
+ */
+void File::invalidateMetrics()
+{
+  _size_cached = false;
+  _theoritical_page_num = -1;
+  _concerned_pages_cached = false;
+  _concerned_pages.clear();
+  _contiguous_factor_cached = false;
+  _sequential_cost = -1;
+  _linux_pages_flash_pages.clear();
 }
 
 /**
@@ -46,7 +113,7 @@ int File::getLinuxPagesNum()
  * page i is equal to the first of page i+1, the second flash page read is
  * not taken into account
  */
-void File::printSequentialPerPageReadCost()
+void File::printSequentialPerPageReadCost(ostream &os)
 {
   int linux_pages_num = getLinuxPagesNum();
   int prev_last_flash_page_index = -1;
@@ -60,7 +127,14 @@ void File::printSequentialPerPageReadCost()
     if(flash_pages_read[0] == prev_last_flash_page_index)
       number_of_flash_pages_read--;
       
-    cout << "  readpage[" << i << "] = " << number_of_flash_pages_read << endl;
+    os << "  readpage[" << i << "] = " << number_of_flash_pages_read;
+    if(readpage_model == READPAGE_KERNEL)
+    {
+      readpage_work_t work;
+      getLinuxPageReadWork(i, work);
+      printReadpageWork(os, work);
+    }
+    os << endl;
     
     prev_last_flash_page_index = flash_pages_read[flash_pages_read.size()-1];
   }
@@ -86,6 +160,78 @@ int File::getLinuxPageReadCost(int page_index)
 vector<int> File::getFlashPagesReadForLinuxPage(int linux_page_index)
 {
   vector<int> pages;
+  vector<DataNode *> nodes;
+  
+  if(_linux_pages_flash_pages.empty() && getSize() > 0)
+    _linux_pages_flash_pages.resize(getLinuxPagesNum());
+  if(linux_page_index >= 0 && linux_page_index < (int)_linux_pages_flash_pages.size()
+    && !_linux_pages_flash_pages[linux_page_index].empty())
+    return _linux_pages_flash_pages[linux_page_index];
+  
+  nodes = getDataNodesReadForLinuxPage(linux_page_index);
+  if(nodes.empty())
+    return pages;
+  
+  for(int i=0; i<(int)nodes.size(); i++)
+  {
+    vector<int> pages_indexes = nodes[i]->getConcernedPagesIndexes();
+    for(int j=0; j<(int)pages_indexes.size(); j++)
+      addToArrayIfDifferentFromLastElement(pages_indexes[j], pages);
+  }
+  
+  assert(pages.size() > 0);
+  _linux_pages_flash_pages[linux_page_index] = pages;
+  return pages;
+}
+
+/**
+ * Kernel readpage model, one jffs2_read_dnode per fragment : a run of
+ * bytes of the linux page backed by the same valid node, walked one
+ * extent at a time
+ */
+int File::getLinuxPageReadWork(int linux_page_index, readpage_work_t &res)
+{
+  uint32_t start = (uint32_t)linux_page_index * LINUX_PAGE_SIZE;
+  uint32_t end;
+  int last_page = -1;
+
+  memset(&res, 0, sizeof(res));
+  if(start >= getSize())
+    return -1;
+  end = min(start + LINUX_PAGE_SIZE, getSize());
+
+  for(uint32_t i=start; i<end; )
+  {
+    uint32_t len;
+    DataNode *dn = getValidExtentAtOffset(i, len);
+
+    len = min(len, end - i);
+    i += len;
+
+    res.fragments_num++;
+    for(int p=dn->getFirstFlashPage(); p<=(int)dn->getLastFlashPage(); p++)
+      if(p != last_page)
+      {
+	res.flash_pages++;
+	last_page = p;
+      }
+    res.flash_bytes += dn->getFlashSize();
+    res.crc_bytes += JFFS2_NODE_HEADER_CRC_SIZE + dn->getCompressedSize();
+    if(dn->isCompressed())
+      res.decompressed_bytes += dn->getDataSize();
+    res.discarded_bytes += dn->getDataSize() - len;
+  }
+
+  return 0;
+}
+
+/**
+ * Return the valid data nodes read when reading a linux page, in file
+ * offset order
+ */
+vector<DataNode *> File::getDataNodesReadForLinuxPage(int linux_page_index)
+{
+  vector<DataNode *> nodes;
   DataNode *dn, *prev_dn;
   uint32_t start_offset_in_file = (uint32_t)linux_page_index * LINUX_PAGE_SIZE;
   dn = prev_dn = NULL;
@@ -94,7 +240,7 @@ vector<int> File::getFlashPagesReadForLinuxPage(int linux_page_index)
   {
     cerr << "Error, calling getFlashPagesReadForLinuxPage on page index (" 
     << linux_page_index << ") > max file size (" << getSize() << ")" << endl;
-    return pages;
+    return nodes;
   }
   
   for(uint32_t i=start_offset_in_file; (i<(start_offset_in_file+LINUX_PAGE_SIZE) && i<getSize()); i++)
@@ -103,14 +249,11 @@ vector<int> File::getFlashPagesReadForLinuxPage(int linux_page_index)
     if(dn == prev_dn)
       continue;
       
-    vector<int> pages_indexes = dn->getConcernedPagesIndexes();
-    for(int j=0; j<(int)pages_indexes.size(); j++)
-      addToArrayIfDifferentFromLastElement(pages_indexes[j], pages);
+    nodes.push_back(dn);
     prev_dn = dn;
   }
   
-  assert(pages.size() > 0);
-  return pages;
+  return nodes;
 }
 
 /**
@@ -118,18 +261,26 @@ vector<int> File::getFlashPagesReadForLinuxPage(int linux_page_index)
  */
 vector<int> File::getConcernedPagesIndexes()
 {
-  vector<int> res;
-  
+  return getConcernedPages().getPages();
+}
+
+/**
+ * Same as a page set, to count or combine them without listing every
+ * page
+ */
+PageSet & File::getConcernedPages()
+{
   assert(_is_final);
   
+  if(_concerned_pages_cached)
+    return _concerned_pages;
+  
   for(int i=0; i<(int)_valid_data_nodes.size(); i++)
-  {
-    vector<int> tmp = _valid_data_nodes[i]->getConcernedPagesIndexes();
-    for(int j=0; j<(int)tmp.size(); j++)
-      addToArrayIfNotAlreadyPresent(tmp[j], res);
-  }
+    _concerned_pages.addRange(_valid_data_nodes[i]->getFirstFlashPage(),
+      _valid_data_nodes[i]->getLastFlashPage());
+  _concerned_pages_cached = true;
   
-  return res;
+  return _concerned_pages;
 }
 
 /**
@@ -140,7 +291,7 @@ vector<int> File::getConcernedPagesIndexes()
 double File::getFragmentationFactor()
 {
   double res = 0.0;
-  int actual_page_num = getConcernedPagesIndexes().size();
+  int actual_page_num = getConcernedPages().getPagesNum();
   int theoritical_page_num = getTheoriticalPageNum();
   
   res = (double)actual_page_num / (double)theoritical_page_num;
@@ -156,26 +307,15 @@ double File::getFragmentationFactor()
  */
 int File::getTheoriticalPageNum()
 {
-  int total_nodes_needed = 0;
-  int res = 0;
-  int flash_page_size = FlashAddr::getFlashPageSize();
+  if(_theoritical_page_num != -1)
+    return _theoritical_page_num;
   
-  // for(int i=0; i<(int)_valid_data_nodes.size(); i++)
-    // total_size += _valid_data_nodes[i]->getFlashSize();
-    // 
-  // res = total_size / flash_page_size;
-  // if(total_size % flash_page_size != 0)
-    // res += 1;
-    
-  total_nodes_needed = getSize() / (JFFS2_MAX_DATANODE_SIZE);
-  if(getSize() % (JFFS2_MAX_DATANODE_SIZE) != 0)
-    total_nodes_needed += 1;
+  if(getSize() == 0)
+    _theoritical_page_num = 0;
+  else
+    _theoritical_page_num = getMinPagesNum(getSize(), getGeometry()->getFlashPageSize());
   
-  res = (total_nodes_needed*(JFFS2_MAX_DATANODE_SIZE)) / flash_page_size;
-  if((total_nodes_needed*(JFFS2_MAX_DATANODE_SIZE)) % flash_page_size != 0)
-    res += 1;
-    
-  return res;
+  return _theoritical_page_num;
 }
 
 /**
@@ -192,6 +332,9 @@ double File::getContiguousFactor()
   DataNode *dn, *prev_dn;
   dn = prev_dn = NULL;
   
+  if(_contiguous_factor_cached)
+    return _contiguous_factor;
+  
   for(uint32_t i=0; i<getSize(); i++)
   {
     dn = getValidDataNodeAtOffset(i);
@@ -204,7 +347,8 @@ double File::getContiguousFactor()
     prev_dn = dn;
   }
   
-  _sequential_cost = pages.size();
+  if(readpage_model == READPAGE_SIMPLE)
+    _sequential_cost = pages.size();
   
   total_pages_jumps = (int)pages.size() -1;
   non_seq_pages_jumps = 0;
@@ -214,6 +358,8 @@ double File::getContiguousFactor()
   
   res = (double)non_seq_pages_jumps / (double)total_pages_jumps;
   
+  _contiguous_factor = res;
+  _contiguous_factor_cached = true;
   return res;
 }
 
@@ -225,15 +371,44 @@ double File::getContiguousFactor()
  */
 int File::getSequentialReadCost()
 {
-  if(_sequential_cost == -1)
+  if(_sequential_cost == -1 && readpage_model == READPAGE_KERNEL)
+    _sequential_cost = getKernelSequentialReadCost();
+  else if(_sequential_cost == -1)
     getContiguousFactor();
   return _sequential_cost;
 }
 
+/**
+ * Same in the kernel readpage model : the linux pages are read one after
+ * the other, only the last flash page of a readpage is still buffered
+ * for the next one
+ */
+int File::getKernelSequentialReadCost()
+{
+  int res = 0, last_page = -1;
+
+  if(getSize() == 0)
+    return 0;
+
+  for(int i=0; i<getLinuxPagesNum(); i++)
+  {
+    vector<int> pages = getFlashPagesReadForLinuxPage(i);
+    for(int j=0; j<(int)pages.size(); j++)
+      if(pages[j] != last_page)
+      {
+	res++;
+	last_page = pages[j];
+      }
+  }
+
+  return res;
+}
+
 /**
  * Return 1 if we must discard the file (lost datanode
+ * verbose enables the progress output
  */
-int File::finalize(vector<Chunk *> &chunk_list)
+int File::finalize(vector<Chunk *> &chunk_list, bool verbose)
 {
   int ret;
   
@@ -248,7 +423,9 @@ int File::finalize(vector<Chunk *> &chunk_list)
     if(ret == 1)
       return ret;
     
-    if(set_valid_datanodes())
+    // the deleted state is known from here
+    invalidateMetrics();
+    if(set_valid_datanodes(verbose))
     {
       cerr << "Error finalizing (datanodes) file " << getInodeNum() << endl;
       return -1;
@@ -256,6 +433,7 @@ int File::finalize(vector<Chunk *> &chunk_list)
   }
   
   _is_final = true;
+  invalidateMetrics();
   
   return 0;
 }
@@ -311,7 +489,7 @@ int File::set_valid_dirent(vector<Chunk *> &chunk_list)
  * the most recent ones fill the holes in the file between @0 -> @size
  * when the entire file is found we're done
  */
-int File::set_valid_datanodes()
+int File::set_valid_datanodes(bool verbose)
 {
   uint32_t size;
   
@@ -326,14 +504,18 @@ int File::set_valid_datanodes()
   /* look for each byte of the file which datanode contains it */
   for(uint32_t i=0; i<size; i++)
   {
-    double process_state = double((double(i)*100)/(double(size)-1));
-    cerr << "\r" << process_state << std::flush;
+    if(verbose)
+    {
+      double process_state = double((double(i)*100)/(double(size)-1));
+      cerr << "\r" << process_state << std::flush;
+    }
     
     DataNode *cur = getValidDataNodeAtOffset(i);
     addValidDataNodeIfNotAlreadyPresent(cur);
   }
   
-  cout << endl;
+  if(verbose)
+    cout << endl;
   
   return 0;
 }
@@ -400,6 +582,35 @@ DataNode * File::getValidDataNodeAtOffset(uint32_t offset)
   return res;
 }
 
+/**
+ * Same, with in len the bytes from offset the node backs before its end
+ * or the start of a newer node
+ */
+DataNode * File::getValidExtentAtOffset(uint32_t offset, uint32_t &len)
+{
+  uint64_t extent_end = getSize();
+  
+  assert(offset < getSize());
+  
+  for(int i=0; i<(int)_all_data_nodes.size(); i++)
+  {
+    DataNode *cur = _all_data_nodes[i];
+    uint64_t data_node_start_offset = cur->getDataOffset();
+    uint64_t data_node_end_offset = data_node_start_offset + cur->getDataSize();
+    
+    if(offset >= data_node_start_offset && offset < data_node_end_offset)
+    {
+      len = min(extent_end, data_node_end_offset) - offset;
+      return cur;
+    }
+    if(cur->getDataSize() > 0 && data_node_start_offset > offset)
+      extent_end = min(extent_end, data_node_start_offset);
+  }
+  
+  assert(false);
+  return NULL;
+}
+
 ostream& operator<<(ostream& os, File& f)
 {
   if(f.getInodeNum() == 1)
@@ -410,44 +621,60 @@ ostream& operator<<(ostream& os, File& f)
       << ", size: " << f.getSize() << " ino:" << f._inode_num << ", size:" <<
       f.getSize() << ", pino:" << f.getParentInodeNum() << endl;
       
-    cout << "    Data nodes versions : ";
-    cout << f._all_data_nodes[0]->getVersionNum() << endl;
+    os << "    Data nodes versions : ";
+    os << f._all_data_nodes[0]->getVersionNum() << endl;
     
-    cout << "    Valid data node versions : " << f._valid_data_nodes.size() << endl;
+    os << "    Valid data node versions : " << f._valid_data_nodes.size() << endl;
     // for(int i=0; i<(int)f._valid_data_nodes.size(); i++)
       // cout << f._valid_data_nodes[i]->getVersionNum() << ", ";
     // cout << endl;
     
-    vector<int> flash_pages_indexes = f.getConcernedPagesIndexes();
-    cout << "    Concerned flash pages indexes (" << flash_pages_indexes.size() << ") : " << endl;
+    os << "    Concerned flash pages indexes (" << f.getConcernedPages().getPagesNum() << ") : " << endl;
     // for(int i=0; i<(int)flash_pages_indexes.size(); i++)
       // cout << flash_pages_indexes[i] << ", ";
     // cout << endl;
     // 
-    cout << "    Fragmentation factor : " << f.getFragmentationFactor() 
+    os << "    Fragmentation factor : " << f.getFragmentationFactor() 
       << endl;
       
-    cout << "    Contiguous factor : " << f.getContiguousFactor() << endl;
+    os << "    Contiguous factor : " << f.getContiguousFactor() << endl;
     
-    if(!f._was_deleted)
+    if(!f._was_deleted && f.getSize() > 0)
     {
-      cout << "Seq. read cost : " << endl;
-      f.printSequentialPerPageReadCost();
+      os << "Seq. read cost : " << endl;
+      f.printSequentialPerPageReadCost(os);
     }
   }
-        
+	
   return os;
 }
 
 uint32_t File::getSize()
 {
   DataNode *most_recent = NULL;
-  most_recent = getMostRecentDataNode();
   
+  if(_size_cached)
+    return _size;
+  
+  most_recent = getMostRecentDataNode();
   if(most_recent == NULL)	// File is deleted
-    return 0;
+    _size = 0;
+  else
+    _size = most_recent->getFileSize();
+  _size_cached = true;
   
-  return most_recent->getFileSize();
+  return _size;
+}
+
+/**
+ * Geometry of the dump the nodes of the file come from, NULL if the
+ * file has no data node
+ */
+FlashGeometry * File::getGeometry()
+{
+  if(_all_data_nodes.empty())
+    return NULL;
+  return &(_all_data_nodes[0]->getGeometry());
 }
 
 uint64_t File::getInodeNum()
@@ -455,6 +682,24 @@ uint64_t File::getInodeNum()
   return _inode_num;
 }
 
+bool File::isDeleted()
+{
+  return _was_deleted;
+}
+
+vector<DataNode *> & File::getValidDataNodes()
+{
+  return _valid_data_nodes;
+}
+
+/**
+ * NULL for slash, the deletion dirent for a deleted file
+ */
+DirentNode * File::getValidDirentNode()
+{
+  return _valid_dirent_node;
+}
+
 uint64_t File::getParentInodeNum()
 {
   if(!_is_final)
@@ -478,17 +723,19 @@ string File::getName()
 int File::addNode(DataNode &dn)
 {
   _all_data_nodes.push_back(&dn);
+  invalidateMetrics();
   return 0;
 }
 
 int File::addNode(DirentNode &dn)
 {
   _all_dirent_nodes.push_back(&dn);
+  invalidateMetrics();
   return 0;
 }
 
 /**
- * May return null if the file is deleted
+ * May return null if the file is deleted or has no data node (slash)
  */
 DataNode * File::getMostRecentDataNode()
 {
@@ -496,7 +743,7 @@ DataNode * File::getMostRecentDataNode()
   DataNode *res = NULL;
   
   // If the file is deleted
-  if(_was_deleted)
+  if(_was_deleted || _all_data_nodes.empty())
     return NULL;
   
   for(int i=0; i<(int)_all_data_nodes.size(); i++)
@@ -516,101 +763,308 @@ DataNode * File::getMostRecentDataNode()
   return res;
 }
 
+/***************************** InodeTable *****************************/
+
+InodeTable::InodeTable(int shards_num)
+{
+  _shards.resize(max(1, shards_num));
+  for(int i=0; i<(int)_shards.size(); i++)
+    pthread_mutex_init(&_shards[i].lock, NULL);
+}
+
+InodeTable::~InodeTable()
+{
+  for(int i=0; i<(int)_shards.size(); i++)
+    pthread_mutex_destroy(&_shards[i].lock);
+}
+
+int InodeTable::getShardsNum()
+{
+  return _shards.size();
+}
+
+int InodeTable::getShard(uint64_t inode_num)
+{
+  return getInodeBucket(inode_num, _shards.size());
+}
+
+/**
+ * Add a node of inode_num, or only the inode if node is NULL. Safe from
+ * any number of threads.
+ */
+void InodeTable::insert(uint64_t inode_num, Node *node, uint64_t rank)
+{
+  shard_t &shard = _shards[getShard(inode_num)];
+  
+  pthread_mutex_lock(&shard.lock);
+  map<uint64_t, inode_nodes_t>::iterator it = shard.inodes.find(inode_num);
+  if(it == shard.inodes.end())
+  {
+    it = shard.inodes.insert(make_pair(inode_num, inode_nodes_t())).first;
+    it->second.inode_num = inode_num;
+    it->second.first_rank = rank;
+  }
+  else if(rank < it->second.first_rank)
+    it->second.first_rank = rank;
+  if(node != NULL)
+    it->second.nodes.push_back(make_pair(rank, node));
+  pthread_mutex_unlock(&shard.lock);
+}
+
+/**
+ * Append the inodes of a shard to res, once the insertions are over
+ */
+void InodeTable::getInodes(int shard, vector<inode_nodes_t *> &res)
+{
+  map<uint64_t, inode_nodes_t> &inodes = _shards[shard].inodes;
+  
+  for(map<uint64_t, inode_nodes_t>::iterator it = inodes.begin(); it != inodes.end(); ++it)
+    res.push_back(&it->second);
+}
+
 /****************************** FileSet *******************************/
 
 FileSet::FileSet(vector<Chunk *> &chunk_list)
 {
-  // First add slash
-  File slash(1);
-  _files.push_back(slash);
-  
-  sortChunkArray(chunk_list);
+  build(chunk_list, true);
+}
+
+/**
+ * Same but without any progress output when verbose is false, to
+ * build several sets concurrently
+ */
+FileSet::FileSet(vector<Chunk *> &chunk_list, bool verbose)
+{
+  build(chunk_list, verbose);
+}
+
+void FileSet::build(vector<Chunk *> &chunk_list, bool verbose)
+{
+  RunStats *stats = getRunStats();
   
-  // next add the nodes present in chunk_list
-  // the data nodes are sorted in that list so they are also sorted 
-  // in the _all_data_node array
-  for(int i=0; i<(int)chunk_list.size(); i++)
+  if(stats == NULL)
   {
-    switch(chunk_list[i]->getType())
-    {
-      case DATA_NODE:
-      {
-	addNode(*(static_cast<DataNode *>(chunk_list[i])));
-	break;
-      }
-      
-      case DIRENT_NODE:
-      {
-	DirentNode *dn = static_cast<DirentNode *>(chunk_list[i]);
-	if(dn->getInodeNum() != 0)
-	  addNode(*dn);
-	break;
-      }
-      
-      default:
-	break;
-    }
+    sortChunkArray(chunk_list);
+    addNodes(chunk_list);
+    finalizeFiles(chunk_list, verbose);
+    return;
   }
   
+  stats->startPhase("sort");
+  sortChunkArray(chunk_list);
+  stats->endPhase();
+  stats->startPhase("fileset");
+  addNodes(chunk_list);
+  stats->endPhase();
+  stats->startPhase("finalize");
+  finalizeFiles(chunk_list, verbose);
+  stats->endPhase();
+  
+  // slash excluded
+  uint64_t files_num = 0, deleted_num = 0;
   for(int i=0; i<(int)_files.size(); i++)
-  {
-    cerr << "Processing file " << i+1 << "/" << (int)_files.size() << ": " << endl;
-    if(_files[i].finalize(chunk_list) == 1)
+    if(_files[i].getInodeNum() != 1)
     {
-      _files.erase(_files.begin()+i);
-      i--;
+      files_num++;
+      deleted_num += (_files[i].isDeleted()) ? 1 : 0;
     }
-  }
-    
+  stats->count("files", files_num);
+  stats->count("deleted_files", deleted_num);
 }
 
-int FileSet::addNode(DataNode &dn)
+/**
+ * Group the nodes by inode with several threads, each inserting a range
+ * of chunk_list, then create the files in chunk list order. Only that
+ * order is computed by one thread, the nodes are put back in list order
+ * in their files one shard at a time by several threads. chunk_list must
+ * be sorted.
+ */
+void FileSet::addNodes(vector<Chunk *> &chunk_list)
 {
-  File *f = NULL;
-  uint64_t inode_num = dn.getInodeNum();
+  InodeTable table(FILESET_SHARDS_NUM);
+  int threads_num = max(1, min(fileset_threads_num, (int)chunk_list.size() / FILESET_MIN_CHUNKS_PER_THREAD));
+  vector<insert_job_t> jobs(threads_num);
+  vector<pthread_t> threads;
+  vector<inode_nodes_t *> inodes;
   
-  if(findFile(inode_num, &f))
+  // slash first, even without any node
+  table.insert(1, NULL, 0);
+  for(int i=0; i<threads_num; i++)
+  {
+    jobs[i].table = &table;
+    jobs[i].chunk_list = &chunk_list;
+    jobs[i].begin = (uint64_t)chunk_list.size() * i / threads_num;
+    jobs[i].end = (uint64_t)chunk_list.size() * (i + 1) / threads_num;
+  }
+  for(int i=1; i<threads_num; i++)
   {
-    File f2(inode_num);
-    _files.push_back(f2);
-    assert(findFile(inode_num, &f) == 0);
+    pthread_t t;
+    if(pthread_create(&t, NULL, insertWorker, &jobs[i]))
+      insertWorker(&jobs[i]);
+    else
+      threads.push_back(t);
   }
+  insertWorker(&jobs[0]);
+  for(int i=0; i<(int)threads.size(); i++)
+    pthread_join(threads[i], NULL);
   
-  f->addNode(dn);
+  for(int s=0; s<table.getShardsNum(); s++)
+    table.getInodes(s, inodes);
+  sort(inodes.begin(), inodes.end(), compareInodesByFirstRank);
+  _files.reserve(inodes.size());
+  _shard_files.assign(table.getShardsNum(), vector<int>());
+  for(int i=0; i<(int)inodes.size(); i++)
+  {
+    _files.push_back(File(inodes[i]->inode_num));
+    _shard_files[table.getShard(inodes[i]->inode_num)].push_back(i);
+  }
   
-  return 0;
+  regroup_state_t state;
+  state.fs = this;
+  state.inodes = &inodes;
+  state.next_shard = 0;
+  pthread_mutex_init(&state.lock, NULL);
+  runWorkers(regroupWorker, &state, getWorkersNum(_shard_files.size(), _files.size()));
+  pthread_mutex_destroy(&state.lock);
 }
 
-int FileSet::addNode(DirentNode &dn)
+/**
+ * The data nodes are sorted in chunk_list so they are also sorted in the
+ * _all_data_node array of each file
+ */
+void *FileSet::regroupWorker(void *arg)
 {
-  File *f = NULL;
-  uint64_t inode_num = dn.getInodeNum();
+  regroup_state_t *state = (regroup_state_t *)arg;
+  FileSet *fs = state->fs;
   
-  if(findFile(inode_num, &f))
+  while(true)
   {
-    File f2(inode_num);
-    _files.push_back(f2);
-    assert(findFile(inode_num, &f) == 0);
+    int shard;
+    
+    pthread_mutex_lock(&state->lock);
+    shard = state->next_shard++;
+    pthread_mutex_unlock(&state->lock);
+    
+    if(shard >= (int)fs->_shard_files.size())
+      break;
+    
+    vector<int> &files = fs->_shard_files[shard];
+    for(int j=0; j<(int)files.size(); j++)
+    {
+      inode_nodes_t *in = (*state->inodes)[files[j]];
+      File &f = fs->_files[files[j]];
+      
+      sort(in->nodes.begin(), in->nodes.end());
+      for(int k=0; k<(int)in->nodes.size(); k++)
+      {
+	Node *n = in->nodes[k].second;
+	if(n->getType() == DATA_NODE)
+	  f.addNode(*(static_cast<DataNode *>(n)));
+	else
+	  f.addNode(*(static_cast<DirentNode *>(n)));
+      }
+    }
   }
   
-  f->addNode(dn);
-  
-  return 0;
+  return NULL;
 }
 
 /**
- * returns 0 if file found, -1 if not
+ * One thread finalizes the files in order with the progress output, more
+ * finalize the shards concurrently and only report each finished file
  */
-int FileSet::findFile(uint64_t inode_num, File **file)
+void FileSet::finalizeFiles(vector<Chunk *> &chunk_list, bool verbose)
 {
-  for(int i=0; i<(int)_files.size(); i++)
-    if(_files[i]._inode_num == inode_num)
+  int threads_num = getWorkersNum(_shard_files.size(), _files.size());
+  finalize_state_t state;
+  vector<File> kept;
+  
+  if(threads_num <= 1)
+  {
+    for(int i=0; i<(int)_files.size(); i++)
     {
-      *file = &(_files[i]);
-      return 0;
+      if(verbose)
+	cerr << "Processing file " << i+1 << "/" << (int)_files.size() << ": " << endl;
+      if(_files[i].finalize(chunk_list, verbose) == 1)
+      {
+	_files.erase(_files.begin()+i);
+	i--;
+      }
     }
+    _shard_files.clear();
+    return;
+  }
+  
+  state.fs = this;
+  state.chunk_list = &chunk_list;
+  state.results.assign(_files.size(), 0);
+  state.next_shard = 0;
+  state.done_num = 0;
+  state.verbose = verbose;
+  pthread_mutex_init(&state.lock, NULL);
+  runWorkers(finalizeWorker, &state, threads_num);
+  pthread_mutex_destroy(&state.lock);
+  
+  // a live file prints an empty line when finalized verbosely
+  kept.reserve(_files.size());
+  for(int i=0; i<(int)_files.size(); i++)
+  {
+    if(state.results[i] == 1)
+      continue;
+    if(verbose && state.results[i] == 0 && _files[i].getInodeNum() != 1 && !_files[i].isDeleted())
+      cout << endl;
+    kept.push_back(_files[i]);
+  }
+  _files.swap(kept);
+  _shard_files.clear();
+}
+
+void *FileSet::finalizeWorker(void *arg)
+{
+  finalize_state_t *state = (finalize_state_t *)arg;
+  FileSet *fs = state->fs;
+  
+  while(true)
+  {
+    int shard;
     
-  return -1;
+    pthread_mutex_lock(&state->lock);
+    shard = state->next_shard++;
+    pthread_mutex_unlock(&state->lock);
+    
+    if(shard >= (int)fs->_shard_files.size())
+      break;
+    
+    vector<int> &files = fs->_shard_files[shard];
+    for(int j=0; j<(int)files.size(); j++)
+    {
+      state->results[files[j]] = fs->_files[files[j]].finalize(*state->chunk_list, false);
+      if(state->verbose)
+      {
+	pthread_mutex_lock(&state->lock);
+	cerr << "Processing file " << ++state->done_num << "/" << (int)fs->_files.size() << ": "
+	  << endl;
+	pthread_mutex_unlock(&state->lock);
+      }
+    }
+  }
+  
+  return NULL;
+}
+
+int FileSet::getFilesNum() const
+{
+  return _files.size();
+}
+
+File * FileSet::getFile(int index)
+{
+  return &(_files[index]);
+}
+
+const File * FileSet::getFile(int index) const
+{
+  return &(_files[index]);
 }
 
 ostream& operator<<(ostream& os, FileSet& f)
@@ -624,24 +1078,138 @@ ostream& operator<<(ostream& os, FileSet& f)
 }
 
 /****************************** Tools *********************************/
+
+/**
+ * Threads building each FileSet, 1 by default in the library, at most the
+ * online processors. Jffs2DParser sets it from -j, all the processors by
+ * default, outside of the batch modes whose sets are built concurrently.
+ */
+void setFileSetThreadsNum(int threads_num)
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  
+  fileset_threads_num = max(1, threads_num);
+  if(cpus > 0 && fileset_threads_num > cpus)
+    fileset_threads_num = cpus;
+}
+
+/**
+ * Workers for a pass over the shards of a FileSet : no more than the
+ * shards or the files, as each one takes a whole shard
+ */
+int getWorkersNum(int shards_num, int files_num)
+{
+  return max(1, min(fileset_threads_num, min(shards_num, files_num)));
+}
+
 /**
- * Return false if the element is already present thus was not added
- * to the array
+ * Run worker on threads_num threads, the caller being one of them
  */
-bool addToArrayIfNotAlreadyPresent(int val, vector<int> &vec)
+void runWorkers(void *(*worker)(void *), void *arg, int threads_num)
 {
-  bool present = false;
+  vector<pthread_t> threads;
   
-  for(int i=0; i<(int)vec.size(); i++)
+  for(int i=1; i<threads_num; i++)
   {
-    if(vec[i] == val)
-      present = true;
+    pthread_t t;
+    if(pthread_create(&t, NULL, worker, arg) == 0)
+      threads.push_back(t);
   }
-     
-  if(!present)
-    vec.push_back(val);
+  worker(arg);
+  for(int i=0; i<(int)threads.size(); i++)
+    pthread_join(threads[i], NULL);
+}
+
+int getFileSetThreadsNum()
+{
+  return fileset_threads_num;
+}
+
+/**
+ * Readpage model of every file, to be set before the files are built
+ * as their costs are cached
+ */
+void setReadpageModel(readpage_model_t model)
+{
+  readpage_model = model;
+}
+
+readpage_model_t getReadpageModel()
+{
+  return readpage_model;
+}
+
+const char *getReadpageModelName(readpage_model_t model)
+{
+  return (model == READPAGE_KERNEL) ? "kernel" : "simple";
+}
+
+void addReadpageWork(readpage_work_t &to, readpage_work_t &from)
+{
+  to.fragments_num += from.fragments_num;
+  to.flash_pages += from.flash_pages;
+  to.flash_bytes += from.flash_bytes;
+  to.crc_bytes += from.crc_bytes;
+  to.decompressed_bytes += from.decompressed_bytes;
+  to.discarded_bytes += from.discarded_bytes;
+}
+
+/**
+ * Appended to a readpage cost line
+ */
+void printReadpageWork(ostream &os, readpage_work_t &w)
+{
+  os << ", fragments: " << w.fragments_num << ", bytes read: " << w.flash_bytes
+    << ", crc bytes: " << w.crc_bytes << ", decompressed: " << w.decompressed_bytes
+    << ", discarded: " << w.discarded_bytes;
+}
+
+/**
+ * The data and dirent nodes of a range of the chunk list, the deletion
+ * dirents belong to no inode
+ */
+void *insertWorker(void *arg)
+{
+  insert_job_t *job = (insert_job_t *)arg;
+  
+  for(int i=job->begin; i<job->end; i++)
+  {
+    Chunk *c = (*job->chunk_list)[i];
     
-  return present;
+    if(c->getType() != DATA_NODE && c->getType() != DIRENT_NODE)
+      continue;
+    Node *n = static_cast<Node *>(c);
+    if(c->getType() == DIRENT_NODE && n->getInodeNum() == 0)
+      continue;
+    job->table->insert(n->getInodeNum(), n, i + 1);
+  }
+  
+  return NULL;
+}
+
+bool compareInodesByFirstRank(inode_nodes_t *a, inode_nodes_t *b)
+{
+  return a->first_rank < b->first_rank;
+}
+
+/**
+ * Minimal number of flash pages needed to store size bytes of file data,
+ * assuming the file is divided into maximal sized nodes of 4096 bytes +
+ * 68 bytes of metadata
+ */
+int getMinPagesNum(uint32_t size, int flash_page_size)
+{
+  uint64_t total_nodes_needed, res;
+  
+  total_nodes_needed = size / (JFFS2_MAX_DATANODE_SIZE);
+  if(size % (JFFS2_MAX_DATANODE_SIZE) != 0)
+    total_nodes_needed += 1;
+  
+  res = (total_nodes_needed*(JFFS2_MAX_DATANODE_SIZE)) / flash_page_size;
+  if((total_nodes_needed*(JFFS2_MAX_DATANODE_SIZE)) % flash_page_size != 0)
+    res += 1;
+  
+  return res;
 }
 
 /**
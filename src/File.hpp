@@ -4,10 +4,40 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <map>
+#include <pthread.h>
 
 #include "ChunkModel.hpp"
+#include "PageSet.hpp"
 
-using namespace std;
+#define LINUX_PAGE_SIZE				4096
+#define FILESET_SHARDS_NUM			64
+#define JFFS2_NODE_HEADER_CRC_SIZE		60	// jffs2_raw_inode covered by node_crc
+#define READPAGE_DEFAULT_CRC_MBPS		100.0
+
+/**
+ * How a readpage is charged. The simple model reads the pages of every
+ * valid node holding bytes of the linux page and the sequential read of
+ * a file reads each node once. The kernel model follows
+ * jffs2_read_inode_range : each fragment is read, CRC checked and
+ * decompressed as a whole node by jffs2_read_dnode, the bytes overlapped
+ * by newer fragments are thrown away, and a node spanning two linux
+ * pages is read again by the second readpage.
+ */
+typedef enum {READPAGE_SIMPLE, READPAGE_KERNEL} readpage_model_t;
+
+/**
+ * Work of one readpage in the kernel model
+ */
+typedef struct
+{
+  int fragments_num;			// jffs2_read_dnode calls
+  int flash_pages;			// the last page read stays in the NAND page buffer
+  uint64_t flash_bytes;			// whole nodes, header and payload
+  uint64_t crc_bytes;			// header and payload CRCs
+  uint64_t decompressed_bytes;		// whole payloads of the compressed nodes
+  uint64_t discarded_bytes;		// payload bytes outside the fragments
+} readpage_work_t;
 
 class File
 {
@@ -17,54 +47,132 @@ class File
     uint32_t getSize();
     uint64_t getInodeNum();
     uint64_t getParentInodeNum();
-    string getName();
-    vector<int> getConcernedPagesIndexes();
+    std::string getName();
+    std::vector<int> getConcernedPagesIndexes();
+    PageSet &getConcernedPages();
+    FlashGeometry *getGeometry();
     double getFragmentationFactor();
     double getContiguousFactor();
     int getSequentialReadCost();
     int getLinuxPageReadCost(int page_index);
+    std::vector<DataNode *> getDataNodesReadForLinuxPage(int linux_page_index);
+    std::vector<int> getFlashPagesReadForLinuxPage(int linux_page_index);
+    int getLinuxPageReadWork(int linux_page_index, readpage_work_t &res);
     int getLinuxPagesNum();
-    void printSequentialPerPageReadCost();
+    int getTheoriticalPageNum();
+    bool isDeleted();
+    std::vector<DataNode *> &getValidDataNodes();
+    DirentNode *getValidDirentNode();
+    void printSequentialPerPageReadCost(std::ostream &os);
+    void invalidateMetrics();
     
   private:
     uint64_t _inode_num;
-    vector<DataNode *> _all_data_nodes;
-    vector<DataNode *> _valid_data_nodes;
+    std::vector<DataNode *> _all_data_nodes;
+    std::vector<DataNode *> _valid_data_nodes;
     DirentNode *_valid_dirent_node;
-    vector<DirentNode *> _all_dirent_nodes;
+    std::vector<DirentNode *> _all_dirent_nodes;
     bool _was_deleted;
     bool _is_final;
     int _sequential_cost;
     
+    // derived values computed at most once, see invalidateMetrics
+    bool _size_cached;
+    uint32_t _size;
+    int _theoritical_page_num;
+    bool _concerned_pages_cached;
+    PageSet _concerned_pages;
+    bool _contiguous_factor_cached;
+    double _contiguous_factor;
+    std::vector<std::vector<int> > _linux_pages_flash_pages;	// empty if not computed yet
+    
     int addNode(DataNode &dn);
     int addNode(DirentNode &dn);
-    int set_valid_dirent(vector<Chunk *> &chunk_list);
-    int set_valid_datanodes();
+    int set_valid_dirent(std::vector<Chunk *> &chunk_list);
+    int set_valid_datanodes(bool verbose);
     DataNode *getMostRecentDataNode();
     DataNode *getValidDataNodeAtOffset(uint32_t offset);
+    DataNode *getValidExtentAtOffset(uint32_t offset, uint32_t &len);
+    int getKernelSequentialReadCost();
     int addValidDataNodeIfNotAlreadyPresent(DataNode *dn);
-    int getTheoriticalPageNum();
-    int finalize(vector<Chunk *> &chunk_list);
-    vector<int> getFlashPagesReadForLinuxPage(int linux_page_index);
+    int finalize(std::vector<Chunk *> &chunk_list, bool verbose);
     
   friend class FileSet;
-  friend ostream& operator<<(ostream& os, File& f);
+  friend std::ostream& operator<<(std::ostream& os, File& f);
+};
+
+/**
+ * Nodes of one inode with their rank in the chunk list
+ */
+typedef struct
+{
+  uint64_t inode_num;
+  uint64_t first_rank;			// lowest rank of its nodes
+  std::vector<std::pair<uint64_t, Node *> > nodes;	// in insertion order
+} inode_nodes_t;
+
+/**
+ * Nodes grouped by inode number, sharded by a hash of it so that several
+ * threads insert at once, each shard under its own lock. The rank given
+ * with each node lets the nodes of an inode, and the inodes, be put back
+ * in chunk list order whatever the thread that inserted them.
+ */
+class InodeTable
+{
+  public:
+    InodeTable(int shards_num);
+    ~InodeTable();
+    int getShardsNum();
+    int getShard(uint64_t inode_num);
+    void insert(uint64_t inode_num, Node *node, uint64_t rank);
+    void getInodes(int shard, std::vector<inode_nodes_t *> &res);
+
+  private:
+    typedef struct
+    {
+      pthread_mutex_t lock;
+      std::map<uint64_t, inode_nodes_t> inodes;
+    } shard_t;
+
+    std::vector<shard_t> _shards;
 };
 
+/**
+ * Files of a chunk list, slash first then by first appearance of their
+ * inode in the sorted list. The nodes are grouped in an InodeTable by
+ * several threads, then the files are finalized one shard at a time by
+ * several threads, see setFileSetThreadsNum.
+ */
 class FileSet
 {
   public:
-    FileSet(vector<Chunk *> &chunk_list);
+    FileSet(std::vector<Chunk *> &chunk_list);
+    FileSet(std::vector<Chunk *> &chunk_list, bool verbose);
+    int getFilesNum() const;
+    File *getFile(int index);
+    const File *getFile(int index) const;
 
   private:
-    vector<File> _files;
+    std::vector<File> _files;
+    std::vector<std::vector<int> > _shard_files;	// files of each shard, until finalized
     
-    int addNode(DataNode &dn);
-    int addNode(DirentNode &dn);
-    int findFile(uint64_t inode_num, File **file);
+    void build(std::vector<Chunk *> &chunk_list, bool verbose);
+    void addNodes(std::vector<Chunk *> &chunk_list);
+    void finalizeFiles(std::vector<Chunk *> &chunk_list, bool verbose);
     uint32_t getMostRecentDirentVersion(uint64_t inode_num);
+    static void *regroupWorker(void *arg);
+    static void *finalizeWorker(void *arg);
     
-  friend ostream& operator<<(ostream& os, FileSet& fs);
+  friend std::ostream& operator<<(std::ostream& os, FileSet& fs);
 };
 
+int getMinPagesNum(uint32_t size, int flash_page_size);
+void setFileSetThreadsNum(int threads_num);
+int getFileSetThreadsNum();
+void setReadpageModel(readpage_model_t model);
+readpage_model_t getReadpageModel();
+const char *getReadpageModelName(readpage_model_t model);
+void addReadpageWork(readpage_work_t &to, readpage_work_t &from);
+void printReadpageWork(std::ostream &os, readpage_work_t &w);
+
 #endif /* FILE_HPP */
@@ -2,57 +2,25 @@
 
 #include "FlashAddr.hpp"
 
-/**************************** Flash address ***************************/
-int FlashAddr::_pages_per_block = -1;
-int FlashAddr::_page_size_in_bytes = -1;
-int FlashAddr::_partition_offset = -1;
+using namespace std;
 
-void FlashAddr::init(int page_size_in_bytes, int pages_per_block)
-{
-  _pages_per_block = pages_per_block;
-  _page_size_in_bytes = page_size_in_bytes;
-  _partition_offset = 0;
-}
-
-void FlashAddr::init(int page_size_in_bytes, int pages_per_block, int partition_offset)
-{
-  _pages_per_block = pages_per_block;
-  _page_size_in_bytes = page_size_in_bytes;
-  _partition_offset = partition_offset;
-}
-
-int FlashAddr::getFlashPageSize()
-{
-  return _page_size_in_bytes;
-}
-
-int FlashAddr::getPartitionOffset()
-{
-  return _partition_offset;
-}
+/**************************** Flash address ***************************/
 
-int FlashAddr::getNumPagesPerBlock()
+FlashAddr::FlashAddr()
 {
-  return _pages_per_block;
+  _flash_offset = 0;
+  _geometry = NULL;
 }
 
-FlashAddr::FlashAddr()
+FlashAddr::FlashAddr(uint64_t offset, FlashGeometry &geometry)
 {
-  _valid = false;
+  _flash_offset = offset;
+  _geometry = &geometry;
 }
 
-FlashAddr::FlashAddr(uint64_t offset)
+FlashGeometry & FlashAddr::getGeometry()
 {
-  if(FlashAddr::_page_size_in_bytes == -1 || FlashAddr::_pages_per_block == -1)
-  {
-    cerr << "Error, number of pages per block & page size in bytes are" 
-      " not initialized." << endl;
-    exit(-1);
-  }
-  
-  _flash_offset = offset;
-  
-  // cout << offset << endl;
+  return *_geometry;
 }
 
 uint64_t FlashAddr::getFlashOffset()
@@ -62,32 +30,32 @@ uint64_t FlashAddr::getFlashOffset()
 
 uint32_t FlashAddr::getFlashPage()
 {
-  return _flash_offset/_page_size_in_bytes;
+  return _geometry->getPage(_flash_offset);
 }
 
 uint32_t FlashAddr::getFlashBlock()
 {
-  return ((_flash_offset/_page_size_in_bytes)/_pages_per_block);
+  return _geometry->getBlock(_flash_offset);
 }
 
 int FlashAddr::getOffsetOfPageInBlock()
 {
-  return ((_flash_offset/_page_size_in_bytes)%_pages_per_block);
+  return _geometry->getPageInBlock(_flash_offset);
 }
 
 int FlashAddr::getByteOffsetInPage()
 {
-  return _flash_offset%_page_size_in_bytes;
+  return _geometry->getByteInPage(_flash_offset);
 }
 
 bool FlashAddr::isStartOfAPage()
 {
-  return (_flash_offset%_page_size_in_bytes == 0);
+  return (_geometry->getByteInPage(_flash_offset) == 0);
 }
 
 bool FlashAddr::isStartOfABlock()
 {
-  return (_flash_offset%(_pages_per_block*_page_size_in_bytes) == 0);
+  return (_flash_offset % _geometry->getBlockSize() == 0);
 }
 
 ostream& operator<<(ostream& os, FlashAddr& fa )
@@ -3,17 +3,16 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <stdint.h>
 
-using namespace std;
-
-typedef unsigned long long int 		uint64_t;
-typedef unsigned int 			uint32_t;
+#include "FlashGeometry.hpp"
 
 class FlashAddr
 {
   public:
     FlashAddr();
-    FlashAddr(uint64_t offset);
+    FlashAddr(uint64_t offset, FlashGeometry &geometry);
+    FlashGeometry &getGeometry();
     uint64_t getFlashOffset();
     uint32_t getFlashPage();
     uint32_t getFlashBlock();
@@ -21,21 +20,12 @@ class FlashAddr
     int getByteOffsetInPage();
     bool isStartOfAPage();
     bool isStartOfABlock();
-    
-    static int getFlashPageSize();
-    static int getNumPagesPerBlock();
-    static int getPartitionOffset();
-    static void init(int page_size_in_bytes, int pages_per_block);
-    static void init(int page_size_in_bytes, int pages_per_block, int partition_offset);
   
   private:
     uint64_t _flash_offset;
-    bool _valid;
-    static int _page_size_in_bytes;
-    static int _pages_per_block;
-    static int _partition_offset;
+    FlashGeometry *_geometry;		// NULL for a default constructed address
     
-  friend ostream& operator<<(ostream& os, FlashAddr& fa );
+  friend std::ostream& operator<<(std::ostream& os, FlashAddr& fa );
     
 };
 
@@ -0,0 +1,164 @@
+#include "FlashGeometry.hpp"
+
+using namespace std;
+
+int getLog2(uint64_t value);
+
+/**
+ * Address computations, generic ones use divisions
+ */
+template <bool POW2> class GeometryOps
+{
+  public:
+    static uint32_t getPage(FlashGeometry &g, uint64_t offset)
+    {
+      return offset / g._page_size_in_bytes;
+    }
+    static uint32_t getBlock(FlashGeometry &g, uint64_t offset)
+    {
+      return (offset / g._page_size_in_bytes) / g._pages_per_block;
+    }
+    static int getPageInBlock(FlashGeometry &g, uint64_t offset)
+    {
+      return (offset / g._page_size_in_bytes) % g._pages_per_block;
+    }
+    static int getByteInPage(FlashGeometry &g, uint64_t offset)
+    {
+      return offset % g._page_size_in_bytes;
+    }
+};
+
+template <> class GeometryOps<true>
+{
+  public:
+    static uint32_t getPage(FlashGeometry &g, uint64_t offset)
+    {
+      return offset >> g._page_shift;
+    }
+    static uint32_t getBlock(FlashGeometry &g, uint64_t offset)
+    {
+      return offset >> (g._page_shift + g._block_shift);
+    }
+    static int getPageInBlock(FlashGeometry &g, uint64_t offset)
+    {
+      return (offset >> g._page_shift) & (g._pages_per_block - 1);
+    }
+    static int getByteInPage(FlashGeometry &g, uint64_t offset)
+    {
+      return offset & (g._page_size_in_bytes - 1);
+    }
+};
+
+/*************************** FlashGeometry ****************************/
+
+FlashGeometry::FlashGeometry()
+{
+  _page_size_in_bytes = _pages_per_block = -1;
+  _partition_offset = 0;
+  _page_shift = _block_shift = -1;
+  _get_page = GeometryOps<false>::getPage;
+  _get_block = GeometryOps<false>::getBlock;
+  _get_page_in_block = GeometryOps<false>::getPageInBlock;
+  _get_byte_in_page = GeometryOps<false>::getByteInPage;
+}
+
+FlashGeometry::FlashGeometry(int page_size_in_bytes, int pages_per_block, uint64_t partition_offset)
+{
+  _page_size_in_bytes = page_size_in_bytes;
+  _pages_per_block = pages_per_block;
+  _partition_offset = partition_offset;
+  _page_shift = getLog2(page_size_in_bytes);
+  _block_shift = getLog2(pages_per_block);
+
+  if(isPow2())
+  {
+    _get_page = GeometryOps<true>::getPage;
+    _get_block = GeometryOps<true>::getBlock;
+    _get_page_in_block = GeometryOps<true>::getPageInBlock;
+    _get_byte_in_page = GeometryOps<true>::getByteInPage;
+  }
+  else
+  {
+    _get_page = GeometryOps<false>::getPage;
+    _get_block = GeometryOps<false>::getBlock;
+    _get_page_in_block = GeometryOps<false>::getPageInBlock;
+    _get_byte_in_page = GeometryOps<false>::getByteInPage;
+  }
+}
+
+bool FlashGeometry::isValid() const
+{
+  return _page_size_in_bytes > 0 && _pages_per_block > 0;
+}
+
+bool FlashGeometry::isPow2() const
+{
+  return _page_shift != -1 && _block_shift != -1;
+}
+
+int FlashGeometry::getFlashPageSize() const
+{
+  return _page_size_in_bytes;
+}
+
+int FlashGeometry::getNumPagesPerBlock() const
+{
+  return _pages_per_block;
+}
+
+uint64_t FlashGeometry::getBlockSize() const
+{
+  return (uint64_t)_page_size_in_bytes * _pages_per_block;
+}
+
+uint64_t FlashGeometry::getPartitionOffset() const
+{
+  return _partition_offset;
+}
+
+uint32_t FlashGeometry::getPage(uint64_t offset)
+{
+  return _get_page(*this, offset);
+}
+
+uint32_t FlashGeometry::getBlock(uint64_t offset)
+{
+  return _get_block(*this, offset);
+}
+
+int FlashGeometry::getPageInBlock(uint64_t offset)
+{
+  return _get_page_in_block(*this, offset);
+}
+
+int FlashGeometry::getByteInPage(uint64_t offset)
+{
+  return _get_byte_in_page(*this, offset);
+}
+
+ostream& operator<<(ostream& os, FlashGeometry& g)
+{
+  os << g._page_size_in_bytes << " bytes pages, " << g._pages_per_block << " pages per block, "
+    << "partition offset " << g._partition_offset;
+  return os;
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Return n if value is 2^n, -1 if it is not a power of two
+ */
+int getLog2(uint64_t value)
+{
+  int res = 0;
+
+  if(value == 0 || (value & (value - 1)) != 0)
+    return -1;
+  while(value > 1)
+  {
+    value >>= 1;
+    res++;
+  }
+
+  return res;
+}
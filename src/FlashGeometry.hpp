@@ -0,0 +1,47 @@
+#ifndef FLASH_GEOMETRY_HPP
+#define FLASH_GEOMETRY_HPP
+
+#include <iostream>
+#include <stdint.h>
+
+/**
+ * Flash page size, pages per block and partition offset of one dump.
+ * Every FlashAddr refers to its geometry so that several partitions or
+ * geometries can be analysed at once. When both sizes are powers of two
+ * the address computations use shifts and masks, the implementation is
+ * chosen once at construction.
+ */
+class FlashGeometry
+{
+  public:
+    FlashGeometry();
+    FlashGeometry(int page_size_in_bytes, int pages_per_block, uint64_t partition_offset);
+
+    bool isValid() const;
+    bool isPow2() const;
+    int getFlashPageSize() const;
+    int getNumPagesPerBlock() const;
+    uint64_t getBlockSize() const;
+    uint64_t getPartitionOffset() const;
+
+    uint32_t getPage(uint64_t offset);
+    uint32_t getBlock(uint64_t offset);
+    int getPageInBlock(uint64_t offset);
+    int getByteInPage(uint64_t offset);
+
+  private:
+    int _page_size_in_bytes;
+    int _pages_per_block;
+    uint64_t _partition_offset;
+    int _page_shift;			// log2 of the sizes, pow2 geometries only
+    int _block_shift;
+    uint32_t (*_get_page)(FlashGeometry &g, uint64_t offset);
+    uint32_t (*_get_block)(FlashGeometry &g, uint64_t offset);
+    int (*_get_page_in_block)(FlashGeometry &g, uint64_t offset);
+    int (*_get_byte_in_page)(FlashGeometry &g, uint64_t offset);
+
+  template <bool POW2> friend class GeometryOps;
+  friend std::ostream& operator<<(std::ostream& os, FlashGeometry& g);
+};
+
+#endif /* FLASH_GEOMETRY_HPP */
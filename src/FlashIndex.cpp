@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <map>
+
+#include "FlashIndex.hpp"
+
+using namespace std;
+
+bool compareExtents(const node_extent_t &a, const node_extent_t &b);
+
+/**************************** FlashIndex ******************************/
+
+/**
+ * O(n log n) : one pass over the chunk list, one over the files to
+ * flag the valid nodes, then a sort
+ */
+FlashIndex::FlashIndex(vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry)
+  : _geometry(geometry)
+{
+  map<uint64_t, File *> owners;
+  map<Node *, File *> valid_nodes;
+
+  for(int i=0; i<fs.getFilesNum(); i++)
+  {
+    File *f = fs.getFile(i);
+    vector<DataNode *> &valid = f->getValidDataNodes();
+
+    owners[f->getInodeNum()] = f;
+    for(int j=0; j<(int)valid.size(); j++)
+      valid_nodes[valid[j]] = f;
+    // the deletion dirent of a deleted file is owned by that file
+    if(f->getValidDirentNode() != NULL)
+      valid_nodes[f->getValidDirentNode()] = f;
+  }
+
+  for(int i=0; i<(int)chunk_list.size(); i++)
+  {
+    if(chunk_list[i]->getType() != DATA_NODE && chunk_list[i]->getType() != DIRENT_NODE)
+      continue;
+
+    Node *n = static_cast<Node *>(chunk_list[i]);
+    node_extent_t e;
+    map<Node *, File *>::iterator v = valid_nodes.find(n);
+
+    if(n->getFlashSize() == 0)
+      continue;
+
+    e.first_page = n->getFirstFlashPage();
+    e.last_page = n->getLastFlashPage();
+    e.node = n;
+    e.valid = (v != valid_nodes.end());
+    if(e.valid)
+      e.file = v->second;
+    else
+    {
+      map<uint64_t, File *>::iterator o = owners.find(n->getInodeNum());
+      e.file = (o == owners.end()) ? NULL : o->second;
+    }
+    _extents.push_back(e);
+  }
+
+  sort(_extents.begin(), _extents.end(), compareExtents);
+
+  _max_last_page.resize(_extents.size());
+  for(int i=0; i<(int)_extents.size(); i++)
+    _max_last_page[i] = (i == 0) ? _extents[i].last_page :
+      max(_max_last_page[i-1], _extents[i].last_page);
+}
+
+int FlashIndex::getExtentsNum() const
+{
+  return _extents.size();
+}
+
+/**
+ * Append to res the extents overlapping [first_page, last_page], sorted
+ * by flash position. O(log n + k) as nodes do not overlap on flash.
+ * Returns the number of extents found.
+ */
+int FlashIndex::findPages(uint32_t first_page, uint32_t last_page,
+  vector<const node_extent_t *> &res) const
+{
+  int start = res.size();
+  node_extent_t key;
+  int i;
+
+  key.first_page = last_page;
+  key.node = NULL;
+  // first extent starting after last_page
+  i = upper_bound(_extents.begin(), _extents.end(), key, compareExtents) - _extents.begin();
+
+  for(i=i-1; i>=0 && _max_last_page[i] >= first_page; i--)
+    if(_extents[i].last_page >= first_page)
+      res.push_back(&(_extents[i]));
+
+  reverse(res.begin()+start, res.end());
+  return res.size() - start;
+}
+
+int FlashIndex::findPage(uint32_t page, vector<const node_extent_t *> &res) const
+{
+  return findPages(page, page, res);
+}
+
+int FlashIndex::findBlock(uint32_t block, vector<const node_extent_t *> &res) const
+{
+  uint32_t ppb = _geometry.getNumPagesPerBlock();
+  return findPages(block*ppb, (block+1)*ppb - 1, res);
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Order by first page then flash offset. A NULL node is a search key
+ * sorting after every extent starting on the same page.
+ */
+bool compareExtents(const node_extent_t &a, const node_extent_t &b)
+{
+  if(a.first_page != b.first_page)
+    return a.first_page < b.first_page;
+  if(a.node == NULL || b.node == NULL)
+    return b.node == NULL && a.node != NULL;
+  return a.node->getFlashAddr().getFlashOffset() < b.node->getFlashAddr().getFlashOffset();
+}
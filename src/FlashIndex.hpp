@@ -0,0 +1,45 @@
+#ifndef FLASH_INDEX_HPP
+#define FLASH_INDEX_HPP
+
+#include <iostream>
+#include <vector>
+
+#include "ChunkModel.hpp"
+#include "File.hpp"
+
+/**
+ * Flash extent of one node, with the file owning it
+ */
+typedef struct
+{
+  uint32_t first_page;
+  uint32_t last_page;
+  Node *node;
+  File *file;				// NULL if no file in the set owns the node
+  bool valid;				// false if the node is obsolete
+} node_extent_t;
+
+/**
+ * Reverse of Node::getConcernedPagesIndexes : for a range of flash
+ * pages, find the nodes (valid or obsolete) stored there.
+ * Extents are kept sorted by first page, along with the running maximum
+ * of the last pages so that a query is a binary search followed by a
+ * scan of the matching extents only.
+ */
+class FlashIndex
+{
+  public:
+    FlashIndex(std::vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry);
+    int getExtentsNum() const;
+    int findPages(uint32_t first_page, uint32_t last_page,
+      std::vector<const node_extent_t *> &res) const;
+    int findPage(uint32_t page, std::vector<const node_extent_t *> &res) const;
+    int findBlock(uint32_t block, std::vector<const node_extent_t *> &res) const;
+
+  private:
+    std::vector<node_extent_t> _extents;
+    std::vector<uint32_t> _max_last_page;	// max of last_page over _extents[0..i]
+    FlashGeometry _geometry;
+};
+
+#endif /* FLASH_INDEX_HPP */
@@ -0,0 +1,283 @@
+#include <fstream>
+#include <set>
+#include <algorithm>
+#include <cstring>
+
+#include "FlashMap.hpp"
+
+using namespace std;
+
+#define MAP_MIN_PIXELS				1024
+
+// colours of the states, the last one for the bytes no chunk covers
+static const unsigned char state_colours[][3] =
+{
+  {40, 180, 40},			// valid
+  {200, 40, 40},			// obsolete
+  {20, 20, 20},				// free
+  {60, 60, 220},			// summary nodes
+  {128, 128, 128}			// not in the dump
+};
+
+/****************************** FlashMap ******************************/
+
+/**
+ * The valid nodes are the ones of computeDumpSummary : valid data nodes
+ * and current dirents of the non deleted files
+ */
+FlashMap::FlashMap(vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry,
+  int max_pixels)
+{
+  set<Node *> valid_nodes;
+  vector<pair<uint64_t, Node *> > valid_extents;
+  uint64_t first = (uint64_t)-1, last = 0;
+  uint64_t pages_num;
+
+  _geometry = geometry;
+  _first_page = 0;
+  _pages_per_pixel = 1;
+
+  for(int i=0; i<fs.getFilesNum(); i++)
+  {
+    File *f = fs.getFile(i);
+    vector<DataNode *> &valid = f->getValidDataNodes();
+
+    if(f->isDeleted())
+      continue;
+    valid_nodes.insert(valid.begin(), valid.end());
+    if(f->getValidDirentNode() != NULL)
+      valid_nodes.insert(f->getValidDirentNode());
+  }
+
+  // extent of the dump, from the start of its first block
+  for(int i=0; i<(int)chunk_list.size(); i++)
+  {
+    Chunk *c = chunk_list[i];
+    uint64_t start, end;
+
+    if(c->getType() == FREE_SPACE)
+    {
+      start = static_cast<FreeSpaceChunk *>(c)->getStart().getFlashOffset();
+      end = start + static_cast<FreeSpaceChunk *>(c)->getSize();
+    }
+    else if(c->getType() == SUMMARY_NODE)
+    {
+      start = static_cast<SummaryNode *>(c)->getFlashAddr().getFlashOffset();
+      end = start + static_cast<SummaryNode *>(c)->getFlashSize();
+    }
+    else
+    {
+      start = static_cast<Node *>(c)->getFlashAddr().getFlashOffset();
+      end = start + static_cast<Node *>(c)->getFlashSize();
+    }
+    first = min(first, start);
+    last = max(last, end);
+  }
+  if(first >= last)
+    return;
+
+  _first_page = _geometry.getBlock(first) * _geometry.getNumPagesPerBlock();
+  pages_num = _geometry.getPage(last - 1) - _first_page + 1;
+  max_pixels = max(max_pixels, MAP_MIN_PIXELS);
+  while((pages_num + _pages_per_pixel - 1) / _pages_per_pixel > (uint64_t)max_pixels)
+    _pages_per_pixel *= 2;
+
+  map_pixel_t empty;
+  memset(&empty, 0, sizeof(empty));
+  _pixels.assign((pages_num + _pages_per_pixel - 1) / _pages_per_pixel, empty);
+
+  for(int i=0; i<(int)chunk_list.size(); i++)
+  {
+    Chunk *c = chunk_list[i];
+
+    switch(c->getType())
+    {
+      case FREE_SPACE:
+      {
+	FreeSpaceChunk *fsc = static_cast<FreeSpaceChunk *>(c);
+	addExtent(fsc->getStart().getFlashOffset(), fsc->getSize(), MAP_FREE);
+	break;
+      }
+
+      case SUMMARY_NODE:
+      {
+	SummaryNode *sn = static_cast<SummaryNode *>(c);
+	addExtent(sn->getFlashAddr().getFlashOffset(), sn->getFlashSize(), MAP_OTHER);
+	break;
+      }
+
+      case DATA_NODE:
+      case DIRENT_NODE:
+      {
+	Node *n = static_cast<Node *>(c);
+	map_state_t state = (valid_nodes.find(n) != valid_nodes.end()) ? MAP_VALID : MAP_OBSOLETE;
+	addExtent(n->getFlashAddr().getFlashOffset(), n->getFlashSize(), state);
+	if(state == MAP_VALID)
+	  valid_extents.push_back(make_pair(n->getFlashAddr().getFlashOffset(), n));
+	break;
+      }
+
+      default:
+	break;
+    }
+  }
+
+  findOwners(valid_extents);
+}
+
+int FlashMap::getPagesPerPixel()
+{
+  return _pages_per_pixel;
+}
+
+int FlashMap::getPixelsNum()
+{
+  return _pixels.size();
+}
+
+/**
+ * Binary PPM, width pixels per row, the last row padded with the
+ * colour of the bytes out of the dump
+ */
+int FlashMap::writePPM(char *path, map_colouring_t colouring, int width)
+{
+  ofstream out(path, ios::out | ios::binary);
+  vector<unsigned char> row;
+  int rows_num;
+
+  if(!out)
+  {
+    cerr << "Can't open " << path << endl;
+    return -1;
+  }
+  if(width < 1)
+    width = 1;
+
+  rows_num = max(1, ((int)_pixels.size() + width - 1) / width);
+  out << "P6\n" << width << " " << rows_num << "\n255\n";
+
+  row.resize(width * 3);
+  for(int r=0; r<rows_num; r++)
+  {
+    for(int x=0; x<width; x++)
+    {
+      int i = r * width + x;
+      if(i < (int)_pixels.size())
+	getColour(_pixels[i], colouring, &row[x*3]);
+      else
+	memcpy(&row[x*3], state_colours[MAP_STATES_NUM], 3);
+    }
+    out.write((char *)&row[0], row.size());
+  }
+
+  if(!out)
+  {
+    cerr << "Error writing " << path << endl;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Account size bytes from offset to each pixel they overlap
+ */
+void FlashMap::addExtent(uint64_t offset, uint64_t size, map_state_t state)
+{
+  uint64_t pixel_bytes = (uint64_t)_pages_per_pixel * _geometry.getFlashPageSize();
+  uint64_t base = (uint64_t)_first_page * _geometry.getFlashPageSize();
+  uint64_t end = offset + size;
+
+  while(offset < end)
+  {
+    uint64_t i = (offset - base) / pixel_bytes;
+    uint64_t n = min(end, base + (i + 1) * pixel_bytes) - offset;
+    map_pixel_t &p = _pixels[i];
+
+    p.bytes[state] += n;
+    offset += n;
+  }
+}
+
+/**
+ * Count the valid bytes of each file in a pixel, the valid nodes being
+ * walked in flash order so that only one pixel is counted at a time
+ */
+void FlashMap::findOwners(vector<pair<uint64_t, Node *> > &valid)
+{
+  uint64_t pixel_bytes = (uint64_t)_pages_per_pixel * _geometry.getFlashPageSize();
+  uint64_t base = (uint64_t)_first_page * _geometry.getFlashPageSize();
+  map<uint64_t, uint64_t> bytes;	// of each file in the current pixel
+  uint64_t cur = 0;
+
+  sort(valid.begin(), valid.end());
+  for(int j=0; j<(int)valid.size(); j++)
+  {
+    uint64_t offset = valid[j].first;
+    uint64_t end = offset + valid[j].second->getFlashSize();
+
+    while(offset < end)
+    {
+      uint64_t i = (offset - base) / pixel_bytes;
+      uint64_t n = min(end, base + (i + 1) * pixel_bytes) - offset;
+
+      if(i != cur)
+      {
+	setOwner(cur, bytes);
+	cur = i;
+      }
+      bytes[valid[j].second->getInodeNum()] += n;
+      offset += n;
+    }
+  }
+  setOwner(cur, bytes);
+}
+
+/**
+ * The file with the most bytes owns the pixel, the lowest inode on a tie
+ */
+void FlashMap::setOwner(uint64_t pixel, map<uint64_t, uint64_t> &bytes)
+{
+  uint64_t most = 0;
+
+  for(map<uint64_t, uint64_t>::iterator it = bytes.begin(); it != bytes.end(); ++it)
+    if(it->second > most)
+    {
+      most = it->second;
+      _pixels[pixel].owner = it->first;
+    }
+  bytes.clear();
+}
+
+/**
+ * Mean of the state colours weighted by their bytes in the pixel, by file
+ * the valid bytes take the colour of the owner file
+ */
+void FlashMap::getColour(map_pixel_t &p, map_colouring_t colouring, unsigned char *rgb)
+{
+  uint64_t pixel_bytes = (uint64_t)_pages_per_pixel * _geometry.getFlashPageSize();
+  uint64_t covered = 0;
+  uint64_t sum[3] = {0, 0, 0};
+  unsigned char owner_colour[3];
+
+  // a hash of the inode number, away from black
+  uint32_t h = (uint32_t)p.owner * 2654435761U;
+  owner_colour[0] = 64 + (h >> 24) % 192;
+  owner_colour[1] = 64 + (h >> 16) % 192;
+  owner_colour[2] = 64 + (h >> 8) % 192;
+
+  for(int s=0; s<MAP_STATES_NUM; s++)
+  {
+    const unsigned char *c = state_colours[s];
+    if(s == MAP_VALID && colouring == MAP_BY_FILE)
+      c = owner_colour;
+    for(int k=0; k<3; k++)
+      sum[k] += (uint64_t)p.bytes[s] * c[k];
+    covered += p.bytes[s];
+  }
+  if(covered < pixel_bytes)
+    for(int k=0; k<3; k++)
+      sum[k] += (pixel_bytes - covered) * state_colours[MAP_STATES_NUM][k];
+
+  for(int k=0; k<3; k++)
+    rgb[k] = sum[k] / max(pixel_bytes, covered);
+}
@@ -0,0 +1,53 @@
+#ifndef FLASH_MAP_HPP
+#define FLASH_MAP_HPP
+
+#include <iostream>
+#include <vector>
+#include <map>
+
+#include "ChunkModel.hpp"
+#include "File.hpp"
+#include "FlashGeometry.hpp"
+
+#define MAP_DEFAULT_MAX_PIXELS			(1 << 20)
+
+typedef enum {MAP_BY_STATE, MAP_BY_FILE} map_colouring_t;
+
+/**
+ * Occupancy image of a partition, one pixel per group of pages. The group
+ * is the smallest power of two number of pages keeping the image under
+ * max_pixels, so a pixel is a page on small partitions and the memory
+ * stays bounded on large ones : each pixel only accumulates the bytes of
+ * each state and the file owning most of its valid bytes, counted per file
+ * one pixel at a time.
+ */
+class FlashMap
+{
+  public:
+    FlashMap(std::vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry,
+      int max_pixels);
+    int getPagesPerPixel();
+    int getPixelsNum();
+    int writePPM(char *path, map_colouring_t colouring, int width);
+
+  private:
+    typedef enum {MAP_VALID, MAP_OBSOLETE, MAP_FREE, MAP_OTHER, MAP_STATES_NUM} map_state_t;
+
+    typedef struct
+    {
+      uint32_t bytes[MAP_STATES_NUM];
+      uint64_t owner;			// file with the most valid bytes
+    } map_pixel_t;
+
+    FlashGeometry _geometry;
+    uint32_t _first_page;
+    uint32_t _pages_per_pixel;
+    std::vector<map_pixel_t> _pixels;
+
+    void addExtent(uint64_t offset, uint64_t size, map_state_t state);
+    void findOwners(std::vector<std::pair<uint64_t, Node *> > &valid);
+    void setOwner(uint64_t pixel, std::map<uint64_t, uint64_t> &bytes);
+    void getColour(map_pixel_t &p, map_colouring_t colouring, unsigned char *rgb);
+};
+
+#endif /* FLASH_MAP_HPP */
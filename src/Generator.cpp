@@ -0,0 +1,519 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Generator.hpp"
+#include "Extract.hpp"
+
+using namespace std;
+
+#define JFFS2_MAGIC				0x1985
+#define JFFS2_NODETYPE_DIRENT			0xe001
+#define JFFS2_NODETYPE_INODE			0xe002
+#define JFFS2_RAW_INODE_SIZE			68
+#define JFFS2_RAW_DIRENT_SIZE			40
+#define JFFS2_MAX_DATA_SIZE			4096
+#define GEN_MODE_DIR				0040755
+#define GEN_MODE_FILE				0100644
+#define GEN_DT_DIR				4
+#define GEN_DT_REG				8
+#define GEN_MAX_OVERWRITES_PER_PAGE		16	// bounds the log whatever the overwrite ratio
+
+bool initCrc32Table();
+
+static uint32_t crc32_table[256];
+static bool crc32_table_ready = initCrc32Table();
+
+void put16(unsigned char *p, uint32_t v);
+void put32(unsigned char *p, uint32_t v);
+uint32_t align4(uint32_t v);
+
+/**
+ * Parse a comma separated list of <name>=<value> terms, K and M suffixes
+ * accepted for the size :
+ *   files, dirs, size, writers, overwrite, delete, dup, free, seed
+ * compr=none|rtime|zlib, and the raw flag for a raw image. The ratios
+ * must be in [0, 1), at 1 the overwrites would never let the files end.
+ */
+int parseGenParams(char *str, gen_params_t &res)
+{
+  string content = (str == NULL) ? "" : str;
+  size_t start = 0;
+
+  res.files_num = 1000;
+  res.dirs_num = 0;
+  res.mean_file_size = 16384;
+  res.writers_num = 8;
+  res.overwrite_ratio = 0.1;
+  res.delete_ratio = 0.05;
+  res.duplicate_ratio = 0.01;
+  res.free_ratio = 0.1;
+  res.seed = 1;
+  res.raw = false;
+  res.compr = JFFS2_COMPR_NONE;
+
+  while(start <= content.size())
+  {
+    size_t end = content.find(',', start);
+    if(end == string::npos)
+      end = content.size();
+    string term = content.substr(start, end - start);
+    size_t eq = term.find('=');
+    string name = term.substr(0, eq);
+    char *suffix = NULL;
+    double value = 0.0;
+
+    start = end + 1;
+    if(term.empty())
+      continue;
+    if(term == "raw")
+    {
+      res.raw = true;
+      continue;
+    }
+    if(name == "compr" && eq != string::npos)
+    {
+      string compr = term.substr(eq + 1);
+      res.compr = -1;
+      for(int c=JFFS2_COMPR_NONE; c<=JFFS2_COMPR_LZO; c++)
+	if(compr == getComprName(c) && (c == JFFS2_COMPR_NONE || c == JFFS2_COMPR_RTIME ||
+	  c == JFFS2_COMPR_ZLIB))
+	  res.compr = c;
+      if(res.compr < 0)
+      {
+	cerr << "Error, unsupported generator compressor : " << compr << endl;
+	return -1;
+      }
+      continue;
+    }
+
+    if(eq != string::npos)
+    {
+      value = strtod(term.c_str() + eq + 1, &suffix);
+      if(*suffix == 'K' || *suffix == 'k')
+	value *= 1024, suffix++;
+      else if(*suffix == 'M')
+	value *= 1024*1024, suffix++;
+    }
+    if(eq == string::npos || *suffix != '\0' || value < 0)
+    {
+      cerr << "Error, invalid generator term : " << term << endl;
+      return -1;
+    }
+
+    if(name == "files")
+      res.files_num = (int)value;
+    else if(name == "dirs")
+      res.dirs_num = (int)value;
+    else if(name == "size")
+      res.mean_file_size = (uint32_t)value;
+    else if(name == "writers")
+      res.writers_num = max(1, (int)value);
+    else if(name == "overwrite")
+      res.overwrite_ratio = value;
+    else if(name == "delete")
+      res.delete_ratio = value;
+    else if(name == "dup")
+      res.duplicate_ratio = value;
+    else if(name == "free")
+      res.free_ratio = value;
+    else if(name == "seed")
+      res.seed = (unsigned int)value;
+    else
+    {
+      cerr << "Error, unknown generator parameter : " << name << endl;
+      return -1;
+    }
+  }
+
+  if(res.overwrite_ratio >= 1 || res.delete_ratio >= 1 || res.duplicate_ratio >= 1 ||
+    res.free_ratio >= 1)
+  {
+    cerr << "Error, the generator ratios must be in [0, 1)" << endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+/*************************** DumpGenerator ****************************/
+
+DumpGenerator::DumpGenerator(gen_params_t &params, FlashGeometry &geometry)
+{
+  _params = params;
+  _geometry = geometry;
+  _os = NULL;
+  _pos = 0;
+  _rng = params.seed;
+  _nodes_num = _lines_num = 0;
+}
+
+int DumpGenerator::write(ostream &os)
+{
+  vector<gen_file_t> writers;		// files being appended to
+  vector<gen_file_t> files;		// written files, targets of the overwrites
+  int dirs_num = _params.dirs_num;
+  int created_num = 0;
+  uint32_t next_ino;
+  uint64_t end;
+
+  _os = &os;
+  _pos = 0;
+  _rng = _params.seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  _nodes_num = _lines_num = 0;
+
+  if(dirs_num <= 0)
+    dirs_num = max(1, (int)sqrt((double)_params.files_num));
+  _dir_versions.assign(dirs_num + 2, 0);
+
+  for(int i=0; i<dirs_num; i++)
+  {
+    gen_file_t d;
+    char name[32];
+
+    d.ino = i + 2;
+    d.pino = 1;
+    d.size = d.target_size = 0;
+    d.version = 1;
+    d.overwrites_num = 0;
+    writeInode(d, 0, 0);
+    snprintf(name, sizeof(name), "dir%d", i);
+    string s = name;
+    writeDirent(d.pino, d.ino, s);
+  }
+  next_ino = dirs_num + 2;
+
+  while(created_num < _params.files_num || !writers.empty())
+  {
+    int i;
+
+    while((int)writers.size() < _params.writers_num && created_num < _params.files_num)
+    {
+      gen_file_t f;
+      char name[32];
+
+      f.ino = next_ino++;
+      f.pino = 2 + random() % dirs_num;
+      f.size = 0;
+      f.target_size = (uint32_t)(-log(1.0 - uniform()) * _params.mean_file_size);
+      f.version = 1;
+      f.overwrites_num = 0;
+      writeInode(f, 0, 0);
+      snprintf(name, sizeof(name), "f%u", f.ino);
+      string s = name;
+      writeDirent(f.pino, f.ino, s);
+      writers.push_back(f);
+      created_num++;
+    }
+
+    if(!files.empty() && uniform() < _params.overwrite_ratio)
+    {
+      i = random() % files.size();
+      if(files[i].size > 0)
+	writeData(files[i], true);
+      // a file overwritten enough times, or empty, is no longer a target
+      if(files[i].overwrites_num >= GEN_MAX_OVERWRITES_PER_PAGE *
+	((files[i].size + JFFS2_MAX_DATA_SIZE - 1) / JFFS2_MAX_DATA_SIZE))
+      {
+	files[i] = files.back();
+	files.pop_back();
+      }
+      continue;
+    }
+    if(writers.empty())
+      continue;
+
+    i = random() % writers.size();
+    if(writers[i].size < writers[i].target_size)
+    {
+      writeData(writers[i], false);
+      continue;
+    }
+
+    // a written file is either deleted or kept for the overwrites
+    if(uniform() < _params.delete_ratio)
+    {
+      char name[32];
+      snprintf(name, sizeof(name), "f%u", writers[i].ino);
+      string s = name;
+      writeDirent(writers[i].pino, 0, s);
+    }
+    else
+      files.push_back(writers[i]);
+    writers[i] = writers.back();
+    writers.pop_back();
+  }
+
+  end = _pos + (uint64_t)(_pos * _params.free_ratio);
+  end = ((end + _geometry.getBlockSize() - 1) / _geometry.getBlockSize()) * _geometry.getBlockSize();
+  writeFreeSpace(_pos, end);
+  _pos = end;
+
+  if(!os)
+  {
+    cerr << "Error writing the generated dump" << endl;
+    return -1;
+  }
+  return 0;
+}
+
+uint64_t DumpGenerator::getNodesNum()
+{
+  return _nodes_num;
+}
+
+uint64_t DumpGenerator::getLinesNum()
+{
+  return _lines_num;
+}
+
+uint64_t DumpGenerator::getSize()
+{
+  return _pos;
+}
+
+/**
+ * 64 bits LCG, the same dump for the same seed everywhere
+ */
+uint64_t DumpGenerator::random()
+{
+  _rng = _rng * 6364136223846793005ULL + 1442695040888963407ULL;
+  return _rng >> 33;
+}
+
+double DumpGenerator::uniform()
+{
+  return (double)random() / (double)(1ULL << 31);
+}
+
+/**
+ * Offset of a node of totlen bytes, nodes don't cross erase blocks
+ */
+uint64_t DumpGenerator::placeNode(uint32_t totlen)
+{
+  uint64_t block_size = _geometry.getBlockSize();
+  uint64_t next_block = (_pos / block_size + 1) * block_size;
+
+  if(_pos + align4(totlen) > next_block)
+  {
+    writeFreeSpace(_pos, next_block);
+    _pos = next_block;
+  }
+  return _pos;
+}
+
+void DumpGenerator::writeFreeSpace(uint64_t from, uint64_t to)
+{
+  if(to <= from)
+    return;
+
+  if(!_params.raw)
+  {
+    char line[128];
+    snprintf(line, sizeof(line), "Empty space found from 0x%08llx to 0x%08llx\n",
+      (unsigned long long)from, (unsigned long long)to);
+    *_os << line;
+    _lines_num++;
+    return;
+  }
+
+  _buf.assign(JFFS2_MAX_DATA_SIZE, 0xff);
+  while(from < to)
+  {
+    uint64_t n = min(to - from, (uint64_t)_buf.size());
+    _os->write((char *)&_buf[0], n);
+    from += n;
+  }
+}
+
+/**
+ * Inode node of version f.version holding [offset, offset + dsize)
+ */
+void DumpGenerator::writeInode(gen_file_t &f, uint32_t offset, uint32_t dsize)
+{
+  unsigned char *payload = NULL;
+  uint32_t csize = dsize, totlen;
+  int compr = JFFS2_COMPR_NONE;
+  uint64_t pos;
+
+  // the text needs the compressed size too
+  if(dsize > 0 && (_params.raw || _params.compr != JFFS2_COMPR_NONE))
+  {
+    _data.resize(dsize);
+    for(uint32_t i=0; i<dsize; i++)
+      _data[i] = (unsigned char)(f.ino * 31 + offset + i);
+    payload = &_data[0];
+    if(_params.compr != JFFS2_COMPR_NONE && compressNode(_params.compr, payload, dsize, _cdata) == 0)
+    {
+      compr = _params.compr;
+      csize = _cdata.size();
+      payload = &_cdata[0];
+    }
+  }
+  totlen = JFFS2_RAW_INODE_SIZE + csize;
+  pos = placeNode(totlen);
+
+  if(!_params.raw)
+  {
+    char line[256];
+    snprintf(line, sizeof(line), "         Inode      node at 0x%08llx, totlen 0x%08x, #ino %6u, "
+      "version %5u, isize %8u, csize %8u, dsize %8u, offset %8u\n", (unsigned long long)pos,
+      totlen, f.ino, f.version, f.size, csize, dsize, offset);
+    *_os << line;
+    _lines_num++;
+  }
+  else
+  {
+    unsigned char *p;
+
+    _buf.assign(align4(totlen), 0xff);
+    p = &_buf[0];
+    put16(p, JFFS2_MAGIC);
+    put16(p+2, JFFS2_NODETYPE_INODE);
+    put32(p+4, totlen);
+    put32(p+8, jffs2Crc32(0, p, 8));
+    put32(p+12, f.ino);
+    put32(p+16, f.version);
+    put32(p+20, (f.ino < _dir_versions.size()) ? GEN_MODE_DIR : GEN_MODE_FILE);
+    put16(p+24, 0);
+    put16(p+26, 0);
+    put32(p+28, f.size);
+    put32(p+32, 0);
+    put32(p+36, 0);
+    put32(p+40, 0);
+    put32(p+44, offset);
+    put32(p+48, csize);
+    put32(p+52, dsize);
+    p[56] = compr;
+    p[57] = 0;
+    put16(p+58, 0);
+    if(csize > 0)
+      memcpy(p + JFFS2_RAW_INODE_SIZE, payload, csize);
+    put32(p+60, jffs2Crc32(0, p + JFFS2_RAW_INODE_SIZE, csize));
+    put32(p+64, jffs2Crc32(0, p, 60));
+    _os->write((char *)p, _buf.size());
+  }
+
+  _pos = pos + align4(totlen);
+  _nodes_num++;
+}
+
+/**
+ * Dirent of name in pino, to ino or a deletion if ino is 0. Dirent
+ * versions follow the version sequence of the parent directory.
+ */
+void DumpGenerator::writeDirent(uint32_t pino, uint32_t ino, string &name)
+{
+  uint32_t totlen = JFFS2_RAW_DIRENT_SIZE + name.size();
+  uint32_t version = ++_dir_versions[(pino < _dir_versions.size()) ? pino : 1];
+  uint64_t pos = placeNode(totlen);
+
+  if(!_params.raw)
+  {
+    char line[256];
+    snprintf(line, sizeof(line), "         Dirent     node at 0x%08llx, totlen 0x%08x, #pino %5u, "
+      "version %5u, #ino %9u, nsize %8u, name %s\n", (unsigned long long)pos, totlen, pino,
+      version, ino, (unsigned int)name.size(), name.c_str());
+    *_os << line;
+    _lines_num++;
+  }
+  else
+  {
+    unsigned char *p;
+
+    _buf.assign(align4(totlen), 0xff);
+    p = &_buf[0];
+    put16(p, JFFS2_MAGIC);
+    put16(p+2, JFFS2_NODETYPE_DIRENT);
+    put32(p+4, totlen);
+    put32(p+8, jffs2Crc32(0, p, 8));
+    put32(p+12, pino);
+    put32(p+16, version);
+    put32(p+20, ino);
+    put32(p+24, 0);
+    p[28] = name.size();
+    p[29] = (ino == 0) ? 0 : ((ino < _dir_versions.size()) ? GEN_DT_DIR : GEN_DT_REG);
+    p[30] = p[31] = 0;
+    put32(p+32, jffs2Crc32(0, p, 32));
+    memcpy(p + JFFS2_RAW_DIRENT_SIZE, name.data(), name.size());
+    put32(p+36, jffs2Crc32(0, p + JFFS2_RAW_DIRENT_SIZE, name.size()));
+    _os->write((char *)p, _buf.size());
+  }
+
+  _pos = pos + align4(totlen);
+  _nodes_num++;
+}
+
+/**
+ * Append up to the end of the current linux page, or rewrite a random
+ * page of the file. The node is sometimes listed twice.
+ */
+void DumpGenerator::writeData(gen_file_t &f, bool overwrite)
+{
+  uint32_t offset, dsize;
+
+  if(overwrite)
+  {
+    uint32_t pages_num = (f.size + JFFS2_MAX_DATA_SIZE - 1) / JFFS2_MAX_DATA_SIZE;
+    offset = (random() % pages_num) * JFFS2_MAX_DATA_SIZE;
+    dsize = min((uint32_t)JFFS2_MAX_DATA_SIZE, f.size - offset);
+    f.overwrites_num++;
+  }
+  else
+  {
+    offset = f.size;
+    dsize = min(JFFS2_MAX_DATA_SIZE - offset % JFFS2_MAX_DATA_SIZE, f.target_size - f.size);
+    f.size += dsize;
+  }
+
+  f.version++;
+  writeInode(f, offset, dsize);
+  if(uniform() < _params.duplicate_ratio)
+    writeInode(f, offset, dsize);
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * CRC32 as computed by JFFS2 : reflected 0xedb88320 polynomial, no
+ * inversion, 0 as initial value
+ */
+uint32_t jffs2Crc32(uint32_t crc, const unsigned char *buf, size_t len)
+{
+  for(size_t i=0; i<len; i++)
+    crc = crc32_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+/**
+ * Filled before main, the table is then only read, from any thread
+ */
+bool initCrc32Table()
+{
+  for(uint32_t i=0; i<256; i++)
+  {
+    uint32_t c = i;
+    for(int k=0; k<8; k++)
+      c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+    crc32_table[i] = c;
+  }
+  return true;
+}
+
+void put16(unsigned char *p, uint32_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+}
+
+void put32(unsigned char *p, uint32_t v)
+{
+  put16(p, v & 0xffff);
+  put16(p+2, v >> 16);
+}
+
+uint32_t align4(uint32_t v)
+{
+  return (v + 3) & ~3U;
+}
@@ -0,0 +1,83 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "FlashGeometry.hpp"
+
+/**
+ * Parameters of a synthetic dump, see parseGenParams
+ */
+typedef struct
+{
+  int files_num;
+  int dirs_num;				// 0 for about sqrt(files_num)
+  uint32_t mean_file_size;		// file sizes are exponentially distributed
+  int writers_num;			// files appended to concurrently
+  double overwrite_ratio;		// share of the writes rewriting existing data, below 1
+  double delete_ratio;			// share of the files deleted once written
+  double duplicate_ratio;		// share of the data nodes listed twice
+  double free_ratio;			// free space left after the log, share of it
+  unsigned int seed;
+  bool raw;				// raw JFFS2 image instead of jffs2dump text
+  int compr;				// compressor of the data, JFFS2_COMPR_NONE, RTIME or ZLIB
+} gen_params_t;
+
+int parseGenParams(char *str, gen_params_t &res);
+
+/**
+ * Writes a synthetic partition as a flash log : directories, then files
+ * created and appended to by several writers at once, random overwrites
+ * of existing pages, a bounded number per page, deletions and duplicated
+ * data nodes as jffs2dump sometimes reports them. Either the jffs2dump
+ * text or a raw image readable by the JFFS2 tools is written, with the
+ * data compressed as the kernel would by the chosen compressor, when it
+ * makes it smaller. Only a few integers per inode are kept, so millions
+ * of inodes can be generated.
+ */
+class DumpGenerator
+{
+  public:
+    DumpGenerator(gen_params_t &params, FlashGeometry &geometry);
+    int write(std::ostream &os);
+    uint64_t getNodesNum();
+    uint64_t getLinesNum();
+    uint64_t getSize();
+
+  private:
+    typedef struct
+    {
+      uint32_t ino;
+      uint32_t pino;
+      uint32_t size;
+      uint32_t target_size;
+      uint32_t version;
+      uint32_t overwrites_num;
+    } gen_file_t;
+
+    gen_params_t _params;
+    FlashGeometry _geometry;
+    std::ostream *_os;
+    uint64_t _pos;			// next free byte of the log
+    uint64_t _rng;
+    uint64_t _nodes_num;
+    uint64_t _lines_num;
+    std::vector<uint32_t> _dir_versions;	// last dirent version per directory
+    std::vector<unsigned char> _buf;
+    std::vector<unsigned char> _data;	// payload of the node being written
+    std::vector<unsigned char> _cdata;	// compressed payload
+
+    uint64_t random();
+    double uniform();
+    uint64_t placeNode(uint32_t totlen);
+    void writeFreeSpace(uint64_t from, uint64_t to);
+    void writeInode(gen_file_t &f, uint32_t offset, uint32_t dsize);
+    void writeDirent(uint32_t pino, uint32_t ino, std::string &name);
+    void writeData(gen_file_t &f, bool overwrite);
+};
+
+uint32_t jffs2Crc32(uint32_t crc, const unsigned char *buf, size_t len);
+
+#endif /* GENERATOR_HPP */
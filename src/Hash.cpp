@@ -0,0 +1,21 @@
+#include "Hash.hpp"
+
+/****************************** Tools *********************************/
+
+/**
+ * Fibonacci hashing, consecutive inode numbers are spread over the whole
+ * range, the high bits being the best mixed
+ */
+uint64_t hashInode(uint64_t inode_num)
+{
+  return inode_num * 0x9E3779B97F4A7C15ULL;
+}
+
+/**
+ * Bucket of an inode among buckets_num, as used for the shards of the
+ * FileSet and the buckets of the external filemap
+ */
+int getInodeBucket(uint64_t inode_num, int buckets_num)
+{
+  return (hashInode(inode_num) >> 32) % buckets_num;
+}
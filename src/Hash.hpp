@@ -0,0 +1,9 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <stdint.h>
+
+uint64_t hashInode(uint64_t inode_num);
+int getInodeBucket(uint64_t inode_num, int buckets_num);
+
+#endif /* HASH_HPP */
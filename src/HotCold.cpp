@@ -0,0 +1,295 @@
+#include <iomanip>
+#include <climits>
+#include <set>
+
+#include "HotCold.hpp"
+#include "Summary.hpp"
+
+using namespace std;
+
+/************************** HotColdReport *****************************/
+
+HotColdReport::HotColdReport(vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry,
+  double hot_age) : _geometry(geometry)
+{
+  _hot_age = hot_age;
+  _first_block = _head_block = 0;
+  _hot_files_num = _cold_files_num = 0;
+
+  if(find_blocks(chunk_list) < 0)
+    return;
+  classify(chunk_list, fs);
+}
+
+/**
+ * The blocks covered by the nodes of the dump, and the one being
+ * written : the block holding the most nodes that are the newest version
+ * of their inode, looked for first among the blocks with free space
+ * after their nodes. The other blocks are taken as written before
+ * it in flash order, wrapping around the partition.
+ */
+int HotColdReport::find_blocks(vector<Chunk *> &chunk_list)
+{
+  map<uint64_t, uint32_t> newest;
+  vector<int> newest_nodes, partial;
+  uint32_t last_block = 0;
+  int best = -1;
+
+  _first_block = UINT_MAX;
+  for(int i=0; i<(int)chunk_list.size(); i++)
+    if(chunk_list[i]->getType() == DATA_NODE || chunk_list[i]->getType() == DIRENT_NODE)
+    {
+      Node *n = static_cast<Node *>(chunk_list[i]);
+      uint32_t block = n->getFlashAddr().getFlashBlock();
+
+      _first_block = min(_first_block, block);
+      last_block = max(last_block, block);
+      if(n->getType() == DATA_NODE)
+      {
+	uint32_t &v = newest[n->getInodeNum()];
+	v = max(v, n->getVersionNum());
+      }
+    }
+  if(_first_block > last_block)
+    return -1;
+
+  _blocks.resize(last_block - _first_block + 1);
+  newest_nodes.assign(_blocks.size(), 0);
+  partial.assign(_blocks.size(), 0);
+  for(int i=0; i<(int)_blocks.size(); i++)
+  {
+    block_temp_t &b = _blocks[i];
+    b.block = _first_block + i;
+    b.log_age = 0.0;
+    b.hot_bytes = b.cold_bytes = b.obsolete_bytes = 0;
+  }
+
+  for(int i=0; i<(int)chunk_list.size(); i++)
+    if(chunk_list[i]->getType() == DATA_NODE)
+    {
+      Node *n = static_cast<Node *>(chunk_list[i]);
+      if(n->getVersionNum() == newest[n->getInodeNum()])
+	newest_nodes[n->getFlashAddr().getFlashBlock() - _first_block]++;
+    }
+    else if(chunk_list[i]->getType() == FREE_SPACE)
+    {
+      FreeSpaceChunk *fsc = static_cast<FreeSpaceChunk *>(chunk_list[i]);
+      uint32_t block = fsc->getStart().getFlashBlock();
+      if(fsc->getSize() != 0 && !fsc->getStart().isStartOfABlock() && getBlock(block) != NULL)
+	partial[block - _first_block] = 1;
+    }
+
+  for(int pass=0; pass<2 && best < 0; pass++)
+    for(int i=0; i<(int)_blocks.size(); i++)
+      if((pass == 1 || partial[i]) && newest_nodes[i] > 0 &&
+	(best < 0 || newest_nodes[i] > newest_nodes[best]))
+	best = i;
+  best = max(best, 0);
+  _head_block = _first_block + best;
+
+  for(int i=0; i<(int)_blocks.size(); i++)
+    _blocks[i].log_age = (double)((best - i + _blocks.size()) % _blocks.size()) / _blocks.size();
+
+  return 0;
+}
+
+/**
+ * Linux pages of the file covered by a data node, one for an empty node
+ */
+void getNodePages(DataNode *dn, uint32_t &first, uint32_t &last)
+{
+  first = dn->getDataOffset() / LINUX_PAGE_SIZE;
+  last = first;
+  if(dn->getDataSize() > 0)
+    last = (dn->getDataOffset() + dn->getDataSize() - 1) / LINUX_PAGE_SIZE;
+}
+
+/**
+ * The valid dirents are counted as cold, names are seldom rewritten
+ */
+int HotColdReport::classify(vector<Chunk *> &chunk_list, FileSet &fs)
+{
+  map<pair<uint64_t, uint32_t>, int> page_writes;	// data nodes written to each page
+  map<uint64_t, int> nodes_nums;		// data nodes of each inode
+  set<Node *> valid_nodes;
+
+  for(int i=0; i<(int)chunk_list.size(); i++)
+    if(chunk_list[i]->getType() == DATA_NODE)
+    {
+      DataNode *dn = static_cast<DataNode *>(chunk_list[i]);
+      uint32_t first, last;
+
+      getNodePages(dn, first, last);
+      for(uint32_t p=first; p<=last; p++)
+	page_writes[make_pair(dn->getInodeNum(), p)]++;
+      nodes_nums[dn->getInodeNum()]++;
+    }
+
+  for(int i=0; i<fs.getFilesNum(); i++)
+  {
+    File *f = fs.getFile(i);
+    vector<DataNode *> &valid = f->getValidDataNodes();
+    uint64_t hot = 0, cold = 0;
+
+    if(f->getInodeNum() == 1 || f->isDeleted())
+      continue;
+
+    valid_nodes.insert(f->getValidDirentNode());
+    getBlock(f->getValidDirentNode()->getFlashAddr().getFlashBlock())->cold_bytes +=
+      f->getValidDirentNode()->getFlashSize();
+    if(valid.empty())
+      continue;
+
+    for(int j=0; j<(int)valid.size(); j++)
+    {
+      block_temp_t *b = getBlock(valid[j]->getFlashAddr().getFlashBlock());
+      uint32_t first, last;
+      int rewrites = 0;
+
+      getNodePages(valid[j], first, last);
+      for(uint32_t p=first; p<=last; p++)
+	rewrites = max(rewrites, page_writes[make_pair(f->getInodeNum(), p)] - 1);
+      double age = (1.0 / (1 + rewrites) + b->log_age) / 2;
+
+      valid_nodes.insert(valid[j]);
+      _node_ages.push_back(age);
+      if(age < _hot_age)
+      {
+	b->hot_bytes += valid[j]->getFlashSize();
+	hot += valid[j]->getFlashSize();
+      }
+      else
+      {
+	b->cold_bytes += valid[j]->getFlashSize();
+	cold += valid[j]->getFlashSize();
+      }
+    }
+
+    _file_hot_shares.push_back((double)hot / (hot + cold));
+    _file_rewrites.push_back((double)nodes_nums[f->getInodeNum()] / valid.size());
+    if(hot > cold)
+      _hot_files_num++;
+    else
+      _cold_files_num++;
+  }
+
+  for(int i=0; i<(int)chunk_list.size(); i++)
+    if(chunk_list[i]->getType() == DATA_NODE || chunk_list[i]->getType() == DIRENT_NODE)
+    {
+      Node *n = static_cast<Node *>(chunk_list[i]);
+      if(valid_nodes.find(n) == valid_nodes.end())
+	getBlock(n->getFlashAddr().getFlashBlock())->obsolete_bytes += n->getFlashSize();
+    }
+
+  return 0;
+}
+
+block_temp_t * HotColdReport::getBlock(uint32_t block)
+{
+  if(_blocks.empty() || block < _blocks[0].block || block > _blocks.back().block)
+    return NULL;
+  return &(_blocks[block - _blocks[0].block]);
+}
+
+uint64_t HotColdReport::getHotBytes()
+{
+  uint64_t res = 0;
+
+  for(int i=0; i<(int)_blocks.size(); i++)
+    res += _blocks[i].hot_bytes;
+  return res;
+}
+
+uint64_t HotColdReport::getColdBytes()
+{
+  uint64_t res = 0;
+
+  for(int i=0; i<(int)_blocks.size(); i++)
+    res += _blocks[i].cold_bytes;
+  return res;
+}
+
+/**
+ * Cold data sharing a block with hot data
+ */
+uint64_t HotColdReport::getMixedColdBytes()
+{
+  uint64_t res = 0;
+
+  for(int i=0; i<(int)_blocks.size(); i++)
+    if(_blocks[i].hot_bytes > 0)
+      res += _blocks[i].cold_bytes;
+  return res;
+}
+
+/**
+ * Valid bytes copied by reclaiming every block holding obsolete data or
+ * hot data, which becomes obsolete soon
+ */
+uint64_t HotColdReport::getGCCopyBytes()
+{
+  uint64_t res = 0;
+
+  for(int i=0; i<(int)_blocks.size(); i++)
+    if(_blocks[i].obsolete_bytes > 0 || _blocks[i].hot_bytes > 0)
+      res += _blocks[i].hot_bytes + _blocks[i].cold_bytes;
+  return res;
+}
+
+/**
+ * Same with the cold data in blocks of their own, that GC leaves alone
+ */
+uint64_t HotColdReport::getSeparatedGCCopyBytes()
+{
+  uint64_t res = 0;
+
+  for(int i=0; i<(int)_blocks.size(); i++)
+    if(_blocks[i].obsolete_bytes > 0 || _blocks[i].hot_bytes > 0)
+      res += _blocks[i].hot_bytes;
+  return res;
+}
+
+vector<block_temp_t> & HotColdReport::getBlocks()
+{
+  return _blocks;
+}
+
+ostream& operator<<(ostream& os, HotColdReport& hc)
+{
+  double age_bounds[] = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9};
+  double share_bounds[] = {0.01, 0.25, 0.5, 0.75, 0.99};
+  double rewrite_bounds[] = {1.01, 1.5, 2, 4, 8, 16};
+  uint64_t hot = hc.getHotBytes(), cold = hc.getColdBytes();
+  uint64_t gc_copy = hc.getGCCopyBytes(), separated = hc.getSeparatedGCCopyBytes();
+  int mixed_blocks = 0;
+
+  os << "Hot/cold data over " << hc._blocks.size() << " blocks, head block " << hc._head_block
+    << ", hot under write age " << hc._hot_age << " :" << endl;
+  os << "     block  log age   hot bytes  cold bytes  obsolete bytes" << endl;
+  for(int i=0; i<(int)hc._blocks.size(); i++)
+  {
+    block_temp_t &b = hc._blocks[i];
+    if(b.hot_bytes == 0 || b.cold_bytes == 0)
+      continue;
+    mixed_blocks++;
+    os << "  " << setw(8) << b.block << setw(9) << fixed << setprecision(2) << b.log_age
+      << setw(12) << b.hot_bytes << setw(12) << b.cold_bytes << setw(16) << b.obsolete_bytes
+      << endl;
+  }
+  os.unsetf(ios::fixed);
+  os << setprecision(6);
+
+  os << "Files : " << hc._hot_files_num << " hot, " << hc._cold_files_num << " cold" << endl;
+  os << "Valid bytes : " << hot << " hot, " << cold << " cold" << endl;
+  os << "Mixed blocks : " << mixed_blocks << ", holding " << hc.getMixedColdBytes()
+    << " cold bytes" << endl;
+  os << "GC copy per pass : " << gc_copy << " bytes, " << separated
+    << " with hot/cold separation (" << gc_copy - separated << " saved, "
+    << ((gc_copy) ? 100.0 * (gc_copy - separated) / gc_copy : 0.0) << "%)" << endl;
+
+  printHistogram(os, "Node write ages", hc._node_ages, age_bounds, 9);
+  printHistogram(os, "Hot share of the files", hc._file_hot_shares, share_bounds, 5);
+  printHistogram(os, "Data nodes written per valid one", hc._file_rewrites, rewrite_bounds, 6);
+
+  return os;
+}
@@ -0,0 +1,69 @@
+#ifndef HOT_COLD_HPP
+#define HOT_COLD_HPP
+
+#include <iostream>
+#include <vector>
+#include <map>
+
+#include "ChunkModel.hpp"
+#include "File.hpp"
+
+// write age under which data is hot : at 0.5 data written once is cold, data
+// rewritten r times is hot in the blocks of log age under r / (r + 1)
+#define HOTCOLD_DEFAULT_AGE			0.5
+
+/**
+ * Valid data of one erase block by temperature, in flash bytes
+ */
+typedef struct
+{
+  uint32_t block;
+  double log_age;			// 0 for the block being written, near 1 for the oldest
+  uint64_t hot_bytes;
+  uint64_t cold_bytes;			// valid dirents included
+  uint64_t obsolete_bytes;
+} block_temp_t;
+
+/**
+ * Hot/cold classification of the valid data. The log is written forward
+ * through the blocks, so each valid data node gets a write age in
+ * (0, 1) : the mean of its version age, 1 / (1 + r) where r is the most
+ * times one of its linux pages was rewritten, obsolete nodes included,
+ * and of its log age, how far its block is behind the block being
+ * written. Data never rewritten is thus never younger than 0.5. The
+ * nodes younger than the threshold are hot, the others cold. GC
+ * reclaims the blocks holding obsolete or hot data and copies their
+ * valid nodes : the cold ones in those blocks are the copies that
+ * writing hot and cold data to separate blocks would save.
+ */
+class HotColdReport
+{
+  public:
+    HotColdReport(std::vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry,
+      double hot_age);
+    uint64_t getHotBytes();
+    uint64_t getColdBytes();
+    uint64_t getMixedColdBytes();
+    uint64_t getGCCopyBytes();
+    uint64_t getSeparatedGCCopyBytes();
+    std::vector<block_temp_t> &getBlocks();
+
+  private:
+    std::vector<block_temp_t> _blocks;		// every block covered by the dump
+    FlashGeometry _geometry;
+    double _hot_age;
+    uint32_t _first_block;
+    uint32_t _head_block;			// block being written
+    std::vector<double> _node_ages;
+    std::vector<double> _file_hot_shares;	// hot share of the valid data of each live file
+    std::vector<double> _file_rewrites;	// data nodes written per valid one
+    int _hot_files_num, _cold_files_num;
+
+    block_temp_t *getBlock(uint32_t block);
+    int find_blocks(std::vector<Chunk *> &chunk_list);
+    int classify(std::vector<Chunk *> &chunk_list, FileSet &fs);
+
+  friend std::ostream& operator<<(std::ostream& os, HotColdReport& hc);
+};
+
+#endif /* HOT_COLD_HPP */
@@ -0,0 +1,451 @@
+#include <fstream>
+#include <cstring>
+#include <stdint.h>
+#include <zlib.h>
+#include <lzma.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "Input.hpp"
+
+using namespace std;
+
+/************************* DecompressingBuf ***************************/
+
+DecompressingBuf::DecompressingBuf(istream *src, bool owns_src, input_format_t format)
+{
+  _src = src;
+  _owns_src = owns_src;
+  _format = format;
+  _buffers.assign(INPUT_RING_BUFFERS_NUM, vector<char>(INPUT_RING_BUFFER_SIZE));
+  _lengths.assign(INPUT_RING_BUFFERS_NUM, 0);
+  _head = _full_num = 0;
+  _reading = _done = _stop = _error = false;
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_not_empty, NULL);
+  pthread_cond_init(&_not_full, NULL);
+
+  _started = (pthread_create(&_thread, NULL, decompressor, this) == 0);
+  if(!_started)
+  {
+    cerr << "Error creating the decompression thread" << endl;
+    _done = _error = true;
+  }
+}
+
+/**
+ * The thread may still be decompressing if the reader stopped early
+ */
+DecompressingBuf::~DecompressingBuf()
+{
+  pthread_mutex_lock(&_lock);
+  _stop = true;
+  pthread_cond_broadcast(&_not_full);
+  pthread_mutex_unlock(&_lock);
+
+  if(_started)
+    pthread_join(_thread, NULL);
+  pthread_cond_destroy(&_not_full);
+  pthread_cond_destroy(&_not_empty);
+  pthread_mutex_destroy(&_lock);
+  if(_owns_src)
+    delete _src;
+}
+
+/**
+ * A corrupted or truncated source, to be checked at the end of the text
+ */
+bool DecompressingBuf::failed()
+{
+  bool res;
+
+  pthread_mutex_lock(&_lock);
+  res = _error;
+  pthread_mutex_unlock(&_lock);
+  return res;
+}
+
+/**
+ * Give back the buffer just read and wait for the next one
+ */
+int DecompressingBuf::underflow()
+{
+  char *buf;
+  size_t len;
+
+  if(gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  pthread_mutex_lock(&_lock);
+  if(_reading)
+  {
+    _head = (_head + 1) % INPUT_RING_BUFFERS_NUM;
+    _full_num--;
+    _reading = false;
+    pthread_cond_signal(&_not_full);
+  }
+  while(_full_num == 0 && !_done)
+    pthread_cond_wait(&_not_empty, &_lock);
+  if(_full_num == 0)
+  {
+    pthread_mutex_unlock(&_lock);
+    setg(NULL, NULL, NULL);
+    return traits_type::eof();
+  }
+  _reading = true;
+  buf = &_buffers[_head][0];
+  len = _lengths[_head];
+  pthread_mutex_unlock(&_lock);
+
+  setg(buf, buf, buf + len);
+  return traits_type::to_int_type(*buf);
+}
+
+/**
+ * The buffer after the full ones, NULL once the reader is gone
+ */
+char *DecompressingBuf::acquireBuffer()
+{
+  char *res = NULL;
+
+  pthread_mutex_lock(&_lock);
+  while(_full_num == INPUT_RING_BUFFERS_NUM && !_stop)
+    pthread_cond_wait(&_not_full, &_lock);
+  if(!_stop)
+    res = &_buffers[(_head + _full_num) % INPUT_RING_BUFFERS_NUM][0];
+  pthread_mutex_unlock(&_lock);
+
+  return res;
+}
+
+void DecompressingBuf::publishBuffer(size_t len)
+{
+  if(len == 0)
+    return;
+
+  pthread_mutex_lock(&_lock);
+  _lengths[(_head + _full_num) % INPUT_RING_BUFFERS_NUM] = len;
+  _full_num++;
+  pthread_cond_signal(&_not_empty);
+  pthread_mutex_unlock(&_lock);
+}
+
+/**
+ * gzip, concatenated members included, or zlib. As for the other
+ * formats, more input is only read once the decoder stopped filling its
+ * output, so that nothing it holds is lost at the end of the source.
+ */
+int DecompressingBuf::inflateAll()
+{
+  vector<char> in(INPUT_READ_SIZE);
+  bool out_full = false, ended = false;
+  z_stream z;
+  char *out;
+  int ret;
+
+  memset(&z, 0, sizeof(z));
+  if(inflateInit2(&z, MAX_WBITS + 32) != Z_OK)
+    return -1;
+  if((out = acquireBuffer()) == NULL)
+  {
+    inflateEnd(&z);
+    return 0;
+  }
+  z.next_out = (Bytef *)out;
+  z.avail_out = INPUT_RING_BUFFER_SIZE;
+
+  while(true)
+  {
+    if(z.avail_in == 0 && !out_full)
+    {
+      _src->read(&in[0], in.size());
+      if(_src->gcount() == 0)
+	break;
+      z.next_in = (Bytef *)&in[0];
+      z.avail_in = _src->gcount();
+    }
+
+    ret = inflate(&z, Z_NO_FLUSH);
+    if(ret == Z_STREAM_END)
+    {
+      ended = true;
+      inflateReset(&z);
+    }
+    else if(ret == Z_OK)
+      ended = false;
+    else if(ret != Z_BUF_ERROR)
+    {
+      cerr << "Error decompressing the dump : " << ((z.msg != NULL) ? z.msg : "corrupted gzip")
+	<< endl;
+      inflateEnd(&z);
+      return -1;
+    }
+
+    out_full = (z.avail_out == 0);
+    if(out_full)
+    {
+      publishBuffer(INPUT_RING_BUFFER_SIZE);
+      if((out = acquireBuffer()) == NULL)
+      {
+	inflateEnd(&z);
+	return 0;
+      }
+      z.next_out = (Bytef *)out;
+      z.avail_out = INPUT_RING_BUFFER_SIZE;
+    }
+  }
+  publishBuffer(INPUT_RING_BUFFER_SIZE - z.avail_out);
+  inflateEnd(&z);
+
+  if(!ended)
+  {
+    cerr << "Error decompressing the dump : truncated gzip" << endl;
+    return -1;
+  }
+  return 0;
+}
+
+int DecompressingBuf::unxzAll()
+{
+  vector<char> in(INPUT_READ_SIZE);
+  lzma_stream s = LZMA_STREAM_INIT;
+  lzma_action action = LZMA_RUN;
+  lzma_ret ret;
+  bool out_full = false;
+  char *out;
+
+  if(lzma_stream_decoder(&s, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+    return -1;
+  if((out = acquireBuffer()) == NULL)
+  {
+    lzma_end(&s);
+    return 0;
+  }
+  s.next_out = (uint8_t *)out;
+  s.avail_out = INPUT_RING_BUFFER_SIZE;
+
+  while(true)
+  {
+    if(s.avail_in == 0 && !out_full && action == LZMA_RUN)
+    {
+      _src->read(&in[0], in.size());
+      if(_src->gcount() == 0)
+	action = LZMA_FINISH;
+      s.next_in = (uint8_t *)&in[0];
+      s.avail_in = _src->gcount();
+    }
+
+    ret = lzma_code(&s, action);
+    if(ret == LZMA_STREAM_END)
+      break;
+    if(ret != LZMA_OK)
+    {
+      cerr << "Error decompressing the dump : " << ((ret == LZMA_BUF_ERROR) ? "truncated xz" :
+	"corrupted xz") << endl;
+      lzma_end(&s);
+      return -1;
+    }
+
+    out_full = (s.avail_out == 0);
+    if(out_full)
+    {
+      publishBuffer(INPUT_RING_BUFFER_SIZE);
+      if((out = acquireBuffer()) == NULL)
+      {
+	lzma_end(&s);
+	return 0;
+      }
+      s.next_out = (uint8_t *)out;
+      s.avail_out = INPUT_RING_BUFFER_SIZE;
+    }
+  }
+  publishBuffer(INPUT_RING_BUFFER_SIZE - s.avail_out);
+  lzma_end(&s);
+
+  return 0;
+}
+
+/**
+ * Needs libzstd at build time, see the Makefile
+ */
+int DecompressingBuf::unzstdAll()
+{
+#ifdef HAVE_ZSTD
+  vector<char> in(INPUT_READ_SIZE);
+  ZSTD_DStream *ds = ZSTD_createDStream();
+  ZSTD_inBuffer zin;
+  ZSTD_outBuffer zout;
+  bool out_full = false;
+  size_t ret = 0;
+  char *out;
+
+  if(ds == NULL || ZSTD_isError(ZSTD_initDStream(ds)))
+  {
+    ZSTD_freeDStream(ds);
+    return -1;
+  }
+  if((out = acquireBuffer()) == NULL)
+  {
+    ZSTD_freeDStream(ds);
+    return 0;
+  }
+  zin.src = &in[0];
+  zin.size = zin.pos = 0;
+  zout.dst = out;
+  zout.size = INPUT_RING_BUFFER_SIZE;
+  zout.pos = 0;
+
+  while(true)
+  {
+    if(zin.pos == zin.size && !out_full)
+    {
+      _src->read(&in[0], in.size());
+      if(_src->gcount() == 0)
+	break;
+      zin.size = _src->gcount();
+      zin.pos = 0;
+    }
+
+    ret = ZSTD_decompressStream(ds, &zout, &zin);
+    if(ZSTD_isError(ret))
+    {
+      cerr << "Error decompressing the dump : " << ZSTD_getErrorName(ret) << endl;
+      ZSTD_freeDStream(ds);
+      return -1;
+    }
+
+    out_full = (zout.pos == zout.size);
+    if(out_full)
+    {
+      publishBuffer(INPUT_RING_BUFFER_SIZE);
+      if((out = acquireBuffer()) == NULL)
+      {
+	ZSTD_freeDStream(ds);
+	return 0;
+      }
+      zout.dst = out;
+      zout.pos = 0;
+    }
+  }
+  publishBuffer(zout.pos);
+  ZSTD_freeDStream(ds);
+
+  // 0 once a frame is complete
+  if(ret != 0)
+  {
+    cerr << "Error decompressing the dump : truncated zstd" << endl;
+    return -1;
+  }
+  return 0;
+#else
+  cerr << "Error, zstd dumps need a build with libzstd (make ZSTD=1)" << endl;
+  return -1;
+#endif
+}
+
+void *DecompressingBuf::decompressor(void *arg)
+{
+  DecompressingBuf *db = (DecompressingBuf *)arg;
+  int ret = -1;
+
+  if(db->_format == INPUT_GZIP)
+    ret = db->inflateAll();
+  else if(db->_format == INPUT_XZ)
+    ret = db->unxzAll();
+  else if(db->_format == INPUT_ZSTD)
+    ret = db->unzstdAll();
+
+  pthread_mutex_lock(&db->_lock);
+  db->_done = true;
+  if(ret < 0)
+    db->_error = true;
+  pthread_cond_broadcast(&db->_not_empty);
+  pthread_mutex_unlock(&db->_lock);
+
+  return NULL;
+}
+
+/************************ DecompressedStream **************************/
+
+DecompressedStream::DecompressedStream(istream *src, bool owns_src, input_format_t format) :
+  istream(NULL), _buf(src, owns_src, format)
+{
+  rdbuf(&_buf);
+}
+
+bool DecompressedStream::failed()
+{
+  return _buf.failed();
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Open a dump, "-" for stdin, compressed or not. NULL if it can't be
+ * opened, the stream is given back to closeDump.
+ */
+istream *openDump(const char *path)
+{
+  istream *src = &cin;
+  input_format_t format;
+
+  if(strcmp(path, "-"))
+  {
+    ifstream *file = new ifstream(path, ios::in | ios::binary);
+    if(!*file)
+    {
+      cerr << "Can't open " << path << endl;
+      delete file;
+      return NULL;
+    }
+    src = file;
+  }
+
+  format = detectDumpFormat(*src);
+  if(format == INPUT_PLAIN)
+    return src;
+  return new DecompressedStream(src, src != &cin, format);
+}
+
+/**
+ * Return -1 if the dump could not be decompressed up to its end
+ */
+int closeDump(istream *in)
+{
+  DecompressedStream *ds = dynamic_cast<DecompressedStream *>(in);
+  int ret = (ds != NULL && ds->failed()) ? -1 : 0;
+
+  if(in != &cin)
+    delete in;
+  return ret;
+}
+
+/**
+ * By the first byte only, stdin can't be read back further. A text dump
+ * starts with a space, a '#' or a letter, the decompressors check the
+ * rest of the magic.
+ */
+input_format_t detectDumpFormat(istream &in)
+{
+  int c = in.peek();
+
+  if(c == 0x1f)
+    return INPUT_GZIP;
+  if(c == 0xfd)
+    return INPUT_XZ;
+  if(c == 0x28)
+    return INPUT_ZSTD;
+  return INPUT_PLAIN;
+}
+
+const char *getInputFormatName(input_format_t format)
+{
+  switch(format)
+  {
+    case INPUT_GZIP: return "gzip";
+    case INPUT_XZ: return "xz";
+    case INPUT_ZSTD: return "zstd";
+    default: return "plain";
+  }
+}
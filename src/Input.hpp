@@ -0,0 +1,75 @@
+#ifndef INPUT_HPP
+#define INPUT_HPP
+
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+
+#define INPUT_RING_BUFFERS_NUM			8
+#define INPUT_RING_BUFFER_SIZE			(1024*1024)	// decompressed text per buffer
+#define INPUT_READ_SIZE				(256*1024)	// compressed bytes read at once
+
+typedef enum {INPUT_PLAIN, INPUT_GZIP, INPUT_XZ, INPUT_ZSTD} input_format_t;
+
+/**
+ * Stream buffer of a compressed dump : a thread of its own decompresses
+ * the source into a bounded ring of buffers while the reader parses the
+ * previous ones, so decompression and parsing overlap and nothing is
+ * written to disk. The reader holds one buffer at a time, the thread
+ * waits for a free one when the ring is full.
+ */
+class DecompressingBuf : public std::streambuf
+{
+  public:
+    DecompressingBuf(std::istream *src, bool owns_src, input_format_t format);
+    ~DecompressingBuf();
+    bool failed();
+
+  protected:
+    int underflow();
+
+  private:
+    std::istream *_src;
+    bool _owns_src;
+    input_format_t _format;
+    std::vector<std::vector<char> > _buffers;
+    std::vector<size_t> _lengths;
+    int _head;				// oldest full buffer, the one being read
+    int _full_num;
+    bool _reading;			// the reader holds _head
+    bool _done;				// nothing more will be decompressed
+    bool _stop;				// the reader is gone
+    bool _error;
+    bool _started;
+    pthread_t _thread;
+    pthread_mutex_t _lock;
+    pthread_cond_t _not_empty;
+    pthread_cond_t _not_full;
+
+    char *acquireBuffer();
+    void publishBuffer(size_t len);
+    int inflateAll();
+    int unxzAll();
+    int unzstdAll();
+    static void *decompressor(void *arg);
+};
+
+/**
+ * Reads a compressed dump like a plain one
+ */
+class DecompressedStream : public std::istream
+{
+  public:
+    DecompressedStream(std::istream *src, bool owns_src, input_format_t format);
+    bool failed();
+
+  private:
+    DecompressingBuf _buf;
+};
+
+std::istream *openDump(const char *path);
+int closeDump(std::istream *in);
+input_format_t detectDumpFormat(std::istream &in);
+const char *getInputFormatName(input_format_t format);
+
+#endif /* INPUT_HPP */
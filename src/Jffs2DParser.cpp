@@ -4,43 +4,117 @@
 #include <fstream>
 #include <cstdlib>
 #include <cstring>
+#include <sstream>
+#include <map>
+#include <algorithm>
 #include <getopt.h>
+#include <unistd.h>
 
 #define NDEBUG
 
 #include "Parser.hpp"
 #include "ChunkModel.hpp"
 #include "File.hpp"
+#include "DirTree.hpp"
+#include "FlashIndex.hpp"
+#include "DumpDiff.hpp"
+#include "Batch.hpp"
+#include "MountScan.hpp"
+#include "Compression.hpp"
+#include "Query.hpp"
+#include "Sweep.hpp"
+#include "Partition.hpp"
+#include "FlashMap.hpp"
+#include "Server.hpp"
+#include "Stream.hpp"
+#include "Generator.hpp"
+#include "Benchmark.hpp"
+#include "Stats.hpp"
+#include "External.hpp"
+#include "Sample.hpp"
+#include "Extract.hpp"
+#include "Input.hpp"
+#include "HotCold.hpp"
 
 using namespace std;
 
-typedef enum {MODE_VIZ, MODE_CSV, MODE_FILEMAP} parser_mode_t;
+typedef enum {MODE_VIZ, MODE_CSV, MODE_FILEMAP, MODE_TREE, MODE_PAGES, MODE_DIFF, MODE_BATCH, MODE_MOUNT, MODE_COMPRESSION, MODE_QUERY, MODE_SWEEP, MODE_PARTITIONS, MODE_MAP, MODE_SERVER, MODE_STREAM, MODE_GENERATE, MODE_BENCHMARK, MODE_EXTERNAL, MODE_SAMPLE, MODE_EXTRACT, MODE_HOTCOLD} parser_mode_t;
+
+#define OPT_STATS			256	// long options only, after every char
 
 typedef struct
 {
   int flash_page_size;
   int pages_per_block;
-  int partition_offset;
+  uint64_t partition_offset;
+  FlashGeometry geometry;		// built from the 3 fields above, used by every chunk
   parser_mode_t mode;
   char file_path[256];			// stdin if == "-"
+  char tree_root[256];			// subtree printed in tree mode
+  char *bad_pages;			// page list for pages mode
+  char *bad_blocks;			// block list for pages mode
+  char *old_dump_path;			// dump compared to the input in diff mode
+  char *query;				// predicates and order for query mode
+  char *geometries;			// geometry list for sweep mode
+  char *partition_table;		// partitions of the chip for partitions mode
+  char *map_path;			// image written in map mode
+  map_colouring_t map_colouring;
+  int map_width;			// pixels per row of the image
+  char *socket_path;			// unix socket of the server mode
+  int stream_window;			// chunks without news before a file is printed
+  int stream_interval;			// chunks between two global stats lines
+  char *gen_spec;			// synthetic dump parameters, generate and benchmark modes
+  char *bench_scales;			// numbers of files of the benchmark dumps
+  int threads_num;			// workers for the batch mode
+  int memory_budget;			// MB of dumps processed at once, 0 for no limit
+  int external_budget;			// MB of nodes held at once in external mode
+  double sample_rate;			// share of the inodes finalized in sample mode
+  char *image_path;			// raw partition image of the extract mode
+  char *extract_dir;			// where the extract mode writes the files
+  bool extract_check_crc;		// else the uncompressed payloads are copied unchecked
+  double hot_age;			// write age under which data is hot, hot/cold mode
+  readpage_model_t readpage_model;	// how the readpages of every mode are charged
+  double page_read_us;			// time to read one flash page
+  double decompress_mbps;		// decompressor throughput for compression mode
+  bool stats;				// print the run statistics on stderr at exit
+  bool stats_json;
+  bool stats_hw;			// with the hardware counters
 } parser_config_t;
 
+static bool stats_json;
+
 void print_help_and_exit(int argc, char **argv);
 void print_all(vector<Chunk *> &res);
 void set_default_options(parser_config_t &config);
 void print_csv(vector<Chunk *> &res);
 void print_filemap(vector<Chunk *> &res);
+int print_tree(vector<Chunk *> &res, parser_config_t &config);
+int print_affected_files(vector<Chunk *> &res, parser_config_t &config);
+int parse_index_list(char *list, vector<uint32_t> &res);
+int print_diff(vector<Chunk *> &res, parser_config_t &config);
+void print_compression(vector<Chunk *> &res, parser_config_t &config);
+int print_query(vector<Chunk *> &res, parser_config_t &config);
+int print_sweep(vector<Chunk *> &res, parser_config_t &config);
+int print_map(vector<Chunk *> &res, parser_config_t &config);
+int print_extract(vector<Chunk *> &res, parser_config_t &config);
 void print_config(parser_config_t &config);
+void print_stats();
 
 int main(int argc, char **argv)
 {
   parser_config_t config;
   vector<Chunk *> res;
-  int c;
+  int c, ret = EXIT_SUCCESS;
+  static struct option long_options[] =
+  {
+    {"stats", optional_argument, NULL, OPT_STATS},
+    {NULL, 0, NULL, 0}
+  };
   
   // process options
   set_default_options(config);
-  while ((c = getopt (argc, argv, "vcfp:b:")) != -1)
+  while ((c = getopt_long (argc, argv, "vcftP:r:R:d:Bj:m:sT:zZ:q:g:M:i:I:W:S:l:L:G:X:E:a:x:O:UH:Kp:b:o:", 
+    long_options, NULL)) != -1)
     switch (c)
     {
       case 'v':
@@ -52,6 +126,111 @@ int main(int argc, char **argv)
       case 'f':
 	config.mode = MODE_FILEMAP;
 	break;
+      case 't':
+	config.mode = MODE_TREE;
+	break;
+      case 'P':
+	strncpy(config.tree_root, optarg, sizeof(config.tree_root)-1);
+	break;
+      case 'r':
+	config.mode = MODE_PAGES;
+	config.bad_pages = optarg;
+	break;
+      case 'R':
+	config.mode = MODE_PAGES;
+	config.bad_blocks = optarg;
+	break;
+      case 'd':
+	config.mode = MODE_DIFF;
+	config.old_dump_path = optarg;
+	break;
+      case 'B':
+	config.mode = MODE_BATCH;
+	break;
+      case 'j':
+	config.threads_num = atoi(optarg);
+	break;
+      case 'm':
+	config.memory_budget = atoi(optarg);
+	break;
+      case 's':
+	config.mode = MODE_MOUNT;
+	break;
+      case 'T':
+	config.page_read_us = atof(optarg);
+	break;
+      case 'z':
+	config.mode = MODE_COMPRESSION;
+	break;
+      case 'Z':
+	config.decompress_mbps = atof(optarg);
+	break;
+      case 'q':
+	config.mode = MODE_QUERY;
+	config.query = optarg;
+	break;
+      case 'g':
+	config.mode = MODE_SWEEP;
+	config.geometries = optarg;
+	break;
+      case 'M':
+	config.mode = MODE_PARTITIONS;
+	config.partition_table = optarg;
+	break;
+      case 'i':
+      case 'I':
+	config.mode = MODE_MAP;
+	config.map_path = optarg;
+	config.map_colouring = (c == 'i') ? MAP_BY_STATE : MAP_BY_FILE;
+	break;
+      case 'W':
+	config.map_width = atoi(optarg);
+	break;
+      case 'S':
+	config.mode = MODE_SERVER;
+	config.socket_path = optarg;
+	break;
+      case 'l':
+	config.mode = MODE_STREAM;
+	config.stream_window = atoi(optarg);
+	break;
+      case 'L':
+	config.stream_interval = atoi(optarg);
+	break;
+      case 'G':
+	if(config.mode != MODE_BENCHMARK)
+	  config.mode = MODE_GENERATE;
+	config.gen_spec = optarg;
+	break;
+      case 'X':
+	config.mode = MODE_BENCHMARK;
+	config.bench_scales = optarg;
+	break;
+      case 'E':
+	config.mode = MODE_EXTERNAL;
+	config.external_budget = atoi(optarg);
+	break;
+      case 'a':
+	config.mode = MODE_SAMPLE;
+	config.sample_rate = atof(optarg);
+	break;
+      case 'x':
+	config.mode = MODE_EXTRACT;
+	config.image_path = optarg;
+	break;
+      case 'O':
+	config.extract_dir = optarg;
+	break;
+      case 'U':
+	config.extract_check_crc = false;
+	break;
+      case 'H':
+	config.mode = MODE_HOTCOLD;
+	config.hot_age = atof(optarg);
+	break;
+      case 'K':
+	config.readpage_model = READPAGE_KERNEL;
+	break;
       case 'p':
 	config.flash_page_size = atoi(optarg);
 	break;
@@ -59,7 +238,16 @@ int main(int argc, char **argv)
 	config.pages_per_block = atoi(optarg);
 	break;
       case 'o':
-	config.partition_offset = atoi(optarg);
+	if(parseOffset(optarg, config.partition_offset) < 0)
+	{
+	  cerr << "Error, invalid partition offset : " << optarg << endl;
+	  return EXIT_FAILURE;
+	}
+	break;
+      case OPT_STATS:
+	config.stats = true;
+	if(parseStatsOptions(optarg, config.stats_json, config.stats_hw) < 0)
+	  return EXIT_FAILURE;
 	break;
       case 'h':
       default:
@@ -70,45 +258,324 @@ int main(int argc, char **argv)
   else
     print_help_and_exit(argc, argv);
   
-  FlashAddr::init(config.flash_page_size, config.pages_per_block, config.partition_offset);
+  config.geometry = FlashGeometry(config.flash_page_size, config.pages_per_block, 
+    config.partition_offset);
+  if(!config.geometry.isValid())
+  {
+    cerr << "Error, invalid flash geometry" << endl;
+    return EXIT_FAILURE;
+  }
+  setReadpageModel(config.readpage_model);
+  
+  // printed at exit, whatever the mode and exit path
+  if(config.stats)
+  {
+    run_stats = new RunStats(config.stats_hw);
+    stats_json = config.stats_json;
+    atexit(print_stats);
+  }
+  
+  // the generator writes <input> instead of reading it
+  if(config.mode == MODE_GENERATE || config.mode == MODE_BENCHMARK)
+  {
+    gen_params_t params;
+    
+    if(parseGenParams(config.gen_spec, params) < 0)
+      return EXIT_FAILURE;
+    if(config.mode == MODE_BENCHMARK)
+    {
+      vector<int> scales;
+      
+      if(parseScaleList(config.bench_scales, scales) < 0)
+	return EXIT_FAILURE;
+      DumpBenchmark bench(params, config.geometry, config.file_path);
+      return (bench.run(scales, cout) < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    
+    DumpGenerator gen(params, config.geometry);
+    if(!strcmp(config.file_path, "-"))
+      ret = gen.write(cout);
+    else
+    {
+      ofstream out(config.file_path, ios::out | ios::binary);
+      if(!out)
+      {
+	cerr << "Can't open " << config.file_path << endl;
+	return EXIT_FAILURE;
+      }
+      ret = gen.write(out);
+    }
+    if(ret < 0)
+      return EXIT_FAILURE;
+    cerr << gen.getNodesNum() << " nodes, " << gen.getSize() << " bytes of flash written to " 
+      << config.file_path << endl;
+    return EXIT_SUCCESS;
+  }
+  
+  // batch mode parses its inputs itself
+  if(config.mode == MODE_BATCH)
+  {
+    print_config(config);
+    if(runBatch(config.file_path, config.geometry, config.threads_num, 
+      (uint64_t)config.memory_budget*1024*1024, cout) < 0)
+      return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+  }
+  
+  // the server loads every input once and answers requests until shut down
+  if(config.mode == MODE_SERVER)
+  {
+    QueryServer server(config.geometry);
+    
+    print_config(config);
+    for(int i=optind; i<argc; i++)
+      if(server.load(argv[i]) < 0)
+	return EXIT_FAILURE;
+    if(server.serve(config.socket_path, config.threads_num) < 0)
+      return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+  }
+  
+  // the streaming mode never holds the whole chunk list
+  if(config.mode == MODE_STREAM)
+  {
+    StreamAnalyzer stream(config.geometry, config.stream_window, config.stream_interval, cout);
+    istream *in;
+    
+    print_config(config);
+    if((in = openDump(config.file_path)) == NULL)
+      return EXIT_FAILURE;
+    ret = stream.run(*in);
+    if(closeDump(in) < 0)
+      ret = -1;
+    return (ret < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  
+  // the external mode only holds one bucket of nodes at a time
+  if(config.mode == MODE_EXTERNAL)
+  {
+    ExternalFileMap efm(config.geometry, (uint64_t)config.external_budget*1024*1024);
+    
+    print_config(config);
+    if(efm.run(config.file_path, cout) < 0)
+      return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+  }
+  
+  // the sample mode only keeps the nodes of the sampled inodes
+  if(config.mode == MODE_SAMPLE)
+  {
+    SampledSummary sample(config.geometry, config.sample_rate);
+    istream *in;
+    
+    print_config(config);
+    if((in = openDump(config.file_path)) == NULL)
+      return EXIT_FAILURE;
+    ret = sample.run(*in);
+    if(closeDump(in) < 0 || ret < 0)
+      return EXIT_FAILURE;
+    cout << sample;
+    return EXIT_SUCCESS;
+  }
+  
+  // so does the partitions mode, the partitions may come from several dumps
+  if(config.mode == MODE_PARTITIONS)
+  {
+    print_config(config);
+    if(runPartitions(config.file_path, config.partition_table, config.geometry, 
+      config.threads_num, (uint64_t)config.memory_budget*1024*1024, cout) < 0)
+      return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+  }
+  
+  // a single dump from here, its files are built by every thread
+  setFileSetThreadsNum(config.threads_num);
   
   if (!strcmp(config.file_path, "-"))
   {
-    if (parseStdIn(res) < 0)
+    if (parseStdIn(res, config.geometry) < 0)
     {
       cerr << "Error parsing stdin" << endl;
       return EXIT_FAILURE;
     }
   }
   else
-    if(parseFile(config.file_path, res) < 0)
+    if(parseFile(config.file_path, res, config.geometry) < 0)
     {
       cerr << "Error parsing " << argv[1] <<  endl;
       return EXIT_FAILURE;
     }
     
   print_config(config);
+  if(run_stats != NULL)
+    run_stats->startPhase("output");
   if(config.mode == MODE_VIZ)
     print_all(res);
   else if(config.mode == MODE_CSV)
     print_csv(res);
   else if(config.mode == MODE_FILEMAP)
     print_filemap(res);
+  else if(config.mode == MODE_TREE)
+  {
+    if(print_tree(res, config) < 0)
+      ret = EXIT_FAILURE;
+  }
+  else if(config.mode == MODE_PAGES)
+  {
+    if(print_affected_files(res, config) < 0)
+      ret = EXIT_FAILURE;
+  }
+  else if(config.mode == MODE_DIFF)
+  {
+    if(print_diff(res, config) < 0)
+      ret = EXIT_FAILURE;
+  }
+  else if(config.mode == MODE_MOUNT)
+  {
+    MountScan ms(res, config.geometry, config.page_read_us);
+    cout << ms;
+  }
+  else if(config.mode == MODE_COMPRESSION)
+    print_compression(res, config);
+  else if(config.mode == MODE_QUERY)
+  {
+    if(print_query(res, config) < 0)
+      ret = EXIT_FAILURE;
+  }
+  else if(config.mode == MODE_SWEEP)
+  {
+    if(print_sweep(res, config) < 0)
+      ret = EXIT_FAILURE;
+  }
+  else if(config.mode == MODE_MAP)
+  {
+    if(print_map(res, config) < 0)
+      ret = EXIT_FAILURE;
+  }
+  else if(config.mode == MODE_EXTRACT)
+  {
+    if(print_extract(res, config) < 0)
+      ret = EXIT_FAILURE;
+  }
+  else if(config.mode == MODE_HOTCOLD)
+  {
+    FileSet fs(res);
+    HotColdReport hc(res, fs, config.geometry, config.hot_age);
+    cout << hc;
+  }
   else
   {
     cerr << "Invalid mode" << endl;
   }
+  if(run_stats != NULL)
+    run_stats->endPhase();
   
   for(int i=0; i<(int)res.size(); i++)
     delete res[i];
     
-  return EXIT_SUCCESS;
+  return ret;
+}
+
+void print_stats()
+{
+  cout.flush();
+  run_stats->print(cerr, stats_json);
+  delete run_stats;
+  run_stats = NULL;
 }
 
 void print_help_and_exit(int argc, char **argv)
 {
   cout << "Usage : " << argv[0] << " <input>" << endl;
-  cout << "  <input> can be a file or '-' for std input" << endl;
+  cout << "  <input> can be a file or '-' for std input, gzip, xz and zstd dumps" << endl;
+  cout << "     are decompressed on the fly" << endl;
+  cout << "  -v : visualization mode (default)" << endl;
+  cout << "  -f : filemap mode" << endl;
+  cout << "  -t : directory tree mode, with per subtree costs" << endl;
+  cout << "  -P <path> : only print the subtree rooted at path (tree mode)" << endl;
+  cout << "  -r <pages> : report the nodes and files stored in these flash pages" << endl;
+  cout << "  -R <blocks> : same for whole flash blocks" << endl;
+  cout << "     lists are like 12,40-47 or @file to read them from a file," << endl;
+  cout << "     indexes include the partition offset" << endl;
+  cout << "  -d <old dump> : diff mode, report the nodes and file costs changed" << endl;
+  cout << "     between the old dump and <input>" << endl;
+  cout << "  -B : batch mode, <input> is a directory of dumps or a file listing" << endl;
+  cout << "     one dump path per line, print one summary row per dump then" << endl;
+  cout << "     fleet-wide distributions" << endl;
+  cout << "  -M <table> : partitions mode, <input> is a whole chip dump, summarize" << endl;
+  cout << "     each partition of the table then the chip. The table has one" << endl;
+  cout << "     '<name> <offset> <size> [<partition dump>]' per line or is a copy" << endl;
+  cout << "     of /proc/mtd" << endl;
+  cout << "  -j <num> : number of dumps, partitions, geometries or connections" << endl;
+  cout << "     processed concurrently (batch, partitions, sweep and server modes)," << endl;
+  cout << "     or of threads building the files of a single dump" << endl;
+  cout << "  -m <MB> : max total size of the dumps processed concurrently (batch and" << endl;
+  cout << "     partitions modes)" << endl;
+  cout << "  -s : mount scan mode, estimate the pages read and time spent at mount," << endl;
+  cout << "     per block, with and without erase block summaries" << endl;
+  cout << "  -z : compression mode, compression ratios and readpage io + decompression" << endl;
+  cout << "     time per file, per directory and globally" << endl;
+  cout << "  -q <query> : query mode, print the files matching comma separated terms :" << endl;
+  cout << "     <metric><op><value> (op in < <= > >= =, value with K, M or G suffix)," << endl;
+  cout << "     deleted, live, path=<prefix>, by=<metric>, asc, top=<K>" << endl;
+  cout << "     metrics : ino, nodes, size, pages, runs, blocks, frag, seqcost," << endl;
+  cout << "     contig" << endl;
+  cout << "  -g <geometries> : sweep mode, compare the file costs for each geometry" << endl;
+  cout << "     of a list like 2048x64,4096x64 (page size x pages per block)" << endl;
+  cout << "  -i <image.ppm> : map mode, write an image of the partition coloured by" << endl;
+  cout << "     state : valid green, obsolete red, free black, summaries blue" << endl;
+  cout << "  -I <image.ppm> : same, the valid data coloured by owning file" << endl;
+  cout << "  -W <pixels> : width of the map image (map mode)" << endl;
+  cout << "  -S <socket> : server mode, load every <input> dump then answer requests" << endl;
+  cout << "     on this unix socket, one per line : dumps, use <n>, file <path|ino>," << endl;
+  cout << "     query <query>, page <n>, block <n>, read <path|ino> <offset> <len>," << endl;
+  cout << "     replay <trace file>, quit, shutdown" << endl;
+  cout << "  -l <chunks> : streaming mode, print each file as soon as none of its" << endl;
+  cout << "     nodes came in the last <chunks> chunks, again if it changes later," << endl;
+  cout << "     for live dumps piped on stdin" << endl;
+  cout << "  -L <chunks> : chunks between two global stats lines (streaming mode)" << endl;
+  cout << "  -G <spec> : generate mode, write a synthetic dump to <input> from comma" << endl;
+  cout << "     separated <key>=<value> : files, dirs, size (mean file size, K or M" << endl;
+  cout << "     suffix), writers, overwrite, delete, dup, free (ratios in [0, 1)), seed," << endl;
+  cout << "     and compr=none|rtime|zlib for the data, raw to write a JFFS2 image" << endl;
+  cout << "     instead of jffs2dump text" << endl;
+  cout << "  -X <scales> : benchmark mode, time each analysis phase on generated" << endl;
+  cout << "     dumps of these numbers of files (like 1000,10K,100K), <input> is" << endl;
+  cout << "     the scratch dump path, -G gives the other parameters. JSON output" << endl;
+  cout << "  -E <MB> : filemap mode for dumps larger than the memory, the nodes are" << endl;
+  cout << "     spilled to temporary files by inode ($TMPDIR or /tmp) and about <MB>" << endl;
+  cout << "     of them finalized at once. The files are listed by inode number" << endl;
+  cout << "  -a <rate> : sample mode, finalize only this share of the inodes, chosen" << endl;
+  cout << "     by a hash of their number, and estimate the fragmentation, read cost" << endl;
+  cout << "     and GC pressure with 95% confidence intervals" << endl;
+  cout << "  -x <image> : extract mode, rebuild the live files from the raw image of" << endl;
+  cout << "     the partition <input> was dumped from (zlib, rtime, lzo or no" << endl;
+  cout << "     compression), the files are processed concurrently (-j)" << endl;
+  cout << "  -O <dir> : where the extract mode writes the files (default extracted)" << endl;
+  cout << "  -U : do not check the data CRC of the uncompressed nodes in extract mode," << endl;
+  cout << "     they are copied from the image by the kernel (copy_file_range)" << endl;
+  cout << "  -H <age> : hot/cold mode, classify the valid data by write age, from the" << endl;
+  cout << "     rewrites of their pages and the log position of their block, hot" << endl;
+  cout << "     under <age> (0 to 1, e.g. 0.5 : rewritten data in the newer blocks)," << endl;
+  cout << "     and estimate the GC copies saved" << endl;
+  cout << "     by writing hot and cold data to separate blocks" << endl;
+  cout << "  -K : kernel readpage model, every fragment of a linux page is read," << endl;
+  cout << "     CRC checked and decompressed as a whole node, and a node spanning" << endl;
+  cout << "     two linux pages is read again for the second. Changes the sequential" << endl;
+  cout << "     read cost and the compression mode times, the filemap readpage list" << endl;
+  cout << "     and the server read and replay answers also give the bytes read, CRC" << endl;
+  cout << "     checked, decompressed and discarded. The simple model reads each" << endl;
+  cout << "     node once" << endl;
+  cout << "  -T <us> : flash page read time in microseconds" << endl;
+  cout << "  -Z <MB/s> : decompression throughput (compression mode)" << endl;
+  cout << "  -p <size> : flash page size in bytes" << endl;
+  cout << "  -b <num> : number of flash pages per block" << endl;
+  cout << "  -o <offset> : partition offset in bytes, decimal or 0x prefixed hex, dump" << endl;
+  cout << "     offsets are relative to it" << endl;
+  cout << "  --stats[=<options>] : print on stderr the wall and cpu time of each phase" << endl;
+  cout << "     (read, parse, dedupe, sort, fileset, finalize, output), the node," << endl;
+  cout << "     duplicate and file counts and the peak RSS. Options, comma separated :" << endl;
+  cout << "     json, hw for the cycles, instructions and cache misses of each phase" << endl;
   exit(-1);
 }
 
@@ -139,6 +606,13 @@ void print_all(vector<Chunk *> &res)
 	cout << *dn << endl;
 	break;
       }
+      
+      case SUMMARY_NODE:
+      {
+	SummaryNode *sn = static_cast<SummaryNode *>(res[i]);
+	cout << *sn << endl;
+	break;
+      }
 	
       default:
 	cerr << "Error unknown type ..." << endl;
@@ -166,6 +640,59 @@ void print_config(parser_config_t &config)
     case MODE_VIZ:
       cout << " - Visualization mode" << endl;
       break;
+    case MODE_TREE:
+      cout << " - Directory tree mode (" << config.tree_root << ")" << endl;
+      break;
+    case MODE_PAGES:
+      cout << " - Bad pages mode" << endl;
+      break;
+    case MODE_DIFF:
+      cout << " - Diff mode against " << config.old_dump_path << endl;
+      break;
+    case MODE_BATCH:
+      cout << " - Batch mode, " << config.threads_num << " threads" << endl;
+      break;
+    case MODE_MOUNT:
+      cout << " - Mount scan mode" << endl;
+      break;
+    case MODE_COMPRESSION:
+      cout << " - Compression mode" << endl;
+      break;
+    case MODE_QUERY:
+      cout << " - Query mode (" << config.query << ")" << endl;
+      break;
+    case MODE_SWEEP:
+      cout << " - Geometry sweep mode (" << config.geometries << "), " << config.threads_num 
+	<< " threads" << endl;
+      break;
+    case MODE_EXTERNAL:
+      cout << " - External memory filemap mode, " << config.external_budget << " MB" << endl;
+      break;
+    case MODE_SAMPLE:
+      cout << " - Sample mode, rate " << config.sample_rate << endl;
+      break;
+    case MODE_EXTRACT:
+      cout << " - Extract mode from " << config.image_path << " to " << config.extract_dir 
+	<< ", " << config.threads_num << " threads"
+	<< ((config.extract_check_crc) ? "" : ", uncompressed data CRCs not checked") << endl;
+      break;
+    case MODE_HOTCOLD:
+      cout << " - Hot/cold mode, hot under write age " << config.hot_age << endl;
+      break;
+    case MODE_STREAM:
+      cout << " - Streaming mode, " << config.stream_window << " chunks window" << endl;
+      break;
+    case MODE_SERVER:
+      cout << " - Server mode on " << config.socket_path << ", " << config.threads_num 
+	<< " threads" << endl;
+      break;
+    case MODE_MAP:
+      cout << " - Map mode (" << config.map_path << ")" << endl;
+      break;
+    case MODE_PARTITIONS:
+      cout << " - Partitions mode (" << config.partition_table << "), " << config.threads_num 
+	<< " threads" << endl;
+      break;
     default:
       break;
   }
@@ -173,6 +700,8 @@ void print_config(parser_config_t &config)
   cout << " - Flash page size : " << config.flash_page_size << endl;
   cout << " - Pages per block : " << config.pages_per_block << endl;
   cout << " - Partition offset : " << config.partition_offset << endl;
+  if(config.readpage_model != READPAGE_SIMPLE)
+    cout << " - Readpage model : " << getReadpageModelName(config.readpage_model) << endl;
   
   cout << "/************************************/" << endl;
 }
@@ -189,11 +718,299 @@ void print_filemap(vector<Chunk *> &res)
   cout << fs;
 }
 
+int print_tree(vector<Chunk *> &res, parser_config_t &config)
+{
+  FileSet fs(res);
+  DirTree tree(fs);
+  int entry = tree.findPath(config.tree_root);
+  
+  if(entry == -1)
+  {
+    cerr << "Error, no such path : " << config.tree_root << endl;
+    return -1;
+  }
+  
+  cout << "DirTree with " << tree.getEntriesNum() << " entries :" << endl;
+  tree.printSubtree(cout, entry);
+  
+  return 0;
+}
+
+/**
+ * For each bad page/block print the nodes stored there, then the byte
+ * ranges of each file whose valid data is affected
+ */
+int print_affected_files(vector<Chunk *> &res, parser_config_t &config)
+{
+  vector<uint32_t> pages, blocks;
+  map<File *, vector<pair<uint32_t, uint32_t> > > affected;
+  
+  if(config.bad_pages != NULL && parse_index_list(config.bad_pages, pages) < 0)
+    return -1;
+  if(config.bad_blocks != NULL && parse_index_list(config.bad_blocks, blocks) < 0)
+    return -1;
+  
+  FileSet fs(res);
+  DirTree tree(fs);
+  FlashIndex index(res, fs, config.geometry);
+  
+  cout << "Flash index with " << index.getExtentsNum() << " node extents" << endl;
+  for(int i=0; i<(int)(pages.size() + blocks.size()); i++)
+  {
+    vector<const node_extent_t *> found;
+    bool is_page = (i < (int)pages.size());
+    uint32_t idx = is_page ? pages[i] : blocks[i-pages.size()];
+    
+    if(is_page)
+    {
+      index.findPage(idx, found);
+      cout << "Page " << idx << " (block " << idx/config.geometry.getNumPagesPerBlock() 
+	<< ") : " << found.size() << " node(s)" << endl;
+    }
+    else
+    {
+      index.findBlock(idx, found);
+      cout << "Block " << idx << " : " << found.size() << " node(s)" << endl;
+    }
+    
+    for(int j=0; j<(int)found.size(); j++)
+    {
+      const node_extent_t *e = found[j];
+      int entry = (e->file == NULL) ? -1 : tree.findInode(e->file->getInodeNum());
+      
+      cout << "    ";
+      if(e->node->getType() == DATA_NODE)
+	cout << *(static_cast<DataNode *>(e->node));
+      else
+	cout << *(static_cast<DirentNode *>(e->node));
+      cout << " " << ((e->valid) ? "[valid]" : "[obsolete]");
+      if(entry != -1)
+	cout << " \"" << tree.getPath(entry) << "\"";
+      cout << endl;
+      
+      if(e->valid && e->node->getType() == DATA_NODE)
+      {
+	DataNode *dn = static_cast<DataNode *>(e->node);
+	if(dn->getDataSize() > 0)
+	  affected[e->file].push_back(make_pair(dn->getDataOffset(), 
+	    dn->getDataOffset() + dn->getDataSize() - 1));
+      }
+    }
+  }
+  
+  cout << "Affected files (" << affected.size() << ") :" << endl;
+  for(map<File *, vector<pair<uint32_t, uint32_t> > >::iterator it = affected.begin(); 
+    it != affected.end(); ++it)
+  {
+    vector<pair<uint32_t, uint32_t> > &ranges = it->second;
+    int entry = tree.findInode(it->first->getInodeNum());
+    
+    // merge the overlapping ranges, nodes may be hit by several pages
+    sort(ranges.begin(), ranges.end());
+    cout << "  F: \"" << ((entry == -1) ? it->first->getName() : tree.getPath(entry)) 
+      << "\" ino:" << it->first->getInodeNum() << ", bytes :";
+    for(int i=0; i<(int)ranges.size(); )
+    {
+      uint32_t start = ranges[i].first, end = ranges[i].second;
+      for(i++; i<(int)ranges.size() && ranges[i].first <= end+1; i++)
+	end = max(end, ranges[i].second);
+      cout << " " << start << "->" << end;
+    }
+    cout << endl;
+  }
+  
+  return 0;
+}
+
+int print_diff(vector<Chunk *> &res, parser_config_t &config)
+{
+  vector<Chunk *> old_res;
+  int ret = 0;
+  
+  if(parseFile(config.old_dump_path, old_res, config.geometry) < 0)
+  {
+    cerr << "Error parsing " << config.old_dump_path << endl;
+    ret = -1;
+  }
+  else
+  {
+    DumpDiff diff(old_res, res);
+    cout << diff;
+  }
+  
+  for(int i=0; i<(int)old_res.size(); i++)
+    delete old_res[i];
+  
+  return ret;
+}
+
+void print_compression(vector<Chunk *> &res, parser_config_t &config)
+{
+  FileSet fs(res);
+  DirTree tree(fs);
+  read_cost_params_t params;
+
+  params.page_read_us = config.page_read_us;
+  params.decompress_mbps = config.decompress_mbps;
+  params.crc_mbps = READPAGE_DEFAULT_CRC_MBPS;
+  CompressionReport cr(tree, params);
+  cout << cr;
+}
+
+/**
+ * The tree only resolves the paths, its subtree stats are not needed, so
+ * only the metrics used by the query are computed
+ */
+int print_query(vector<Chunk *> &res, parser_config_t &config)
+{
+  query_t query;
+  vector<query_result_t> results;
+  int matched_num;
+
+  if(parseQuery(config.query, query) < 0)
+    return -1;
+
+  FileSet fs(res);
+  DirTree tree(fs);
+  matched_num = runQuery(tree, query, results);
+  printQueryResults(cout, tree, query, results, matched_num);
+
+  return 0;
+}
+
+/**
+ * The dump is parsed and its files built once with the geometry of the
+ * options, then every geometry of the list is evaluated
+ */
+int print_sweep(vector<Chunk *> &res, parser_config_t &config)
+{
+  vector<FlashGeometry> geometries;
+
+  if(parseGeometryList(config.geometries, config.partition_offset, geometries) < 0)
+    return -1;
+
+  FileSet fs(res);
+  GeometrySweep sweep(fs, geometries);
+  if(sweep.run(config.threads_num) < 0)
+    return -1;
+  cout << sweep;
+
+  return 0;
+}
+
+/**
+ * The image is written from per pixel counters, its size does not depend
+ * on the number of chunks
+ */
+int print_map(vector<Chunk *> &res, parser_config_t &config)
+{
+  FileSet fs(res);
+  FlashMap map(res, fs, config.geometry, MAP_DEFAULT_MAX_PIXELS);
+
+  if(map.writePPM(config.map_path, config.map_colouring, config.map_width) < 0)
+    return -1;
+  cout << map.getPixelsNum() << " pixels of " << map.getPagesPerPixel() << " page(s) written to "
+    << config.map_path << endl;
+
+  return 0;
+}
+
+/**
+ * The files of the dump are rebuilt from the raw image it was made from
+ */
+int print_extract(vector<Chunk *> &res, parser_config_t &config)
+{
+  FileSet fs(res);
+  DirTree tree(fs);
+  FileExtractor extractor(tree, config.geometry);
+
+  if(extractor.run(config.image_path, config.extract_dir, config.threads_num,
+    config.extract_check_crc) < 0)
+    return -1;
+  cout << extractor;
+
+  return 0;
+}
+
+/**
+ * Parse a list like "12,40-47" (or "@path" to read it from a file)
+ */
+int parse_index_list(char *list, vector<uint32_t> &res)
+{
+  string content = list;
+  
+  if(list[0] == '@')
+  {
+    ifstream in(list+1);
+    stringstream ss;
+    if(!in)
+    {
+      cerr << "Can't open " << list+1 << endl;
+      return -1;
+    }
+    ss << in.rdbuf();
+    content = ss.str();
+  }
+  
+  // accept commas, spaces and new lines as separators
+  for(int i=0; i<(int)content.size(); i++)
+    if(content[i] == ',' || content[i] == '\n' || content[i] == '\t')
+      content[i] = ' ';
+  
+  stringstream ss(content);
+  string item;
+  while(ss >> item)
+  {
+    unsigned long first, last;
+    char *end;
+    
+    first = last = strtoul(item.c_str(), &end, 0);
+    if(*end == '-')
+      last = strtoul(end+1, &end, 0);
+    if(*end != '\0' || last < first)
+    {
+      cerr << "Error, invalid index range : " << item << endl;
+      return -1;
+    }
+    for(unsigned long i=first; i<=last; i++)
+      res.push_back(i);
+  }
+  
+  return 0;
+}
+
 void set_default_options(parser_config_t &config)
 {
   config.pages_per_block = 64;
   config.flash_page_size = 2048;
   config.mode = MODE_VIZ;
   strcpy(config.file_path, "");
-  config.partition_offset = 7864320;		//TODO put 0 here
+  strcpy(config.tree_root, "/");
+  config.bad_pages = NULL;
+  config.bad_blocks = NULL;
+  config.old_dump_path = NULL;
+  config.query = NULL;
+  config.geometries = NULL;
+  config.partition_table = NULL;
+  config.map_path = NULL;
+  config.map_colouring = MAP_BY_STATE;
+  config.map_width = 512;
+  config.socket_path = NULL;
+  config.stream_window = 1000;
+  config.stream_interval = 100000;
+  config.gen_spec = NULL;
+  config.bench_scales = NULL;
+  config.stats = config.stats_json = config.stats_hw = false;
+  config.threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+  config.memory_budget = 0;
+  config.external_budget = 256;
+  config.sample_rate = 0.1;
+  config.image_path = NULL;
+  config.extract_dir = (char *)"extracted";
+  config.extract_check_crc = true;
+  config.hot_age = HOTCOLD_DEFAULT_AGE;
+  config.readpage_model = READPAGE_SIMPLE;
+  config.page_read_us = 50.0;
+  config.decompress_mbps = 20.0;
+  config.partition_offset = 0;
 }
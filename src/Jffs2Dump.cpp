@@ -0,0 +1,306 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "Jffs2Dump.hpp"
+#include "Parser.hpp"
+
+using namespace std;
+
+/***************************** Jffs2Dump ******************************/
+
+Jffs2Dump::Jffs2Dump(FlashGeometry &geometry)
+{
+  _geometry = geometry;
+  _fs = NULL;
+  _tree = NULL;
+  _index = NULL;
+  memset(&_summary, 0, sizeof(_summary));
+}
+
+Jffs2Dump::~Jffs2Dump()
+{
+  clear();
+}
+
+void Jffs2Dump::clear()
+{
+  delete _index;
+  delete _tree;
+  delete _fs;
+  _index = NULL;
+  _tree = NULL;
+  _fs = NULL;
+  for(int i=0; i<(int)_chunks.size(); i++)
+    delete _chunks[i];
+  _chunks.clear();
+}
+
+/**
+ * Parse a dump, "-" for stdin, and build everything the queries need.
+ * A dump already loaded is replaced.
+ */
+int Jffs2Dump::load(const char *path)
+{
+  vector<char> path_buf(path, path + strlen(path) + 1);
+  int ret;
+
+  clear();
+  _name = path;
+  if(!strcmp(path, "-"))
+    ret = parseStdIn(_chunks, _geometry);
+  else
+    ret = parseFile(&path_buf[0], _chunks, _geometry);
+  if(ret < 0)
+  {
+    cerr << "Error parsing " << path << endl;
+    clear();
+    return -1;
+  }
+
+  _fs = new FileSet(_chunks, false);
+  _tree = new DirTree(*_fs);
+  _index = new FlashIndex(_chunks, *_fs, _geometry);
+  warmFileMetrics(*_fs);
+  computeDumpSummary(_chunks, *_fs, _geometry, _summary);
+
+  return 0;
+}
+
+string Jffs2Dump::getName() const
+{
+  return _name;
+}
+
+FlashGeometry Jffs2Dump::getGeometry() const
+{
+  return _geometry;
+}
+
+/**
+ * DirTree entries, slash included
+ */
+int Jffs2Dump::getEntriesNum() const
+{
+  return (_tree == NULL) ? 0 : _tree->getEntriesNum();
+}
+
+int Jffs2Dump::getFilesNum() const
+{
+  return (_fs == NULL) ? 0 : _fs->getFilesNum();
+}
+
+int Jffs2Dump::findPath(const string &path) const
+{
+  return (_tree == NULL) ? -1 : _tree->findPath(path);
+}
+
+int Jffs2Dump::findInode(uint64_t inode_num) const
+{
+  return (_tree == NULL) ? -1 : _tree->findInode(inode_num);
+}
+
+/**
+ * A file designated by its path, or by its inode number, -1 if there
+ * is none
+ */
+int Jffs2Dump::findFile(const string &path_or_ino) const
+{
+  int entry;
+
+  if(path_or_ino.empty())
+    return -1;
+  if(path_or_ino.find_first_not_of("0123456789") == string::npos)
+    entry = findInode(strtoull(path_or_ino.c_str(), NULL, 10));
+  else
+    entry = findPath(path_or_ino);
+
+  if(entry == -1 || _tree->getFile(entry) == NULL)
+    return -1;
+  return entry;
+}
+
+string Jffs2Dump::getPath(int entry) const
+{
+  if(_tree == NULL || entry < 0 || entry >= _tree->getEntriesNum())
+    return "";
+  return _tree->getPath(entry);
+}
+
+bool Jffs2Dump::isDeleted(int entry) const
+{
+  File *f = (_tree == NULL || entry < 0 || entry >= _tree->getEntriesNum()) ? NULL :
+    _tree->getFile(entry);
+
+  return f != NULL && f->isDeleted();
+}
+
+/**
+ * Every query metric of one file, -1 if entry is not a file
+ */
+int Jffs2Dump::getFileMetrics(int entry, file_metrics_t &res) const
+{
+  File *f = (_tree == NULL || entry < 0 || entry >= _tree->getEntriesNum()) ? NULL :
+    _tree->getFile(entry);
+
+  if(f == NULL)
+    return -1;
+  res.computed = 0;
+  for(int m=0; m<METRIC_NUM; m++)
+    getMetric(*f, (metric_t)m, res);
+
+  return 0;
+}
+
+/**
+ * Flash pages read by the readpages of the linux pages holding
+ * [offset, offset+size), the part beyond the end of file is not read.
+ * Return -1 if entry is not a file.
+ */
+int Jffs2Dump::getReadCost(int entry, uint64_t offset, uint64_t size, int &readpages_num) const
+{
+  File *f = (_tree == NULL || entry < 0 || entry >= _tree->getEntriesNum()) ? NULL :
+    _tree->getFile(entry);
+  uint64_t end = offset + size;
+  int res = 0;
+
+  readpages_num = 0;
+  if(f == NULL)
+    return -1;
+  if(f->isDeleted() || size == 0 || offset >= f->getSize())
+    return 0;
+  if(end > f->getSize())
+    end = f->getSize();
+
+  for(int p=offset/LINUX_PAGE_SIZE; p<=(int)((end-1)/LINUX_PAGE_SIZE); p++)
+  {
+    res += f->getLinuxPageReadCost(p);
+    readpages_num++;
+  }
+
+  return res;
+}
+
+/**
+ * Same range in the kernel readpage model, the work of its readpages
+ * summed. Return -1 if entry is not a file.
+ */
+int Jffs2Dump::getReadWork(int entry, uint64_t offset, uint64_t size, readpage_work_t &res) const
+{
+  File *f = (_tree == NULL || entry < 0 || entry >= _tree->getEntriesNum()) ? NULL :
+    _tree->getFile(entry);
+  uint64_t end = offset + size;
+
+  memset(&res, 0, sizeof(res));
+  if(f == NULL)
+    return -1;
+  if(f->isDeleted() || size == 0 || offset >= f->getSize())
+    return 0;
+  if(end > f->getSize())
+    end = f->getSize();
+
+  for(int p=offset/LINUX_PAGE_SIZE; p<=(int)((end-1)/LINUX_PAGE_SIZE); p++)
+  {
+    readpage_work_t work;
+    f->getLinuxPageReadWork(p, work);
+    addReadpageWork(res, work);
+  }
+
+  return 0;
+}
+
+/**
+ * Indexes of the flash pages read by the readpage of one linux page of
+ * a file
+ */
+int Jffs2Dump::getFlashPagesReadForLinuxPage(int entry, int linux_page_index,
+  vector<int> &res) const
+{
+  File *f = (_tree == NULL || entry < 0 || entry >= _tree->getEntriesNum()) ? NULL :
+    _tree->getFile(entry);
+
+  res.clear();
+  if(f == NULL || f->isDeleted() || f->getSize() == 0 || linux_page_index < 0 ||
+    linux_page_index >= f->getLinuxPagesNum())
+    return -1;
+  res = f->getFlashPagesReadForLinuxPage(linux_page_index);
+
+  return 0;
+}
+
+/**
+ * Run a query written as for the -q option, return the number of
+ * matching files or -1 if the query is invalid
+ */
+int Jffs2Dump::query(const string &str, vector<query_result_t> &res) const
+{
+  vector<char> buf(str.begin(), str.end());
+  query_t q;
+
+  res.clear();
+  buf.push_back('\0');
+  if(_tree == NULL || parseQuery(&buf[0], q) < 0)
+    return -1;
+
+  return runQuery(*_tree, q, res);
+}
+
+void Jffs2Dump::findPage(uint32_t page_index, vector<const node_extent_t *> &res) const
+{
+  if(_index != NULL)
+    _index->findPage(page_index, res);
+}
+
+void Jffs2Dump::findBlock(uint32_t block_index, vector<const node_extent_t *> &res) const
+{
+  if(_index != NULL)
+    _index->findBlock(block_index, res);
+}
+
+const dump_summary_t &Jffs2Dump::getSummary() const
+{
+  return _summary;
+}
+
+const vector<Chunk *> &Jffs2Dump::getChunks() const
+{
+  return _chunks;
+}
+
+const FileSet &Jffs2Dump::getFileSet() const
+{
+  return *_fs;
+}
+
+const DirTree &Jffs2Dump::getTree() const
+{
+  return *_tree;
+}
+
+const FlashIndex &Jffs2Dump::getIndex() const
+{
+  return *_index;
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Compute every lazily cached metric of the files, so that concurrent
+ * callers only read them
+ */
+void warmFileMetrics(FileSet &fs)
+{
+  for(int i=0; i<fs.getFilesNum(); i++)
+  {
+    File *f = fs.getFile(i);
+
+    f->getTheoriticalPageNum();
+    f->getConcernedPages().getPagesNum();
+    if(f->isDeleted() || f->getSize() == 0)
+      continue;
+    f->getSequentialReadCost();
+    if(f->getSize() > 1)
+      f->getContiguousFactor();
+    for(int p=0; p<f->getLinuxPagesNum(); p++)
+      f->getLinuxPageReadCost(p);
+  }
+}
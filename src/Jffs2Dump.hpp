@@ -0,0 +1,70 @@
+#ifndef JFFS2_DUMP_HPP
+#define JFFS2_DUMP_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "FlashGeometry.hpp"
+#include "ChunkModel.hpp"
+#include "File.hpp"
+#include "DirTree.hpp"
+#include "FlashIndex.hpp"
+#include "Summary.hpp"
+#include "Query.hpp"
+
+/**
+ * Entry point of libjffs2dparser : one dump parsed into the chunk model,
+ * with its file set, directory tree, flash index and summary built by
+ * load. Every lazily computed metric is computed there too, so once
+ * loaded a dump is only read and its const methods can be called from
+ * several threads at once. Files are designated by their DirTree entry.
+ */
+class Jffs2Dump
+{
+  public:
+    Jffs2Dump(FlashGeometry &geometry);
+    ~Jffs2Dump();
+    int load(const char *path);
+
+    std::string getName() const;
+    FlashGeometry getGeometry() const;
+    int getEntriesNum() const;
+    int getFilesNum() const;
+    int findPath(const std::string &path) const;
+    int findInode(uint64_t inode_num) const;
+    int findFile(const std::string &path_or_ino) const;
+    std::string getPath(int entry) const;
+    bool isDeleted(int entry) const;
+    int getFileMetrics(int entry, file_metrics_t &res) const;
+    int getReadCost(int entry, uint64_t offset, uint64_t size, int &readpages_num) const;
+    int getReadWork(int entry, uint64_t offset, uint64_t size, readpage_work_t &res) const;
+    int getFlashPagesReadForLinuxPage(int entry, int linux_page_index, std::vector<int> &res) const;
+    int query(const std::string &str, std::vector<query_result_t> &res) const;
+    void findPage(uint32_t page_index, std::vector<const node_extent_t *> &res) const;
+    void findBlock(uint32_t block_index, std::vector<const node_extent_t *> &res) const;
+    const dump_summary_t &getSummary() const;
+
+    // the underlying model, read only like the rest of a loaded dump
+    const std::vector<Chunk *> &getChunks() const;
+    const FileSet &getFileSet() const;
+    const DirTree &getTree() const;
+    const FlashIndex &getIndex() const;
+
+  private:
+    std::string _name;
+    FlashGeometry _geometry;
+    std::vector<Chunk *> _chunks;
+    FileSet *_fs;
+    DirTree *_tree;
+    FlashIndex *_index;
+    dump_summary_t _summary;
+
+    Jffs2Dump(const Jffs2Dump &other);
+    Jffs2Dump &operator=(const Jffs2Dump &other);
+    void clear();
+};
+
+void warmFileMetrics(FileSet &fs);
+
+#endif /* JFFS2_DUMP_HPP */
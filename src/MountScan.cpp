@@ -0,0 +1,247 @@
+#include <iomanip>
+#include <climits>
+
+#include "MountScan.hpp"
+
+using namespace std;
+
+// on-flash sizes of the summary structures (include/linux/jffs2.h, fs/jffs2/summary.h)
+#define JFFS2_SUMMARY_HEADER_SIZE		32
+#define JFFS2_SUMMARY_MARKER_SIZE		8
+#define JFFS2_SUMMARY_INODE_SIZE		18
+#define JFFS2_SUMMARY_DIRENT_SIZE		24	// name excluded
+#define JFFS2_MAX_NODE_SIZE			(4096+68)
+
+/**************************** MountScan *******************************/
+
+MountScan::MountScan(vector<Chunk *> &chunk_list, FlashGeometry &geometry, double page_read_us)
+  : _geometry(geometry)
+{
+  uint32_t first_block = UINT_MAX, last_block = 0;
+  uint32_t ppb = _geometry.getNumPagesPerBlock();
+
+  _page_read_us = page_read_us;
+  _full_cost = _summary_cost = _predicted_cost = 0;
+
+  // find the range of blocks covered by the dump
+  for(int i=0; i<(int)chunk_list.size(); i++)
+  {
+    uint32_t first, last;
+
+    switch(chunk_list[i]->getType())
+    {
+      case FREE_SPACE:
+      {
+	FreeSpaceChunk *fsc = static_cast<FreeSpaceChunk *>(chunk_list[i]);
+	if(fsc->getSize() == 0)
+	  continue;
+	first = fsc->getStart().getFlashBlock();
+	last = _geometry.getBlock(fsc->getEnd().getFlashOffset() - 1);
+	break;
+      }
+
+      case DATA_NODE:
+      case DIRENT_NODE:
+      {
+	Node *n = static_cast<Node *>(chunk_list[i]);
+	if(n->getFlashSize() == 0)
+	  continue;
+	first = n->getFirstFlashPage() / ppb;
+	last = n->getLastFlashPage() / ppb;
+	break;
+      }
+
+      case SUMMARY_NODE:
+      {
+	SummaryNode *sn = static_cast<SummaryNode *>(chunk_list[i]);
+	if(sn->getFlashSize() == 0)
+	  continue;
+	first = sn->getFirstFlashPage() / ppb;
+	last = sn->getLastFlashPage() / ppb;
+	break;
+      }
+
+      default:
+	continue;
+    }
+
+    first_block = min(first_block, first);
+    last_block = max(last_block, last);
+  }
+
+  if(first_block > last_block)
+    return;
+
+  _blocks.resize(last_block - first_block + 1);
+  for(int i=0; i<(int)_blocks.size(); i++)
+  {
+    block_scan_t &b = _blocks[i];
+    b.block = first_block + i;
+    b.nodes_num = b.used_pages = b.summary_pages = 0;
+    b.used_bytes = 0;
+    b.summary_size = JFFS2_SUMMARY_HEADER_SIZE + JFFS2_SUMMARY_MARKER_SIZE;
+    b.full_cost = b.summary_cost = b.predicted_cost = 0;
+  }
+
+  for(int i=0; i<(int)chunk_list.size(); i++)
+    switch(chunk_list[i]->getType())
+    {
+      case DATA_NODE:
+      {
+	DataNode *dn = static_cast<DataNode *>(chunk_list[i]);
+	add_node(dn->getFlashAddr().getFlashOffset(), dn->getFlashSize(),
+	  JFFS2_SUMMARY_INODE_SIZE);
+	break;
+      }
+
+      case DIRENT_NODE:
+      {
+	DirentNode *dn = static_cast<DirentNode *>(chunk_list[i]);
+	add_node(dn->getFlashAddr().getFlashOffset(), dn->getFlashSize(),
+	  JFFS2_SUMMARY_DIRENT_SIZE + dn->getName().size());
+	break;
+      }
+
+      case SUMMARY_NODE:
+      {
+	SummaryNode *sn = static_cast<SummaryNode *>(chunk_list[i]);
+	block_scan_t *b = getBlock(sn->getFirstFlashPage() / ppb);
+	if(sn->getFlashSize() != 0 && b != NULL)
+	  b->summary_pages += sn->getLastFlashPage() - sn->getFirstFlashPage() + 1;
+	break;
+      }
+
+      default:
+	break;
+    }
+
+  compute_costs();
+}
+
+/**
+ * Account a node in the block holding its first byte, nodes never cross
+ * block boundaries
+ */
+int MountScan::add_node(uint64_t offset, uint32_t size, int summary_entry_size)
+{
+  uint64_t block_size = _geometry.getBlockSize();
+  block_scan_t *b = getBlock(_geometry.getBlock(offset));
+
+  if(b == NULL || size == 0)
+    return -1;
+
+  b->nodes_num++;
+  b->used_bytes = max(b->used_bytes, (offset % block_size) + size);
+  b->summary_size += summary_entry_size;
+
+  return 0;
+}
+
+/**
+ * Full scan : the pages up to the last node, plus the next one where
+ * the scan finds the empty space (the cleanmarker page for an empty
+ * block).
+ * Summary scan : the sum marker at the end of the block is read first,
+ * then only the summary node if there is one, else the block is fully
+ * scanned.
+ * A block is taken as closed, thus holding a summary in the predicted
+ * scan, if the space left is too small for a full sized node.
+ */
+int MountScan::compute_costs()
+{
+  int ppb = _geometry.getNumPagesPerBlock();
+  int page_size = _geometry.getFlashPageSize();
+  uint64_t block_size = (uint64_t)ppb * page_size;
+  int marker_read = (ppb > 1) ? 1 : 0;
+
+  for(int i=0; i<(int)_blocks.size(); i++)
+  {
+    block_scan_t &b = _blocks[i];
+
+    b.used_pages = (b.used_bytes + page_size - 1) / page_size;
+    if(b.nodes_num == 0 && b.summary_pages == 0)
+    {
+      b.full_cost = 1;
+      b.summary_cost = b.predicted_cost = 1 + marker_read;
+    }
+    else
+    {
+      b.full_cost = b.used_pages + ((b.used_pages < ppb) ? 1 : 0);
+
+      if(b.summary_pages > 0)
+	b.summary_cost = b.summary_pages;
+      else
+	b.summary_cost = b.full_cost + marker_read;
+
+      if(b.summary_pages > 0)
+	b.predicted_cost = b.summary_pages;
+      else if(block_size - b.used_bytes < JFFS2_MAX_NODE_SIZE)
+	b.predicted_cost = (b.summary_size + page_size - 1) / page_size;
+      else
+	b.predicted_cost = b.full_cost + marker_read;
+    }
+
+    _full_cost += b.full_cost;
+    _summary_cost += b.summary_cost;
+    _predicted_cost += b.predicted_cost;
+  }
+
+  return 0;
+}
+
+block_scan_t * MountScan::getBlock(uint32_t block)
+{
+  if(_blocks.empty() || block < _blocks[0].block || block > _blocks.back().block)
+    return NULL;
+  return &(_blocks[block - _blocks[0].block]);
+}
+
+int MountScan::getFullScanCost()
+{
+  return _full_cost;
+}
+
+int MountScan::getSummaryScanCost()
+{
+  return _summary_cost;
+}
+
+int MountScan::getPredictedScanCost()
+{
+  return _predicted_cost;
+}
+
+vector<block_scan_t> & MountScan::getBlocks()
+{
+  return _blocks;
+}
+
+ostream& operator<<(ostream& os, MountScan& ms)
+{
+  int empty_blocks = 0;
+
+  for(int i=0; i<(int)ms._blocks.size(); i++)
+    if(ms._blocks[i].nodes_num == 0 && ms._blocks[i].summary_pages == 0)
+      empty_blocks++;
+
+  os << "MountScan estimate over " << ms._blocks.size() << " blocks (" << empty_blocks
+    << " empty), page read time " << ms._page_read_us << " us :" << endl;
+  os << "     block  nodes  used pages   full  summary  predicted" << endl;
+  for(int i=0; i<(int)ms._blocks.size(); i++)
+  {
+    block_scan_t &b = ms._blocks[i];
+    if(b.nodes_num == 0 && b.summary_pages == 0)
+      continue;
+    os << "  " << setw(8) << b.block << setw(7) << b.nodes_num << setw(12) << b.used_pages
+      << setw(7) << b.full_cost << setw(9) << b.summary_cost << setw(11) << b.predicted_cost << endl;
+  }
+
+  os << "Full scan : " << ms._full_cost << " pages, "
+    << ms._full_cost * ms._page_read_us / 1000.0 << " ms" << endl;
+  os << "Summary scan : " << ms._summary_cost << " pages, "
+    << ms._summary_cost * ms._page_read_us / 1000.0 << " ms" << endl;
+  os << "Predicted summary scan : " << ms._predicted_cost << " pages, "
+    << ms._predicted_cost * ms._page_read_us / 1000.0 << " ms" << endl;
+
+  return os;
+}
@@ -0,0 +1,52 @@
+#ifndef MOUNT_SCAN_HPP
+#define MOUNT_SCAN_HPP
+
+#include <iostream>
+#include <vector>
+
+#include "ChunkModel.hpp"
+
+/**
+ * Mount scan cost of one erase block, in flash pages read
+ */
+typedef struct
+{
+  uint32_t block;
+  int nodes_num;
+  int used_pages;			// pages up to the last one holding a node
+  uint64_t used_bytes;			// bytes up to the end of the last node
+  int summary_pages;			// pages of the summary node, 0 if none
+  int summary_size;			// predicted summary size, in bytes
+  int full_cost;			// full scan
+  int summary_cost;			// scan using the summary nodes of the dump
+  int predicted_cost;			// scan if every closed block had a summary
+} block_scan_t;
+
+/**
+ * Estimate of the flash pages read at mount time to build the inode
+ * cache, for a full scan (no summary), using the summary nodes present
+ * in the dump, and predicted as if summaries were enabled.
+ */
+class MountScan
+{
+  public:
+    MountScan(std::vector<Chunk *> &chunk_list, FlashGeometry &geometry, double page_read_us);
+    int getFullScanCost();
+    int getSummaryScanCost();
+    int getPredictedScanCost();
+    std::vector<block_scan_t> &getBlocks();
+
+  private:
+    std::vector<block_scan_t> _blocks;		// every block covered by the dump
+    FlashGeometry _geometry;
+    double _page_read_us;
+    int _full_cost, _summary_cost, _predicted_cost;
+
+    block_scan_t *getBlock(uint32_t block);
+    int add_node(uint64_t offset, uint32_t size, int summary_entry_size);
+    int compute_costs();
+
+  friend std::ostream& operator<<(std::ostream& os, MountScan& ms);
+};
+
+#endif /* MOUNT_SCAN_HPP */
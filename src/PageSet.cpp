@@ -0,0 +1,178 @@
+#include <algorithm>
+
+#include "PageSet.hpp"
+
+using namespace std;
+
+/****************************** PageSet *******************************/
+
+PageSet::PageSet()
+{
+  _normalized = true;
+  _pages_num = 0;
+}
+
+void PageSet::add(uint32_t page)
+{
+  addRange(page, page);
+}
+
+void PageSet::addRange(uint32_t first_page, uint32_t last_page)
+{
+  page_run_t run;
+
+  if(last_page < first_page)
+    return;
+
+  // nodes are mostly added in flash order, extend the last run if we can
+  if(_normalized && !_runs.empty() && first_page >= _runs.back().first
+    && first_page <= _runs.back().last + 1)
+  {
+    if(last_page > _runs.back().last)
+    {
+      _pages_num += last_page - _runs.back().last;
+      _runs.back().last = last_page;
+    }
+    return;
+  }
+
+  run.first = first_page;
+  run.last = last_page;
+  _normalized = _normalized && (_runs.empty() || first_page > _runs.back().last + 1);
+  if(_normalized)
+    _pages_num += last_page - first_page + 1;
+  _runs.push_back(run);
+}
+
+void PageSet::unite(PageSet &other)
+{
+  for(int i=0; i<(int)other._runs.size(); i++)
+    addRange(other._runs[i].first, other._runs[i].last);
+}
+
+void PageSet::clear()
+{
+  _runs.clear();
+  _normalized = true;
+  _pages_num = 0;
+}
+
+bool PageSet::contains(uint32_t page)
+{
+  int low = 0, high;
+
+  normalize();
+  high = (int)_runs.size() - 1;
+  while(low <= high)
+  {
+    int mid = (low + high) / 2;
+    if(page < _runs[mid].first)
+      high = mid - 1;
+    else if(page > _runs[mid].last)
+      low = mid + 1;
+    else
+      return true;
+  }
+
+  return false;
+}
+
+int PageSet::getPagesNum()
+{
+  normalize();
+  return _pages_num;
+}
+
+/**
+ * Number of maximal ranges of consecutive pages
+ */
+int PageSet::getRunsNum()
+{
+  normalize();
+  return _runs.size();
+}
+
+/**
+ * Number of erase blocks holding at least one page of the set
+ */
+int PageSet::getBlocksNum(uint32_t pages_per_block)
+{
+  int res = 0;
+  int last_block = -1;
+
+  normalize();
+  for(int i=0; i<(int)_runs.size(); i++)
+  {
+    int first = _runs[i].first / pages_per_block;
+    int last = _runs[i].last / pages_per_block;
+
+    // the first block may be shared with the previous run
+    if(first == last_block)
+      first++;
+    if(last >= first)
+      res += last - first + 1;
+    last_block = last;
+  }
+
+  return res;
+}
+
+/**
+ * Every page of the set, in increasing order
+ */
+vector<int> PageSet::getPages()
+{
+  vector<int> res;
+
+  normalize();
+  res.reserve(_pages_num);
+  for(int i=0; i<(int)_runs.size(); i++)
+    for(uint32_t p=_runs[i].first; p<=_runs[i].last; p++)
+      res.push_back(p);
+
+  return res;
+}
+
+/**
+ * Sort the runs and merge the overlapping or adjacent ones
+ */
+void PageSet::normalize()
+{
+  int out = 0;
+
+  if(_normalized || _runs.empty())
+    return;
+
+  sort(_runs.begin(), _runs.end(), compareRuns);
+  for(int i=1; i<(int)_runs.size(); i++)
+  {
+    if(_runs[i].first <= _runs[out].last + 1)
+      _runs[out].last = max(_runs[out].last, _runs[i].last);
+    else
+      _runs[++out] = _runs[i];
+  }
+  _runs.resize(out + 1);
+
+  _pages_num = 0;
+  for(int i=0; i<(int)_runs.size(); i++)
+    _pages_num += _runs[i].last - _runs[i].first + 1;
+  _normalized = true;
+}
+
+bool PageSet::compareRuns(const page_run_t &a, const page_run_t &b)
+{
+  return a.first < b.first;
+}
+
+ostream& operator<<(ostream& os, PageSet& ps)
+{
+  ps.normalize();
+  for(int i=0; i<(int)ps._runs.size(); i++)
+  {
+    os << ((i) ? "," : "") << ps._runs[i].first;
+    if(ps._runs[i].last != ps._runs[i].first)
+      os << "-" << ps._runs[i].last;
+  }
+
+  return os;
+}
@@ -0,0 +1,47 @@
+#ifndef PAGE_SET_HPP
+#define PAGE_SET_HPP
+
+#include <iostream>
+#include <vector>
+
+#include "FlashAddr.hpp"
+
+/**
+ * Set of flash page indexes stored as sorted, disjoint and non adjacent
+ * runs of pages. Runs are appended as they come and merged on the first
+ * query, so building the set of a file is O(n log n) in its number of
+ * nodes, and counting is O(runs).
+ */
+class PageSet
+{
+  public:
+    PageSet();
+
+    void add(uint32_t page);
+    void addRange(uint32_t first_page, uint32_t last_page);
+    void unite(PageSet &other);
+    void clear();
+    bool contains(uint32_t page);
+    int getPagesNum();
+    int getRunsNum();
+    int getBlocksNum(uint32_t pages_per_block);
+    std::vector<int> getPages();
+
+  private:
+    typedef struct
+    {
+      uint32_t first;
+      uint32_t last;
+    } page_run_t;
+
+    std::vector<page_run_t> _runs;
+    bool _normalized;
+    int _pages_num;
+
+    void normalize();
+    static bool compareRuns(const page_run_t &a, const page_run_t &b);
+
+  friend std::ostream& operator<<(std::ostream& os, PageSet& ps);
+};
+
+#endif /* PAGE_SET_HPP */
@@ -1,77 +1,172 @@
 #include <string.h>
 
 #include "Parser.hpp"
+#include "Stats.hpp"
+#include "Input.hpp"
 
-int insertDataNodeInVector(DataNode *dn, vector<Chunk *> &vec);
+using namespace std;
 
-int parseStdIn(vector<Chunk *> &res)
+int parseInPhases(istream &in, vector<Chunk *> &res, FlashGeometry &geometry, RunStats *stats);
+
+int parseStdIn(vector<Chunk *> &res, FlashGeometry &geometry)
 {
-  char line[256];
+  char path[] = "-";
   
-  while(cin.getline(line, 256))
-    if(line[0] != '#' && line[0] != 'W')
-      if(parseLine(line, res) < 0)
-      {
-	cerr << "Error parsing this line :" << endl;
-	cerr << "  \"" << line << "\"" << endl;
-	return -1;
-      }
-  return 0;
+  return parseFile(path, res, geometry);
 }
 
-int parseFile(char *path, vector<Chunk *> &res)
+/**
+ * Parse a dump, "-" for stdin, gzip, xz and zstd dumps are decompressed
+ * on the fly
+ */
+int parseFile(char *path, vector<Chunk *> &res, FlashGeometry &geometry)
 {
   char line[256];
-  ifstream parsed_file(path);
+  istream *parsed_file = openDump(path);
+  int ret = 0;
   
-  if(!parsed_file)
-  {
-    cerr << "Can't open " << path << endl;
+  if(parsed_file == NULL)
     return -1;
-  }
-
-    while(parsed_file.getline(line, 256))
+  if(getRunStats() != NULL)
+    ret = parseInPhases(*parsed_file, res, geometry, getRunStats());
+  else
+    while(ret == 0 && parsed_file->getline(line, 256))
       if(line[0] != '#' && line[0] != 'W')
-	if(parseLine(line, res) < 0)
+	if(parseLine(line, res, geometry) < 0)
 	{
-	  cout << line[0] << endl;
 	  cerr << "Error parsing this line :" << endl;
 	  cerr << "  \"" << line << "\"" << endl;
-	  return -1;
+	  ret = -1;
 	}
   
-  parsed_file.close();
+  if(closeDump(parsed_file) < 0)
+    ret = -1;
+  
+  return ret;
+}
+
+int parseLine(string line, vector<Chunk *> &res, FlashGeometry &geometry)
+{
+  Chunk *c = NULL;
+  
+  if(parseChunk(line, &c, geometry) < 0)
+    return -1;
+  
+  if(c->getType() == DATA_NODE)
+  {
+    if(insertDataNodeInVector(static_cast<DataNode *>(c), res))
+      delete(c);
+  }
+  else
+    res.push_back(c);
   
   return 0;
 }
 
-int parseLine(string line, vector<Chunk *> &res)
+/**
+ * Same result as parseLine on each line, but the lines are read, parsed
+ * and their duplicates removed by batches of PARSER_STATS_BATCH_LINES so
+ * that each step is timed while only one batch is held in memory
+ */
+int parseInPhases(istream &in, vector<Chunk *> &res, FlashGeometry &geometry, RunStats *stats)
+{
+  vector<string> lines;
+  vector<Chunk *> chunks;
+  char line[256];
+  uint64_t types_num[4] = {0, 0, 0, 0};
+  uint64_t lines_num = 0, dropped_num = 0;
+  bool eof = false;
+  int ret = 0;
+  
+  while(!eof && ret == 0)
+  {
+    lines.clear();
+    chunks.clear();
+    
+    stats->startPhase("read");
+    while((int)lines.size() < PARSER_STATS_BATCH_LINES && !(eof = !in.getline(line, 256)))
+      if(line[0] != '#' && line[0] != 'W')
+	lines.push_back(line);
+    stats->endPhase();
+    lines_num += lines.size();
+    
+    stats->startPhase("parse");
+    for(int i=0; i<(int)lines.size() && ret == 0; i++)
+    {
+      Chunk *c = NULL;
+      if(parseChunk(lines[i], &c, geometry) < 0)
+      {
+	cerr << "Error parsing this line :" << endl;
+	cerr << "  \"" << lines[i] << "\"" << endl;
+	ret = -1;
+      }
+      else
+      {
+	chunks.push_back(c);
+	types_num[c->getType()]++;
+      }
+    }
+    stats->endPhase();
+    
+    stats->startPhase("dedupe");
+    for(int i=0; i<(int)chunks.size(); i++)
+      if(chunks[i]->getType() != DATA_NODE)
+	res.push_back(chunks[i]);
+      else if(insertDataNodeInVector(static_cast<DataNode *>(chunks[i]), res))
+      {
+	delete chunks[i];
+	dropped_num++;
+      }
+    stats->endPhase();
+  }
+  
+  stats->count("lines", lines_num);
+  stats->count("free_chunks", types_num[FREE_SPACE]);
+  stats->count("data_nodes", types_num[DATA_NODE]);
+  stats->count("dirent_nodes", types_num[DIRENT_NODE]);
+  stats->count("summary_nodes", types_num[SUMMARY_NODE]);
+  stats->count("duplicates_dropped", dropped_num);
+  
+  return ret;
+}
+
+/**
+ * Build the chunk described by one line of the dump
+ */
+int parseChunk(string line, Chunk **res, FlashGeometry &geometry)
 {
   string free_space_start = "Empty space";
   string data_node_start = "         Inode";
   string dirent_node_start = "         Dirent";
+  string summary_node_start = "         Summary";
   
   if (!line.compare(0, free_space_start.size(), free_space_start))
   {
     FreeSpaceChunk *fsc = new FreeSpaceChunk();
-    if(fsc->build(line) < 0)
+    if(fsc->build(line, geometry) < 0)
       return -1;
-    res.push_back(fsc);
+    *res = fsc;
   }
   else if (!line.compare(0, data_node_start.size(), data_node_start))
   {
     DataNode *dn = new DataNode;
-    if(dn->build(line) < 0)
+    if(dn->build(line, geometry) < 0)
       return -1;
-    if(insertDataNodeInVector(dn, res))
-      delete(dn);
+    *res = dn;
   }
   else if (!line.compare(0, dirent_node_start.size(), dirent_node_start))
   {
     DirentNode *dn = new DirentNode;
-    if(dn->build(line) < 0)
+    if(dn->build(line, geometry) < 0)
+      return -1;
+    *res = dn;
+  }
+  else if (!line.compare(0, summary_node_start.size(), summary_node_start))
+  {
+    SummaryNode *sn = new SummaryNode;
+    if(sn->build(line, geometry) < 0)
       return -1;
-    res.push_back(dn);
+    *res = sn;
   }
   else
   {
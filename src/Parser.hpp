@@ -6,10 +6,12 @@
 
 #include "ChunkModel.hpp" 
 
-using namespace std;
+#define PARSER_STATS_BATCH_LINES		4096	// lines held at once when the phases are timed
 
-int parseStdIn(vector<Chunk *> &res);
-int parseFile(char *path, vector<Chunk *> &res);
-int parseLine(string line, vector<Chunk *> &res);
+int parseStdIn(std::vector<Chunk *> &res, FlashGeometry &geometry);
+int parseFile(char *path, std::vector<Chunk *> &res, FlashGeometry &geometry);
+int parseLine(std::string line, std::vector<Chunk *> &res, FlashGeometry &geometry);
+int parseChunk(std::string line, Chunk **res, FlashGeometry &geometry);
+int insertDataNodeInVector(DataNode *dn, std::vector<Chunk *> &vec);
 
 #endif /* PARSER_HPP */
@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <sys/stat.h>
+
+#include "Partition.hpp"
+#include "Parser.hpp"
+#include "Batch.hpp"
+#include "Input.hpp"
+
+using namespace std;
+
+// memory footprint estimate of a chunk, as the size of its dump line
+#define CHUNK_DUMP_LINE_SIZE			120
+
+bool comparePartitionsByOffset(const mtd_partition_t &a, const mtd_partition_t &b);
+uint64_t getChunkOffset(Chunk *c);
+uint64_t getChunkEnd(Chunk *c);
+int splitFreeSpace(FreeSpaceChunk *fsc, FlashGeometry &geometry,
+  vector<mtd_partition_t> &partitions, vector<vector<Chunk *> > &res);
+bool compareJobsByIndex(const batch_job_t &a, const batch_job_t &b);
+int findPartition(uint64_t offset, vector<mtd_partition_t> &partitions);
+void freePartitionChunks(vector<vector<Chunk *> > &split);
+
+/***************************** Partitions *****************************/
+
+/**
+ * Read a partition table, one partition per line, either as
+ *   <name> <offset> <size> [<dump>]
+ * with decimal or 0x prefixed hex numbers, or as a copy of /proc/mtd
+ * where the partitions follow each other from offset 0 :
+ *   mtd0: 00780000 00020000 "name"
+ */
+int parsePartitionTable(char *path, vector<mtd_partition_t> &res)
+{
+  ifstream in(path);
+  string line;
+  uint64_t next_offset = 0;
+
+  if(!in)
+  {
+    cerr << "Can't open " << path << endl;
+    return -1;
+  }
+
+  while(getline(in, line))
+  {
+    stringstream ss(line);
+    string first, second, third;
+    mtd_partition_t p;
+
+    if(!(ss >> first) || first[0] == '#' || first == "dev:")
+      continue;
+
+    if(first.compare(0, 3, "mtd") == 0 && first[first.size()-1] == ':')
+    {
+      ss >> second >> third;
+      getline(ss, p.name);
+      p.name.erase(0, p.name.find_first_not_of(" \t\""));
+      p.name.erase(p.name.find_last_not_of(" \t\"") + 1);
+      p.offset = next_offset;
+      p.size = strtoull(second.c_str(), NULL, 16);
+    }
+    else
+    {
+      ss >> second >> third;
+      p.name = first;
+      if(parseOffset(second, p.offset) < 0 || parseOffset(third, p.size) < 0)
+      {
+	cerr << "Error, invalid partition line : " << line << endl;
+	return -1;
+      }
+      ss >> p.dump_path;
+    }
+
+    if(p.size == 0)
+    {
+      cerr << "Error, empty partition : " << line << endl;
+      return -1;
+    }
+    next_offset = p.offset + p.size;
+    res.push_back(p);
+  }
+
+  stable_sort(res.begin(), res.end(), comparePartitionsByOffset);
+  for(int i=1; i<(int)res.size(); i++)
+    if(res[i].offset < res[i-1].offset + res[i-1].size)
+    {
+      cerr << "Error, partitions " << res[i-1].name << " and " << res[i].name << " overlap" << endl;
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * Parse a whole chip dump (stdin if path is "-") into one chunk list per
+ * partition. The free space chunks are cut at the partition boundaries,
+ * the nodes crossing one are dropped with a warning as no partition
+ * holds them whole. Inode numbers are per partition so the duplicated
+ * data nodes are only searched within a partition. Return the number of
+ * chunks out of every partition, -1 on error.
+ */
+int parseChipDump(char *path, FlashGeometry &geometry, vector<mtd_partition_t> &partitions,
+  vector<vector<Chunk *> > &res)
+{
+  istream *in = openDump(path);
+  string line;
+  int outside = 0;
+
+  res.clear();
+  res.resize(partitions.size());
+  if(in == NULL)
+    return -1;
+
+  while(getline(*in, line))
+  {
+    Chunk *c = NULL;
+    int p;
+
+    if(line.empty() || line[0] == '#' || line[0] == 'W')
+      continue;
+    if(parseChunk(line, &c, geometry) < 0)
+    {
+      cerr << "Error parsing this line :" << endl;
+      cerr << "  \"" << line << "\"" << endl;
+      closeDump(in);
+      return -1;
+    }
+
+    if(c->getType() == FREE_SPACE)
+    {
+      if(splitFreeSpace(static_cast<FreeSpaceChunk *>(c), geometry, partitions, res) == 0)
+	outside++;
+      continue;
+    }
+
+    p = findPartition(getChunkOffset(c), partitions);
+    if(p == -1)
+    {
+      outside++;
+      delete c;
+    }
+    else if(getChunkEnd(c) > partitions[p].offset + partitions[p].size)
+    {
+      cerr << "Warning, chunk at 0x" << hex << getChunkOffset(c) << dec
+	<< " crosses the end of partition " << partitions[p].name << ", ignored" << endl;
+      outside++;
+      delete c;
+    }
+    else if(c->getType() != DATA_NODE)
+      res[p].push_back(c);
+    else if(insertDataNodeInVector(static_cast<DataNode *>(c), res[p]))
+      delete c;
+  }
+
+  if(closeDump(in) < 0)
+    return -1;
+  return outside;
+}
+
+/**
+ * Give each partition the part of a free space chunk it holds, as a
+ * chunk of its own if the chunk is cut. Return the number of parts.
+ */
+int splitFreeSpace(FreeSpaceChunk *fsc, FlashGeometry &geometry,
+  vector<mtd_partition_t> &partitions, vector<vector<Chunk *> > &res)
+{
+  uint64_t start = fsc->getStart().getFlashOffset();
+  uint64_t end = fsc->getEnd().getFlashOffset();
+  int parts = 0;
+
+  for(int i=0; i<(int)partitions.size(); i++)
+  {
+    uint64_t p_start = max(start, partitions[i].offset);
+    uint64_t p_end = min(end, partitions[i].offset + partitions[i].size);
+    stringstream line;
+    FreeSpaceChunk *part;
+
+    if(p_start >= p_end)
+      continue;
+    parts++;
+    if(p_start == start && p_end == end)
+    {
+      res[i].push_back(fsc);
+      return parts;
+    }
+
+    // built as parsed, the line offsets are relative to the partition offset
+    line << "Empty space found from 0x" << hex << p_start - geometry.getPartitionOffset()
+      << " to 0x" << p_end - geometry.getPartitionOffset();
+    part = new FreeSpaceChunk();
+    part->build(line.str(), geometry);
+    res[i].push_back(part);
+  }
+
+  delete fsc;
+  return parts;
+}
+
+/**
+ * Index of the partition holding offset, -1 if none
+ */
+int findPartition(uint64_t offset, vector<mtd_partition_t> &partitions)
+{
+  int low = 0, high = (int)partitions.size() - 1;
+
+  while(low <= high)
+  {
+    int mid = (low + high) / 2;
+    if(offset < partitions[mid].offset)
+      high = mid - 1;
+    else if(offset >= partitions[mid].offset + partitions[mid].size)
+      low = mid + 1;
+    else
+      return mid;
+  }
+
+  return -1;
+}
+
+int runPartitions(char *chip_dump, char *table, FlashGeometry &geometry, int threads_num,
+  uint64_t memory_budget, ostream &os)
+{
+  vector<mtd_partition_t> partitions;
+  vector<vector<Chunk *> > split;
+  vector<batch_job_t> jobs;
+  dump_summary_t chip;
+  stringstream done_rows;
+  bool need_chip_dump = false;
+  int failed = 0, ret = 0;
+
+  if(parsePartitionTable(table, partitions) < 0)
+    return -1;
+  if(partitions.empty())
+  {
+    cerr << "Error, no partition in " << table << endl;
+    return -1;
+  }
+
+  for(int i=0; i<(int)partitions.size(); i++)
+    need_chip_dump = need_chip_dump || partitions[i].dump_path.empty();
+
+  // the chip dump offsets are relative to the chip start
+  if(need_chip_dump)
+  {
+    int outside = parseChipDump(chip_dump, geometry, partitions, split);
+
+    if(outside < 0)
+    {
+      cerr << "Error parsing " << chip_dump << endl;
+      freePartitionChunks(split);
+      return -1;
+    }
+    if(outside > 0)
+      cerr << "Warning, " << outside << " chunks out of every partition are ignored" << endl;
+  }
+  split.resize(partitions.size());
+
+  os << "Partitions :" << endl;
+  for(int i=0; i<(int)partitions.size(); i++)
+  {
+    mtd_partition_t &p = partitions[i];
+    batch_job_t job;
+    struct stat st;
+
+    job.name = p.name;
+    job.index = i;
+    if(p.dump_path.empty())
+    {
+      job.chunks = &(split[i]);
+      job.geometry = geometry;
+      job.size = split[i].size() * CHUNK_DUMP_LINE_SIZE;
+    }
+    else
+    {
+      // a partition dump has offsets relative to the partition start
+      job.path = p.dump_path;
+      job.chunks = NULL;
+      job.geometry = FlashGeometry(geometry.getFlashPageSize(), geometry.getNumPagesPerBlock(),
+	geometry.getPartitionOffset() + p.offset);
+      job.size = (stat(p.dump_path.c_str(), &st) == 0) ? st.st_size : 0;
+    }
+    jobs.push_back(job);
+
+    os << "  " << left << setw(16) << p.name << right << " 0x" << hex << setw(8) << setfill('0')
+      << p.offset << " - 0x" << setw(8) << p.offset + p.size << dec << setfill(' ')
+      << " (" << p.size / geometry.getBlockSize() << " blocks) "
+      << ((p.dump_path.empty()) ? "from the chip dump" : p.dump_path) << endl;
+  }
+  os << endl;
+
+  // the rows are printed once every partition is done, in table order
+  printSummaryHeader(os);
+  if(runBatchJobs(jobs, threads_num, memory_budget, done_rows) < 0)
+    ret = -1;
+  else
+  {
+    stable_sort(jobs.begin(), jobs.end(), compareJobsByIndex);
+    memset(&chip, 0, sizeof(chip));
+    chip.page_size = geometry.getFlashPageSize();
+    for(int i=0; i<(int)jobs.size(); i++)
+      if(jobs[i].ok)
+      {
+	printSummaryRow(os, jobs[i].name, jobs[i].summary);
+	addDumpSummary(chip, jobs[i].summary);
+      }
+      else
+	failed++;
+    printSummaryRow(os, "chip", chip);
+    if(failed)
+    {
+      cerr << failed << " partition(s) failed" << endl;
+      ret = -1;
+    }
+  }
+
+  freePartitionChunks(split);
+  return ret;
+}
+
+void freePartitionChunks(vector<vector<Chunk *> > &split)
+{
+  for(int i=0; i<(int)split.size(); i++)
+    for(int j=0; j<(int)split[i].size(); j++)
+      delete split[i][j];
+  split.clear();
+}
+
+bool comparePartitionsByOffset(const mtd_partition_t &a, const mtd_partition_t &b)
+{
+  return a.offset < b.offset;
+}
+
+bool compareJobsByIndex(const batch_job_t &a, const batch_job_t &b)
+{
+  return a.index < b.index;
+}
+
+/**
+ * Flash offset of the first byte of a chunk
+ */
+uint64_t getChunkOffset(Chunk *c)
+{
+  switch(c->getType())
+  {
+    case FREE_SPACE:
+      return static_cast<FreeSpaceChunk *>(c)->getStart().getFlashOffset();
+    case DATA_NODE:
+    case DIRENT_NODE:
+      return static_cast<Node *>(c)->getFlashAddr().getFlashOffset();
+    case SUMMARY_NODE:
+      return static_cast<SummaryNode *>(c)->getFlashAddr().getFlashOffset();
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Flash offset after the last byte of a chunk
+ */
+uint64_t getChunkEnd(Chunk *c)
+{
+  switch(c->getType())
+  {
+    case FREE_SPACE:
+      return static_cast<FreeSpaceChunk *>(c)->getEnd().getFlashOffset();
+    case DATA_NODE:
+    case DIRENT_NODE:
+      return getChunkOffset(c) + static_cast<Node *>(c)->getFlashSize();
+    case SUMMARY_NODE:
+      return getChunkOffset(c) + static_cast<SummaryNode *>(c)->getFlashSize();
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Parse a byte count in decimal, or in hex with a 0x prefix : a leading 0
+ * is not octal. Return -1 unless the whole string is such a number.
+ */
+int parseOffset(string str, uint64_t &res)
+{
+  const char *start = str.c_str();
+  char *end;
+  int base = 10;
+
+  if(str.compare(0, 2, "0x") == 0 || str.compare(0, 2, "0X") == 0)
+  {
+    start += 2;
+    base = 16;
+  }
+  if(!isxdigit(*start))
+    return -1;
+
+  errno = 0;
+  res = strtoull(start, &end, base);
+  if(*end != '\0' || errno == ERANGE)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "ChunkModel.hpp"
+
+/**
+ * One MTD partition of a chip, offsets in bytes from the chip start
+ */
+typedef struct
+{
+  std::string name;
+  uint64_t offset;
+  uint64_t size;
+  std::string dump_path;			// dump of this partition only, may be empty
+} mtd_partition_t;
+
+int parsePartitionTable(char *path, std::vector<mtd_partition_t> &res);
+int parseOffset(std::string str, uint64_t &res);
+int parseChipDump(char *path, FlashGeometry &geometry, std::vector<mtd_partition_t> &partitions,
+  std::vector<std::vector<Chunk *> > &res);
+
+/**
+ * Summarize every partition of a chip, in parallel within the memory
+ * budget, then the whole chip. The partitions without their own dump are
+ * taken from the whole chip dump chip_dump.
+ */
+int runPartitions(char *chip_dump, char *table, FlashGeometry &geometry, int threads_num,
+  uint64_t memory_budget, std::ostream &os);
+
+#endif /* PARTITION_HPP */
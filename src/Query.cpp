@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+
+#include "Query.hpp"
+
+using namespace std;
+
+static const char *metric_names[METRIC_NUM] = {"ino", "nodes", "size", "pages", "runs", "blocks", "frag",
+  "seqcost", "contig"};
+
+/**
+ * Heap order : the result to evict first, the least interesting one, is
+ * on top
+ */
+class ResultOrder
+{
+  public:
+    ResultOrder(metric_t metric, bool ascending) : _metric(metric), _ascending(ascending) {}
+    bool operator()(const query_result_t &a, const query_result_t &b) const
+    {
+      double va = a.metrics.values[_metric], vb = b.metrics.values[_metric];
+      if(va != vb)
+	return (_ascending) ? (va < vb) : (va > vb);
+      return a.entry < b.entry;
+    }
+
+  private:
+    metric_t _metric;
+    bool _ascending;
+};
+
+bool comparePredsByCost(const query_pred_t &a, const query_pred_t &b);
+bool matchPred(double value, query_pred_t &pred);
+bool matchPathPrefix(string path, string prefix);
+int parseMetric(string name, metric_t &res);
+
+/******************************* Query ********************************/
+
+/**
+ * Parse a comma separated list of terms :
+ *   <metric><op><value>  with op in < <= > >= = and an optional K, M or G
+ *                        suffix for the value
+ *   deleted, live        restrict to deleted or non deleted files
+ *   path=<prefix>        restrict to a subtree
+ *   top=<K>              keep the K first files only
+ *   by=<metric>, asc     order, decreasing by default
+ */
+int parseQuery(char *str, query_t &res)
+{
+  string content = str;
+  string term;
+  size_t start = 0;
+
+  res.preds.clear();
+  res.deleted = -1;
+  res.path_prefix = "";
+  res.order_by = METRIC_FRAG;
+  res.ascending = false;
+  res.top_k = 0;
+
+  while(start <= content.size())
+  {
+    size_t end = content.find(',', start);
+    if(end == string::npos)
+      end = content.size();
+    term = content.substr(start, end - start);
+    start = end + 1;
+
+    if(term.empty())
+      continue;
+    if(term == "deleted")
+      res.deleted = 1;
+    else if(term == "live")
+      res.deleted = 0;
+    else if(term == "asc")
+      res.ascending = true;
+    else if(term.compare(0, 5, "path=") == 0)
+      res.path_prefix = term.substr(5);
+    else if(term.compare(0, 4, "top=") == 0)
+      res.top_k = atoi(term.c_str() + 4);
+    else if(term.compare(0, 3, "by=") == 0)
+    {
+      if(parseMetric(term.substr(3), res.order_by) < 0)
+	return -1;
+    }
+    else
+    {
+      query_pred_t pred;
+      size_t op_pos = term.find_first_of("<>=");
+      char *suffix;
+
+      if(op_pos == string::npos || parseMetric(term.substr(0, op_pos), pred.metric) < 0)
+      {
+	cerr << "Error, invalid query term : " << term << endl;
+	return -1;
+      }
+
+      string op = term.substr(op_pos, (term.size() > op_pos+1 && term[op_pos+1] == '=') ? 2 : 1);
+      if(op == "<") pred.op = OP_LT;
+      else if(op == "<=") pred.op = OP_LE;
+      else if(op == ">") pred.op = OP_GT;
+      else if(op == ">=") pred.op = OP_GE;
+      else pred.op = OP_EQ;
+
+      pred.value = strtod(term.c_str() + op_pos + op.size(), &suffix);
+      if(*suffix == 'K' || *suffix == 'k')
+	pred.value *= 1024, suffix++;
+      else if(*suffix == 'M')
+	pred.value *= 1024*1024, suffix++;
+      else if(*suffix == 'G')
+	pred.value *= 1024.0*1024*1024, suffix++;
+      if(*suffix != '\0' || suffix == term.c_str() + op_pos + op.size())
+      {
+	cerr << "Error, invalid query value : " << term << endl;
+	return -1;
+      }
+      res.preds.push_back(pred);
+    }
+  }
+
+  // evaluate the cheap predicates first, the others are often skipped
+  stable_sort(res.preds.begin(), res.preds.end(), comparePredsByCost);
+
+  return 0;
+}
+
+int parseMetric(string name, metric_t &res)
+{
+  for(int i=0; i<METRIC_NUM; i++)
+    if(name == metric_names[i])
+    {
+      res = (metric_t)i;
+      return 0;
+    }
+
+  cerr << "Error, unknown metric : " << name << endl;
+  return -1;
+}
+
+string getMetricName(metric_t metric)
+{
+  return metric_names[metric];
+}
+
+/**
+ * Return a metric of f, computing it only the first time. Empty files
+ * have a fragmentation factor of 0.
+ */
+double getMetric(File &f, metric_t metric, file_metrics_t &cache)
+{
+  double value = 0.0;
+
+  if(cache.computed & (1 << metric))
+    return cache.values[metric];
+
+  switch(metric)
+  {
+    case METRIC_INO:
+      value = f.getInodeNum();
+      break;
+    case METRIC_NODES:
+      value = f.getValidDataNodes().size();
+      break;
+    case METRIC_SIZE:
+      value = f.getSize();
+      break;
+    case METRIC_PAGES:
+      value = f.getConcernedPages().getPagesNum();
+      break;
+    case METRIC_RUNS:
+      value = f.getConcernedPages().getRunsNum();
+      break;
+    case METRIC_BLOCKS:
+      if(f.getGeometry() != NULL)
+	value = f.getConcernedPages().getBlocksNum(f.getGeometry()->getNumPagesPerBlock());
+      break;
+    case METRIC_FRAG:
+      if(f.getTheoriticalPageNum() > 0)
+	value = getMetric(f, METRIC_PAGES, cache) / f.getTheoriticalPageNum();
+      break;
+    case METRIC_SEQ_COST:
+      if(!f.isDeleted() && getMetric(f, METRIC_SIZE, cache) > 0)
+	value = f.getSequentialReadCost();
+      break;
+    case METRIC_CONTIG:
+      if(!f.isDeleted() && getMetric(f, METRIC_SIZE, cache) > 1)
+	value = f.getContiguousFactor();
+      break;
+    default:
+      break;
+  }
+
+  cache.values[metric] = value;
+  cache.computed |= (1 << metric);
+  return value;
+}
+
+/**
+ * Fill res with the files matching query, in order, and return the
+ * number of matching files. Only the top_k best are kept, in a heap,
+ * and a metric is computed only if a predicate or the order needs it.
+ */
+int runQuery(const DirTree &tree, query_t &query, vector<query_result_t> &res)
+{
+  ResultOrder order(query.order_by, query.ascending);
+  int matched_num = 0;
+
+  res.clear();
+  for(int i=0; i<tree.getEntriesNum(); i++)
+  {
+    File *f = tree.getFile(i);
+    query_result_t r;
+    bool match = true;
+
+    if(query.deleted != -1 && f->isDeleted() != (query.deleted == 1))
+      continue;
+    if(!query.path_prefix.empty() && !matchPathPrefix(tree.getPath(i), query.path_prefix))
+      continue;
+
+    r.entry = i;
+    r.metrics.computed = 0;
+    for(int j=0; j<(int)query.preds.size() && match; j++)
+      match = matchPred(getMetric(*f, query.preds[j].metric, r.metrics), query.preds[j]);
+    if(!match)
+      continue;
+
+    matched_num++;
+    getMetric(*f, query.order_by, r.metrics);
+    if(query.top_k > 0 && (int)res.size() == query.top_k)
+    {
+      // worse than the worst kept one
+      if(!order(r, res.front()))
+	continue;
+      pop_heap(res.begin(), res.end(), order);
+      res.back() = r;
+    }
+    else
+      res.push_back(r);
+    push_heap(res.begin(), res.end(), order);
+  }
+
+  sort_heap(res.begin(), res.end(), order);
+  return matched_num;
+}
+
+void printQueryResults(ostream &os, const DirTree &tree, query_t &query,
+  vector<query_result_t> &res, int matched_num)
+{
+  os << "Query : " << matched_num << " files matched out of " << tree.getEntriesNum()
+    << ", " << res.size() << " shown by " << ((query.ascending) ? "increasing " : "decreasing ")
+    << getMetricName(query.order_by) << " :" << endl;
+
+  for(int i=0; i<(int)res.size(); i++)
+  {
+    File *f = tree.getFile(res[i].entry);
+
+    os << "  " << setw(4) << i+1 << "  " << getMetricName(query.order_by) << ": "
+      << res[i].metrics.values[query.order_by];
+    for(int m=0; m<METRIC_NUM; m++)
+      if(m != query.order_by && (res[i].metrics.computed & (1 << m)))
+	os << ", " << metric_names[m] << ": " << res[i].metrics.values[m];
+    os << ", ino: " << f->getInodeNum() << "  \"" << tree.getPath(res[i].entry) << "\""
+      << ((f->isDeleted()) ? " [DELETED]" : "") << endl;
+  }
+}
+
+bool comparePredsByCost(const query_pred_t &a, const query_pred_t &b)
+{
+  return a.metric < b.metric;
+}
+
+bool matchPred(double value, query_pred_t &pred)
+{
+  switch(pred.op)
+  {
+    case OP_LT:
+      return value < pred.value;
+    case OP_LE:
+      return value <= pred.value;
+    case OP_GT:
+      return value > pred.value;
+    case OP_GE:
+      return value >= pred.value;
+    case OP_EQ:
+    default:
+      return value == pred.value;
+  }
+}
+
+/**
+ * A path matches a prefix on whole components only
+ */
+bool matchPathPrefix(string path, string prefix)
+{
+  if(prefix.size() > 1 && prefix[prefix.size()-1] == '/')
+    prefix.erase(prefix.size()-1);
+  if(path.compare(0, prefix.size(), prefix) != 0)
+    return false;
+  return prefix == "/" || path.size() == prefix.size() || path[prefix.size()] == '/';
+}
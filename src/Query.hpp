@@ -0,0 +1,59 @@
+#ifndef QUERY_HPP
+#define QUERY_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "File.hpp"
+#include "DirTree.hpp"
+
+/**
+ * Per file metrics a query can filter and order on, from the cheapest
+ * to the most expensive to compute
+ */
+typedef enum {METRIC_INO, METRIC_NODES, METRIC_SIZE, METRIC_PAGES, METRIC_RUNS,
+  METRIC_BLOCKS, METRIC_FRAG, METRIC_SEQ_COST, METRIC_CONTIG, METRIC_NUM} metric_t;
+
+typedef enum {OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ} query_op_t;
+
+typedef struct
+{
+  metric_t metric;
+  query_op_t op;
+  double value;
+} query_pred_t;
+
+typedef struct
+{
+  std::vector<query_pred_t> preds;		// all must match, cheapest first
+  int deleted;				// -1 any, 0 live files only, 1 deleted only
+  std::string path_prefix;			// empty for any
+  metric_t order_by;
+  bool ascending;
+  int top_k;				// 0 for every matching file
+} query_t;
+
+/**
+ * Lazily computed metrics of one file
+ */
+typedef struct
+{
+  unsigned int computed;		// bit i set when values[i] is valid
+  double values[METRIC_NUM];
+} file_metrics_t;
+
+typedef struct
+{
+  int entry;				// DirTree entry
+  file_metrics_t metrics;
+} query_result_t;
+
+int parseQuery(char *str, query_t &res);
+std::string getMetricName(metric_t metric);
+double getMetric(File &f, metric_t metric, file_metrics_t &cache);
+int runQuery(const DirTree &tree, query_t &query, std::vector<query_result_t> &res);
+void printQueryResults(std::ostream &os, const DirTree &tree, query_t &query,
+  std::vector<query_result_t> &res, int matched_num);
+
+#endif /* QUERY_HPP */
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <set>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "Sample.hpp"
+#include "Parser.hpp"
+#include "File.hpp"
+#include "Hash.hpp"
+
+using namespace std;
+
+int scanNodeLine(const string &line, uint64_t &inode_num, uint32_t &version, uint32_t &totlen);
+
+/************************** SampledSummary ****************************/
+
+SampledSummary::SampledSummary(FlashGeometry &geometry, double rate)
+{
+  _geometry = geometry;
+  _rate = min(max(rate, 0.0), 1.0);
+  _lines_num = _data_nodes_num = _dirent_nodes_num = 0;
+  _used_bytes = _free_bytes = _inodes_num = 0;
+}
+
+/**
+ * Scan the whole dump, then finalize the sampled files
+ */
+int SampledSummary::run(istream &in)
+{
+  vector<pair<uint64_t, uint32_t> > data_keys;	// (ino << 32 | version, totlen)
+  set<uint64_t> inodes;
+  vector<Chunk *> chunks;
+  string line;
+  int ret = 0;
+
+  while(ret == 0 && getline(in, line))
+  {
+    uint64_t ino;
+    uint32_t version, totlen;
+    int type;
+
+    if(line.empty() || line[0] == '#' || line[0] == 'W')
+      continue;
+    _lines_num++;
+
+    type = scanNodeLine(line, ino, version, totlen);
+    if(type == DATA_NODE || type == DIRENT_NODE)
+    {
+      if(type == DATA_NODE)
+	data_keys.push_back(make_pair((ino << 32) | version, totlen));
+      else
+      {
+	_dirent_nodes_num++;
+	_used_bytes += totlen;
+      }
+      if(ino != 0)
+	inodes.insert(ino);
+      if(ino != 0 && (ino == 1 || !isInodeSampled(ino, _rate)))
+	continue;
+    }
+    else if(type == SUMMARY_NODE)
+      continue;
+
+    // sampled nodes, deletion dirents and free space
+    if(parseLine(line, chunks, _geometry) < 0)
+    {
+      cerr << "Error parsing this line :" << endl;
+      cerr << "  \"" << line << "\"" << endl;
+      ret = -1;
+    }
+  }
+
+  // duplicated data nodes only count once, as after parseLine
+  sort(data_keys.begin(), data_keys.end());
+  for(int i=0; i<(int)data_keys.size(); i++)
+    if(i == 0 || data_keys[i].first != data_keys[i-1].first)
+    {
+      _data_nodes_num++;
+      _used_bytes += data_keys[i].second;
+    }
+  _inodes_num = inodes.size();
+
+  if(ret == 0)
+  {
+    FileSet fs(chunks, false);
+
+    for(int i=0; i<(int)chunks.size(); i++)
+      if(chunks[i]->getType() == FREE_SPACE)
+	_free_bytes += static_cast<FreeSpaceChunk *>(chunks[i])->getSize();
+
+    for(int i=0; i<fs.getFilesNum(); i++)
+    {
+      File *f = fs.getFile(i);
+      sampled_file_t s;
+
+      if(f->getInodeNum() == 1)
+	continue;
+      memset(&s, 0, sizeof(s));
+      s.files = 1;
+      s.deleted = (f->isDeleted()) ? 1 : 0;
+      if(!f->isDeleted())
+      {
+	vector<DataNode *> &valid = f->getValidDataNodes();
+	for(int j=0; j<(int)valid.size(); j++)
+	  s.valid_bytes += valid[j]->getFlashSize();
+	s.valid_bytes += f->getValidDirentNode()->getFlashSize();
+	s.size = f->getSize();
+	s.pages = f->getConcernedPages().getPagesNum();
+	s.min_pages = f->getTheoriticalPageNum();
+	s.seq_read_cost = f->getSequentialReadCost();
+      }
+      _files.push_back(s);
+    }
+  }
+
+  for(int i=0; i<(int)chunks.size(); i++)
+    delete chunks[i];
+
+  return ret;
+}
+
+/**
+ * Horvitz-Thompson estimate of the sum of field over every file, each
+ * file being sampled with probability _rate independently
+ */
+estimate_t SampledSummary::getTotal(double sampled_file_t::*field)
+{
+  estimate_t res;
+  double sum = 0.0, sum_sq = 0.0;
+
+  for(int i=0; i<(int)_files.size(); i++)
+  {
+    sum += _files[i].*field;
+    sum_sq += (_files[i].*field) * (_files[i].*field);
+  }
+
+  res.value = (_rate > 0) ? sum / _rate : 0.0;
+  res.error = (_rate > 0) ? SAMPLE_CONFIDENCE_Z * sqrt((1 - _rate) * sum_sq) / _rate : 0.0;
+  return res;
+}
+
+/**
+ * Ratio of two totals, with the linearized variance of the ratio
+ * estimator
+ */
+estimate_t SampledSummary::getRatio(double sampled_file_t::*num, double sampled_file_t::*den)
+{
+  estimate_t res;
+  double sum_num = 0.0, sum_den = 0.0, sum_sq = 0.0;
+
+  for(int i=0; i<(int)_files.size(); i++)
+  {
+    sum_num += _files[i].*num;
+    sum_den += _files[i].*den;
+  }
+  res.value = res.error = 0.0;
+  if(sum_den == 0)
+    return res;
+
+  res.value = sum_num / sum_den;
+  for(int i=0; i<(int)_files.size(); i++)
+  {
+    double d = _files[i].*num - res.value * (_files[i].*den);
+    sum_sq += d * d;
+  }
+  res.error = SAMPLE_CONFIDENCE_Z * sqrt((1 - _rate) * sum_sq) / sum_den;
+  return res;
+}
+
+ostream& operator<<(ostream& os, SampledSummary& s)
+{
+  estimate_t files = s.getTotal(&sampled_file_t::files);
+  estimate_t deleted = s.getTotal(&sampled_file_t::deleted);
+  estimate_t size = s.getTotal(&sampled_file_t::size);
+  estimate_t valid = s.getTotal(&sampled_file_t::valid_bytes);
+  estimate_t seq_cost = s.getTotal(&sampled_file_t::seq_read_cost);
+  estimate_t frag = s.getRatio(&sampled_file_t::pages, &sampled_file_t::min_pages);
+  estimate_t read_ampl = s.getRatio(&sampled_file_t::seq_read_cost, &sampled_file_t::size);
+  estimate_t gc;
+
+  // the used bytes are exact, only the valid ones are estimated
+  gc.value = (s._used_bytes) ? 1.0 - valid.value / s._used_bytes : 0.0;
+  gc.error = (s._used_bytes) ? valid.error / s._used_bytes : 0.0;
+  read_ampl.value *= s._geometry.getFlashPageSize();
+  read_ampl.error *= s._geometry.getFlashPageSize();
+
+  os << "Sampled summary : " << s._files.size() << " files finalized, inodes kept with rate "
+    << s._rate << ", " << SAMPLE_CONFIDENCE_Z << " sigma intervals" << endl;
+  os << " - lines : " << s._lines_num << " (exact)" << endl;
+  os << " - inodes : " << s._inodes_num << " (exact)" << endl;
+  os << " - data nodes : " << s._data_nodes_num << " (exact)" << endl;
+  os << " - dirent nodes : " << s._dirent_nodes_num << " (exact)" << endl;
+  os << " - used bytes : " << s._used_bytes << " (exact)" << endl;
+  os << " - free bytes : " << s._free_bytes << " (exact)" << endl;
+  os << " - files : " << files.value << " +/- " << files.error << endl;
+  os << " - deleted files : " << deleted.value << " +/- " << deleted.error << endl;
+  os << " - files size : " << size.value << " +/- " << size.error << endl;
+  os << " - valid bytes : " << valid.value << " +/- " << valid.error << endl;
+  os << " - gc pressure : " << gc.value << " +/- " << gc.error << endl;
+  os << " - frag factor : " << frag.value << " +/- " << frag.error << endl;
+  os << " - seq read cost : " << seq_cost.value << " +/- " << seq_cost.error << endl;
+  os << " - read amplification : " << read_ampl.value << " +/- " << read_ampl.error << endl;
+
+  return os;
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Hash of the inode number mapped to [0, 1)
+ */
+bool isInodeSampled(uint64_t inode_num, double rate)
+{
+  return (double)(hashInode(inode_num) >> 11) / (double)(1ULL << 53) < rate;
+}
+
+/**
+ * Type of a dump line as parseChunk finds it, for nodes also the inode
+ * number, version and flash size, without the regular expressions.
+ * Return -1 for an unknown line.
+ */
+int scanNodeLine(const string &line, uint64_t &inode_num, uint32_t &version, uint32_t &totlen)
+{
+  const char *s = line.c_str();
+  const char *p;
+  int type;
+
+  if(!line.compare(0, 11, "Empty space"))
+    return FREE_SPACE;
+  if(!line.compare(0, 14, "         Inode"))
+    type = DATA_NODE;
+  else if(!line.compare(0, 15, "         Dirent"))
+    type = DIRENT_NODE;
+  else if(!line.compare(0, 16, "         Summary"))
+    return SUMMARY_NODE;
+  else
+    return -1;
+
+  inode_num = version = totlen = 0;
+  if((p = strstr(s, "totlen 0x")) != NULL)
+    totlen = strtoul(p + 9, NULL, 16);
+  if((p = strstr(s, "#ino")) != NULL)
+    inode_num = strtoull(p + 4, NULL, 10);
+  if((p = strstr(s, "version")) != NULL)
+    version = strtoul(p + 7, NULL, 10);
+
+  return type;
+}
@@ -0,0 +1,69 @@
+#ifndef SAMPLE_HPP
+#define SAMPLE_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "ChunkModel.hpp"
+
+#define SAMPLE_CONFIDENCE_Z			1.96	// 95% two sided normal interval
+
+/**
+ * Figures of one sampled file, see computeDumpSummary
+ */
+typedef struct
+{
+  double files;				// 1, to estimate the number of files
+  double deleted;
+  double size;
+  double valid_bytes;
+  double pages;
+  double min_pages;
+  double seq_read_cost;
+} sampled_file_t;
+
+/**
+ * Estimate with its confidence interval half width
+ */
+typedef struct
+{
+  double value;
+  double error;
+} estimate_t;
+
+/**
+ * Approximate dump summary for triage. Each inode is kept with
+ * probability rate, by a hash of its number so that the same inodes are
+ * kept from one run to the next. Every line is only scanned for its
+ * inode number and size, so node counts, free space and used space are
+ * exact. Only the lines of the kept inodes, and the deletion dirents
+ * which may apply to them, are parsed and finalized. The file figures
+ * are estimated by Horvitz-Thompson totals and ratio estimators, with
+ * normal confidence intervals.
+ */
+class SampledSummary
+{
+  public:
+    SampledSummary(FlashGeometry &geometry, double rate);
+    int run(std::istream &in);
+    friend std::ostream& operator<<(std::ostream& os, SampledSummary& s);
+
+  private:
+    FlashGeometry _geometry;
+    double _rate;
+    uint64_t _lines_num;
+    uint64_t _data_nodes_num;		// duplicates excluded
+    uint64_t _dirent_nodes_num;
+    uint64_t _used_bytes;		// valid and obsolete node bytes
+    uint64_t _free_bytes;
+    uint64_t _inodes_num;
+    std::vector<sampled_file_t> _files;
+
+    estimate_t getTotal(double sampled_file_t::*field);
+    estimate_t getRatio(double sampled_file_t::*num, double sampled_file_t::*den);
+};
+
+bool isInodeSampled(uint64_t inode_num, double rate);
+
+#endif /* SAMPLE_HPP */
@@ -0,0 +1,422 @@
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Server.hpp"
+#include "Query.hpp"
+
+using namespace std;
+
+#define SERVER_LISTEN_BACKLOG			16
+#define SERVER_READ_BUFFER_SIZE			4096
+
+int sendAll(int fd, string data);
+
+/**************************** QueryServer *****************************/
+
+QueryServer::QueryServer(FlashGeometry &geometry)
+{
+  _geometry = geometry;
+  _listen_fd = -1;
+  _stopping = false;
+}
+
+QueryServer::~QueryServer()
+{
+  for(int i=0; i<(int)_dumps.size(); i++)
+    delete _dumps[i];
+}
+
+/**
+ * Parse a dump and build its file set, tree and flash index
+ */
+int QueryServer::load(char *path)
+{
+  Jffs2Dump *d = new Jffs2Dump(_geometry);
+
+  if(d->load(path) < 0)
+  {
+    delete d;
+    return -1;
+  }
+  _dumps.push_back(d);
+
+  return 0;
+}
+
+/**
+ * Accept connections on socket_path until a shutdown request, each one
+ * handed to the first idle worker
+ */
+int QueryServer::serve(char *socket_path, int threads_num)
+{
+  struct sockaddr_un addr;
+  vector<pthread_t> threads;
+
+  if(_dumps.empty())
+  {
+    cerr << "Error, no dump loaded" << endl;
+    return -1;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(strlen(socket_path) >= sizeof(addr.sun_path))
+  {
+    cerr << "Error, socket path too long : " << socket_path << endl;
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  _listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path);
+  if(_listen_fd < 0 || bind(_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+    || listen(_listen_fd, SERVER_LISTEN_BACKLOG) < 0)
+  {
+    cerr << "Error listening on " << socket_path << " : " << strerror(errno) << endl;
+    if(_listen_fd >= 0)
+      close(_listen_fd);
+    return -1;
+  }
+
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_cond, NULL);
+  if(threads_num < 1)
+    threads_num = 1;
+  for(int i=0; i<threads_num; i++)
+  {
+    pthread_t t;
+    if(pthread_create(&t, NULL, worker, this))
+    {
+      cerr << "Error creating server worker thread" << endl;
+      break;
+    }
+    threads.push_back(t);
+  }
+
+  cerr << "Serving " << _dumps.size() << " dump(s) on " << socket_path << " with "
+    << threads.size() << " threads" << endl;
+  while(!threads.empty())
+  {
+    int fd = accept(_listen_fd, NULL, NULL);
+
+    pthread_mutex_lock(&_lock);
+    if(fd >= 0 && !_stopping)
+      _pending.push_back(fd);
+    else if(fd >= 0)
+      close(fd);
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    // the listening socket is shut down by the shutdown request
+    if(fd < 0 && errno != EINTR)
+      break;
+  }
+
+  pthread_mutex_lock(&_lock);
+  _stopping = true;
+  pthread_cond_broadcast(&_cond);
+  pthread_mutex_unlock(&_lock);
+  for(int i=0; i<(int)threads.size(); i++)
+    pthread_join(threads[i], NULL);
+  for(int i=0; i<(int)_pending.size(); i++)
+    close(_pending[i]);
+  _pending.clear();
+
+  close(_listen_fd);
+  unlink(socket_path);
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
+
+  return 0;
+}
+
+void *QueryServer::worker(void *arg)
+{
+  QueryServer *s = (QueryServer *)arg;
+
+  while(true)
+  {
+    int fd;
+
+    pthread_mutex_lock(&s->_lock);
+    while(s->_pending.empty() && !s->_stopping)
+      pthread_cond_wait(&s->_cond, &s->_lock);
+    if(s->_pending.empty())
+    {
+      pthread_mutex_unlock(&s->_lock);
+      break;
+    }
+    fd = s->_pending.front();
+    s->_pending.pop_front();
+    pthread_mutex_unlock(&s->_lock);
+
+    s->serveConnection(fd);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+/**
+ * Answer the requests of one client, line by line, until it quits
+ */
+void QueryServer::serveConnection(int fd)
+{
+  char buf[SERVER_READ_BUFFER_SIZE];
+  string pending;
+  int dump_idx = 0;
+  ssize_t n;
+
+  while((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+  {
+    size_t eol;
+
+    if(n < 0)
+      continue;
+    pending.append(buf, n);
+    while((eol = pending.find('\n')) != string::npos)
+    {
+      string line = pending.substr(0, eol);
+      stringstream answer;
+      int ret;
+
+      pending.erase(0, eol + 1);
+      if(!line.empty() && line[line.size()-1] == '\r')
+	line.erase(line.size()-1);
+
+      ret = handleRequest(line, dump_idx, answer);
+      if(ret == 0)
+	answer << "OK" << endl;
+      if(sendAll(fd, answer.str()) < 0 || ret > 0)
+	return;
+    }
+  }
+}
+
+/**
+ * Return 0 if the request succeeded, -1 if it failed and its error line
+ * is in os, 1 if the connection must be closed
+ */
+int QueryServer::handleRequest(string &line, int &dump_idx, ostream &os)
+{
+  stringstream ss(line);
+  string cmd, arg;
+  Jffs2Dump *d = _dumps[dump_idx];
+
+  if(!(ss >> cmd))
+  {
+    os << "ERR empty request" << endl;
+    return -1;
+  }
+
+  if(cmd == "quit")
+    return 1;
+
+  if(cmd == "shutdown")
+  {
+    pthread_mutex_lock(&_lock);
+    _stopping = true;
+    pthread_mutex_unlock(&_lock);
+    shutdown(_listen_fd, SHUT_RDWR);
+    return 1;
+  }
+
+  if(cmd == "dumps")
+  {
+    for(int i=0; i<(int)_dumps.size(); i++)
+      os << i << " " << _dumps[i]->getName() << " " << _dumps[i]->getFilesNum() << " files"
+	<< ((i == dump_idx) ? " *" : "") << endl;
+    return 0;
+  }
+
+  if(cmd == "use")
+  {
+    int n = -1;
+    if(!(ss >> n) || n < 0 || n >= (int)_dumps.size())
+    {
+      os << "ERR no such dump" << endl;
+      return -1;
+    }
+    dump_idx = n;
+    return 0;
+  }
+
+  if(cmd == "file")
+  {
+    int entry;
+    file_metrics_t metrics;
+
+    ss >> arg;
+    entry = d->findFile(arg);
+    if(entry == -1 || d->getFileMetrics(entry, metrics) < 0)
+    {
+      os << "ERR no such file : " << arg << endl;
+      return -1;
+    }
+    os << "\"" << d->getPath(entry) << "\"" << ((d->isDeleted(entry)) ? " [DELETED]" : "");
+    for(int m=0; m<METRIC_NUM; m++)
+      os << ", " << getMetricName((metric_t)m) << ": " << metrics.values[m];
+    os << endl;
+    return 0;
+  }
+
+  if(cmd == "query")
+  {
+    query_t query;
+    vector<query_result_t> results;
+    string str;
+    int matched_num;
+
+    getline(ss, str);
+    str.erase(0, str.find_first_not_of(" \t"));
+    if(parseQuery(&str[0], query) < 0)
+    {
+      os << "ERR invalid query" << endl;
+      return -1;
+    }
+    matched_num = runQuery(d->getTree(), query, results);
+    printQueryResults(os, d->getTree(), query, results, matched_num);
+    return 0;
+  }
+
+  if(cmd == "page" || cmd == "block")
+  {
+    vector<const node_extent_t *> found;
+    uint32_t idx;
+
+    if(!(ss >> idx))
+    {
+      os << "ERR missing index" << endl;
+      return -1;
+    }
+    if(cmd == "page")
+      d->findPage(idx, found);
+    else
+      d->findBlock(idx, found);
+
+    for(int i=0; i<(int)found.size(); i++)
+    {
+      const node_extent_t *e = found[i];
+      int entry = (e->file == NULL) ? -1 : d->findInode(e->file->getInodeNum());
+
+      os << e->first_page << "-" << e->last_page << " "
+	<< ((e->node->getType() == DATA_NODE) ? "data" : "dirent")
+	<< " ino " << e->node->getInodeNum() << " version " << e->node->getVersionNum()
+	<< " " << ((e->valid) ? "valid" : "obsolete");
+      if(entry != -1)
+	os << " \"" << d->getPath(entry) << "\"";
+      os << endl;
+    }
+    return 0;
+  }
+
+  if(cmd == "read")
+  {
+    uint64_t offset, size;
+    int entry, readpages_num, cost;
+
+    if(!(ss >> arg >> offset >> size) || (entry = d->findFile(arg)) == -1)
+    {
+      os << "ERR usage : read <path|ino> <offset> <length>" << endl;
+      return -1;
+    }
+    cost = d->getReadCost(entry, offset, size, readpages_num);
+    os << "readpages: " << readpages_num << ", flash pages read: " << cost;
+    if(getReadpageModel() == READPAGE_KERNEL)
+    {
+      readpage_work_t work;
+      d->getReadWork(entry, offset, size, work);
+      printReadpageWork(os, work);
+    }
+    os << endl;
+    return 0;
+  }
+
+  if(cmd == "replay")
+  {
+    ss >> arg;
+    return replayTrace(d, arg, os);
+  }
+
+  os << "ERR unknown request : " << cmd << endl;
+  return -1;
+}
+
+int QueryServer::replayTrace(Jffs2Dump *d, string &path, ostream &os)
+{
+  ifstream in(path.c_str());
+  string line;
+  int requests_num = 0, unknown_num = 0, readpages_num = 0, cost = 0;
+  readpage_work_t total;
+
+  if(!in)
+  {
+    os << "ERR can't open " << path << endl;
+    return -1;
+  }
+  memset(&total, 0, sizeof(total));
+
+  while(getline(in, line))
+  {
+    stringstream ss(line);
+    string name;
+    uint64_t offset, size;
+    int entry, n;
+
+    if(!(ss >> name) || name[0] == '#')
+      continue;
+    if(!(ss >> offset >> size))
+    {
+      os << "ERR invalid trace line : " << line << endl;
+      return -1;
+    }
+
+    requests_num++;
+    if((entry = d->findFile(name)) == -1)
+    {
+      unknown_num++;
+      continue;
+    }
+    cost += d->getReadCost(entry, offset, size, n);
+    readpages_num += n;
+    if(getReadpageModel() == READPAGE_KERNEL)
+    {
+      readpage_work_t work;
+      d->getReadWork(entry, offset, size, work);
+      addReadpageWork(total, work);
+    }
+  }
+
+  os << "requests: " << requests_num << ", unknown files: " << unknown_num
+    << ", readpages: " << readpages_num << ", flash pages read: " << cost
+    << ", per readpage: " << ((readpages_num) ? (double)cost / readpages_num : 0.0);
+  if(getReadpageModel() == READPAGE_KERNEL)
+    printReadpageWork(os, total);
+  os << endl;
+  return 0;
+}
+
+/****************************** Tools *********************************/
+
+int sendAll(int fd, string data)
+{
+  size_t sent = 0;
+
+  while(sent < data.size())
+  {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return -1;
+    sent += n;
+  }
+
+  return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <deque>
+#include <pthread.h>
+
+#include "Jffs2Dump.hpp"
+
+/**
+ * Resident mode : dumps are parsed and indexed once, then queries are
+ * answered over a local Unix socket, one line per request :
+ *   dumps                      list the loaded dumps
+ *   use <n>                    select the dump of the next requests
+ *   file <path|ino>            metrics of one file
+ *   query <query>              same as the -q option
+ *   page <n> / block <n>       nodes and files stored there
+ *   read <path|ino> <off> <len>  flash pages read by the readpages
+ *   replay <trace>             same for each '<path|ino> <off> <len>' line
+ *                              of a trace file
+ *   quit / shutdown
+ * An answer is its result lines followed by "OK", or a single "ERR <why>"
+ * line. The dumps are only read once loaded, see Jffs2Dump, connections
+ * are served concurrently by a pool of threads.
+ */
+class QueryServer
+{
+  public:
+    QueryServer(FlashGeometry &geometry);
+    ~QueryServer();
+    int load(char *path);
+    int serve(char *socket_path, int threads_num);
+
+  private:
+    FlashGeometry _geometry;
+    std::vector<Jffs2Dump *> _dumps;
+    int _listen_fd;
+    bool _stopping;
+    std::deque<int> _pending;		// accepted connections not served yet
+    pthread_mutex_t _lock;
+    pthread_cond_t _cond;
+
+    static void *worker(void *arg);
+    void serveConnection(int fd);
+    int handleRequest(std::string &line, int &dump_idx, std::ostream &os);
+    int replayTrace(Jffs2Dump *d, std::string &path, std::ostream &os);
+};
+
+#endif /* SERVER_HPP */
@@ -0,0 +1,277 @@
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "Stats.hpp"
+
+using namespace std;
+
+RunStats *run_stats = NULL;
+
+static const char *hw_counter_names[STATS_HW_COUNTERS_NUM] =
+  {"cycles", "instructions", "cache_references", "cache_misses"};
+static const uint64_t hw_counter_configs[STATS_HW_COUNTERS_NUM] =
+  {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+  PERF_COUNT_HW_CACHE_MISSES};
+
+int openHwCounter(uint64_t config);
+uint64_t readHwCounter(int fd);
+
+/***************************** RunStats *******************************/
+
+RunStats::RunStats(bool hw_counters)
+{
+  for(int i=0; i<STATS_HW_COUNTERS_NUM; i++)
+  {
+    _hw_fds[i] = (hw_counters) ? openHwCounter(hw_counter_configs[i]) : -1;
+    _last_hw[i] = 0;
+  }
+  if(hw_counters && !hasHwCounters())
+    cerr << "Hardware counters unavailable, no PMU or perf_event_paranoid too high" << endl;
+
+  _owner = pthread_self();
+  _start_wall = _last_wall = getMonotonicTime();
+  _last_cpu = getProcessCpuTime();
+  sample();
+}
+
+RunStats::~RunStats()
+{
+  for(int i=0; i<STATS_HW_COUNTERS_NUM; i++)
+    if(_hw_fds[i] != -1)
+      close(_hw_fds[i]);
+}
+
+void RunStats::startPhase(const char *name)
+{
+  int idx = -1;
+
+  if(!isOwner())
+    return;
+  sample();
+  for(int i=0; i<(int)_phases.size() && idx == -1; i++)
+    if(_phases[i].name == name)
+      idx = i;
+  if(idx == -1)
+  {
+    phase_stats_t p;
+    p.name = name;
+    p.wall = p.cpu = 0.0;
+    memset(p.hw, 0, sizeof(p.hw));
+    _phases.push_back(p);
+    idx = _phases.size() - 1;
+  }
+  _stack.push_back(idx);
+}
+
+void RunStats::endPhase()
+{
+  if(!isOwner() || _stack.empty())
+    return;
+  sample();
+  _stack.pop_back();
+}
+
+/**
+ * Add n to a named counter, created at 0 the first time
+ */
+void RunStats::count(const char *name, uint64_t n)
+{
+  if(!isOwner())
+    return;
+  for(int i=0; i<(int)_counters.size(); i++)
+    if(_counters[i].first == name)
+    {
+      _counters[i].second += n;
+      return;
+    }
+  _counters.push_back(make_pair(string(name), n));
+}
+
+bool RunStats::isOwner()
+{
+  return pthread_equal(_owner, pthread_self());
+}
+
+/**
+ * Credit the time and events since the last sample to the innermost open
+ * phase
+ */
+void RunStats::sample()
+{
+  double wall = getMonotonicTime(), cpu = getProcessCpuTime();
+  uint64_t hw[STATS_HW_COUNTERS_NUM];
+
+  for(int i=0; i<STATS_HW_COUNTERS_NUM; i++)
+    hw[i] = (_hw_fds[i] != -1) ? readHwCounter(_hw_fds[i]) : 0;
+
+  if(!_stack.empty())
+  {
+    phase_stats_t &p = _phases[_stack.back()];
+    p.wall += wall - _last_wall;
+    p.cpu += cpu - _last_cpu;
+    for(int i=0; i<STATS_HW_COUNTERS_NUM; i++)
+      p.hw[i] += hw[i] - _last_hw[i];
+  }
+
+  _last_wall = wall;
+  _last_cpu = cpu;
+  for(int i=0; i<STATS_HW_COUNTERS_NUM; i++)
+    _last_hw[i] = hw[i];
+}
+
+bool RunStats::hasHwCounters()
+{
+  for(int i=0; i<STATS_HW_COUNTERS_NUM; i++)
+    if(_hw_fds[i] != -1)
+      return true;
+  return false;
+}
+
+/**
+ * The totals are for the whole process, cpu time of every thread
+ * included
+ */
+void RunStats::print(ostream &os, bool json)
+{
+  struct rusage usage;
+  double wall, cpu;
+
+  sample();
+  getrusage(RUSAGE_SELF, &usage);
+  wall = _last_wall - _start_wall;
+  cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec
+    + usage.ru_stime.tv_usec / 1e6;
+
+  if(json)
+  {
+    os << "{\"phases\": {";
+    for(int i=0; i<(int)_phases.size(); i++)
+    {
+      os << ((i) ? ", " : "") << "\"" << _phases[i].name << "\": {\"wall\": " << _phases[i].wall
+	<< ", \"cpu\": " << _phases[i].cpu;
+      for(int j=0; j<STATS_HW_COUNTERS_NUM; j++)
+	if(_hw_fds[j] != -1)
+	  os << ", \"" << hw_counter_names[j] << "\": " << _phases[i].hw[j];
+      os << "}";
+    }
+    os << "}, \"total\": {\"wall\": " << wall << ", \"cpu\": " << cpu << "}, \"counters\": {";
+    for(int i=0; i<(int)_counters.size(); i++)
+      os << ((i) ? ", " : "") << "\"" << _counters[i].first << "\": " << _counters[i].second;
+    os << "}, \"max_rss_kb\": " << usage.ru_maxrss << "}" << endl;
+    return;
+  }
+
+  os << "/************************************/" << endl;
+  os << " Run statistics :" << endl;
+  for(int i=0; i<(int)_phases.size(); i++)
+  {
+    os << " - " << _phases[i].name << " : " << _phases[i].wall << " s wall, " << _phases[i].cpu
+      << " s cpu";
+    for(int j=0; j<STATS_HW_COUNTERS_NUM; j++)
+      if(_hw_fds[j] != -1)
+	os << ", " << _phases[i].hw[j] << " " << hw_counter_names[j];
+    os << endl;
+  }
+  os << " - total : " << wall << " s wall, " << cpu << " s cpu" << endl;
+  for(int i=0; i<(int)_counters.size(); i++)
+    os << " - " << _counters[i].first << " : " << _counters[i].second << endl;
+  os << " - peak RSS : " << usage.ru_maxrss << " KB" << endl;
+  os << "/************************************/" << endl;
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * The run statistics if they are collected and the caller is the thread
+ * they measure, NULL otherwise
+ */
+RunStats *getRunStats()
+{
+  return (run_stats != NULL && run_stats->isOwner()) ? run_stats : NULL;
+}
+
+/**
+ * Parse the --stats argument, comma separated : text (default), json, hw
+ */
+int parseStatsOptions(char *str, bool &json, bool &hw)
+{
+  string content = (str == NULL) ? "" : str;
+  size_t start = 0;
+
+  json = hw = false;
+  while(start <= content.size())
+  {
+    size_t end = content.find(',', start);
+    if(end == string::npos)
+      end = content.size();
+    string term = content.substr(start, end - start);
+
+    start = end + 1;
+    if(term.empty())
+      continue;
+    if(term == "text")
+      json = false;
+    else if(term == "json")
+      json = true;
+    else if(term == "hw")
+      hw = true;
+    else
+    {
+      cerr << "Error, invalid stats option : " << term << endl;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+double getMonotonicTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Cpu time of every thread of the process, the finished ones included
+ */
+double getProcessCpuTime()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * User space events of the calling thread and of the threads it creates
+ * later, counted once they exit, -1 if the kernel refuses
+ */
+int openHwCounter(uint64_t config)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = 1;
+
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+uint64_t readHwCounter(int fd)
+{
+  uint64_t value = 0;
+
+  if(read(fd, &value, sizeof(value)) != sizeof(value))
+    return 0;
+  return value;
+}
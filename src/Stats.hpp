@@ -0,0 +1,65 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <pthread.h>
+
+#include "FlashGeometry.hpp"
+
+#define STATS_HW_COUNTERS_NUM			4	// cycles, instructions, cache refs and misses
+
+/**
+ * Time and counters of one run, filled by hooks in the parser, FileSet and
+ * main when --stats is given. The phases nest : the time of a phase started
+ * inside another one is only counted in the inner phase, so the phases add
+ * up to the run time. A phase started again adds to its previous figures.
+ * Only the thread which created the object opens phases, but their cpu time
+ * and counters are the ones of the whole process : the FileSet workers are
+ * counted in the phase which started them. The workers of the batch,
+ * partitions and server modes run outside of any phase and only show in the
+ * totals.
+ */
+class RunStats
+{
+  public:
+    RunStats(bool hw_counters);
+    ~RunStats();
+    void startPhase(const char *name);
+    void endPhase();
+    void count(const char *name, uint64_t n);
+    bool isOwner();
+    void print(std::ostream &os, bool json);
+
+  private:
+    typedef struct
+    {
+      std::string name;
+      double wall;
+      double cpu;
+      uint64_t hw[STATS_HW_COUNTERS_NUM];
+    } phase_stats_t;
+
+    std::vector<phase_stats_t> _phases;	// in the order they first started
+    std::vector<int> _stack;			// indexes of the open phases
+    std::vector<std::pair<std::string, uint64_t> > _counters;
+    int _hw_fds[STATS_HW_COUNTERS_NUM];	// -1 if the counter can't be read
+    double _start_wall;
+    double _last_wall;
+    double _last_cpu;
+    uint64_t _last_hw[STATS_HW_COUNTERS_NUM];
+    pthread_t _owner;
+
+    void sample();
+    bool hasHwCounters();
+};
+
+extern RunStats *run_stats;
+
+RunStats *getRunStats();
+int parseStatsOptions(char *str, bool &json, bool &hw);
+double getMonotonicTime();
+double getProcessCpuTime();
+
+#endif /* STATS_HPP */
@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <set>
+
+#include "Stream.hpp"
+#include "Parser.hpp"
+
+using namespace std;
+
+bool isFileComplete(vector<Chunk *> &nodes);
+DirentNode *getLastDirent(vector<Chunk *> &nodes);
+int getDirentState(vector<Chunk *> &nodes, map<string, Chunk *> &deletions);
+
+/*************************** StreamAnalyzer ***************************/
+
+StreamAnalyzer::StreamAnalyzer(FlashGeometry &geometry, int window, int interval, ostream &os)
+  : _os(os)
+{
+  _geometry = geometry;
+  _window = max(window, 1);
+  _interval = interval;
+  _chunks_num = _data_nodes_num = _dirent_nodes_num = _free_bytes = 0;
+  _held_nodes_num = _dropped_nodes_num = 0;
+  _rows_num = 0;
+}
+
+StreamAnalyzer::~StreamAnalyzer()
+{
+  for(map<uint64_t, stream_inode_t>::iterator it = _inodes.begin(); it != _inodes.end(); ++it)
+    for(int i=0; i<(int)it->second.nodes.size(); i++)
+      delete it->second.nodes[i];
+  for(map<string, Chunk *>::iterator it = _deletions.begin(); it != _deletions.end(); ++it)
+    delete it->second;
+}
+
+/**
+ * Read the dump line by line until the end of in, return -1 on a
+ * malformed line
+ */
+int StreamAnalyzer::run(istream &in)
+{
+  string line;
+  int incomplete_num = 0;
+
+  while(getline(in, line))
+  {
+    Chunk *c = NULL;
+
+    if(line.empty() || line[0] == '#' || line[0] == 'W')
+      continue;
+    if(parseChunk(line, &c, _geometry) < 0)
+    {
+      cerr << "Error parsing this line :" << endl;
+      cerr << "  \"" << line << "\"" << endl;
+      return -1;
+    }
+
+    _chunks_num++;
+    switch(c->getType())
+    {
+      case FREE_SPACE:
+	_free_bytes += static_cast<FreeSpaceChunk *>(c)->getSize();
+	delete c;
+	break;
+
+      case DATA_NODE:
+      case DIRENT_NODE:
+	addNode(static_cast<Node *>(c));
+	break;
+
+      default:
+	delete c;
+	break;
+    }
+
+    emitQuietInodes();
+    if(_interval > 0 && _chunks_num % _interval == 0)
+      printStats("#");
+  }
+
+  // the end of the dump completes every file, a deleted one is erased
+  for(map<uint64_t, stream_inode_t>::iterator it = _inodes.begin(); it != _inodes.end(); )
+  {
+    map<uint64_t, stream_inode_t>::iterator next = it;
+    ++next;
+    if(it->second.pending && emitFile(it->first, it->second) != 0)
+      incomplete_num++;
+    it = next;
+  }
+
+  printStats("# end :");
+  if(incomplete_num > 0)
+    _os << "# " << incomplete_num << " inode(s) without dirent or with missing data" << endl;
+
+  return 0;
+}
+
+/**
+ * Group a node with the other nodes of its inode, the duplicated data
+ * nodes and the nodes of deleted files are dropped
+ */
+void StreamAnalyzer::addNode(Node *n)
+{
+  uint64_t ino = n->getInodeNum();
+  map<uint64_t, stream_inode_t>::iterator it;
+
+  if(n->getType() == DIRENT_NODE)
+  {
+    DirentNode *dn = static_cast<DirentNode *>(n);
+    _dirent_nodes_num++;
+
+    // a deletion applies to every file of the same name, see
+    // File::set_valid_dirent : an older one of that name no longer can
+    if(ino == 0)
+    {
+      map<string, vector<uint64_t> >::iterator names = _names.find(dn->getName());
+      Chunk *&last = _deletions[dn->getName()];
+
+      if(last != NULL && static_cast<Node *>(last)->getVersionNum() >= dn->getVersionNum())
+      {
+	delete dn;
+	_dropped_nodes_num++;
+	return;
+      }
+      if(last != NULL)
+      {
+	delete last;
+	_held_nodes_num--;
+	_dropped_nodes_num++;
+      }
+      last = dn;
+      _held_nodes_num++;
+      if(names != _names.end())
+	for(int i=0; i<(int)names->second.size(); i++)
+	  touch(names->second[i], _inodes[names->second[i]]);
+      return;
+    }
+  }
+  else
+    _data_nodes_num++;
+
+  if(_deleted_inos.find(ino) != _deleted_inos.end())
+  {
+    delete n;
+    _dropped_nodes_num++;
+    return;
+  }
+
+  if(n->getType() == DIRENT_NODE)
+  {
+    vector<uint64_t> &inos = _names[static_cast<DirentNode *>(n)->getName()];
+    if(find(inos.begin(), inos.end(), ino) == inos.end())
+      inos.push_back(ino);
+  }
+
+  it = _inodes.find(ino);
+  if(it == _inodes.end())
+  {
+    stream_inode_t s;
+    s.last_seen = 0;
+    s.pending = s.emitted = false;
+    it = _inodes.insert(make_pair(ino, s)).first;
+  }
+  stream_inode_t &s = it->second;
+
+  if(n->getType() == DATA_NODE && insertDataNodeInVector(static_cast<DataNode *>(n), s.nodes))
+  {
+    delete n;
+    _dropped_nodes_num++;
+    return;
+  }
+  if(n->getType() == DIRENT_NODE)
+    s.nodes.push_back(n);
+
+  _held_nodes_num++;
+  touch(ino, s);
+}
+
+void StreamAnalyzer::touch(uint64_t ino, stream_inode_t &s)
+{
+  s.last_seen = _chunks_num;
+  s.pending = true;
+  _recent.push_back(make_pair(_chunks_num, ino));
+}
+
+/**
+ * Print the rows of the inodes without any node in the last window
+ * chunks, in the order they became quiet
+ */
+void StreamAnalyzer::emitQuietInodes()
+{
+  while(!_recent.empty() && _recent.front().first + _window <= _chunks_num)
+  {
+    pair<uint64_t, uint64_t> r = _recent.front();
+    map<uint64_t, stream_inode_t>::iterator it = _inodes.find(r.second);
+
+    _recent.pop_front();
+    if(it != _inodes.end() && it->second.last_seen == r.first && it->second.pending)
+      emitFile(it->first, it->second);
+  }
+}
+
+/**
+ * Print the row of one file, the nodes received so far being the whole
+ * file, along with the deletion of its name if any. Return 1 if it can't
+ * be built yet : no dirent, or some data missing. A deleted file is
+ * erased.
+ */
+int StreamAnalyzer::emitFile(uint64_t ino, stream_inode_t &s)
+{
+  vector<Chunk *> chunks(s.nodes);
+  map<string, Chunk *>::iterator deletion;
+  File *f = NULL;
+
+  // a deleted file needs no data, its nodes may be partly erased already
+  switch(getDirentState(s.nodes, _deletions))
+  {
+    case -1:
+      return 1;
+    case 0:
+      if(!isFileComplete(s.nodes))
+	return 1;
+      break;
+    default:
+      break;
+  }
+
+  deletion = _deletions.find(getLastDirent(s.nodes)->getName());
+  if(deletion != _deletions.end())
+    chunks.push_back(deletion->second);
+  FileSet fs(chunks, false);
+  for(int i=0; i<fs.getFilesNum() && f == NULL; i++)
+    if(fs.getFile(i)->getInodeNum() == ino)
+      f = fs.getFile(i);
+  if(f == NULL)
+    return 1;
+
+  _os << ((s.emitted) ? "U" : "F") << " ino: " << ino << ", \"" << f->getName() << "\"";
+  if(f->isDeleted())
+    _os << " [DELETED]";
+  else
+  {
+    int pages_num = f->getConcernedPages().getPagesNum();
+    int min_pages_num = f->getTheoriticalPageNum();
+
+    _os << ", size: " << f->getSize() << ", pages: " << pages_num << ", min pages: "
+      << min_pages_num;
+    if(f->getSize() > 0)
+      _os << ", frag: " << ((min_pages_num) ? (double)pages_num / min_pages_num : 0.0)
+	<< ", seqcost: " << f->getSequentialReadCost();
+  }
+  _os << endl;
+
+  s.emitted = true;
+  s.pending = false;
+  _rows_num++;
+  if(f->isDeleted())
+    forgetInode(ino);
+  else
+    dropNodes(s, f);
+
+  return 0;
+}
+
+/**
+ * Once a file is built its obsolete nodes can't become valid again, only
+ * its valid data nodes and its most recent dirent are kept
+ */
+void StreamAnalyzer::dropNodes(stream_inode_t &s, File *f)
+{
+  set<Chunk *> keep;
+  vector<Chunk *> kept;
+  DirentNode *last_dirent = getLastDirent(s.nodes);
+
+  keep.insert(f->getValidDataNodes().begin(), f->getValidDataNodes().end());
+  keep.insert(last_dirent);
+
+  // only the name of the most recent dirent can be deleted
+  for(int i=0; i<(int)s.nodes.size(); i++)
+    if(keep.find(s.nodes[i]) != keep.end())
+      kept.push_back(s.nodes[i]);
+    else
+    {
+      if(s.nodes[i]->getType() == DIRENT_NODE &&
+	static_cast<DirentNode *>(s.nodes[i])->getName() != last_dirent->getName())
+	forgetName(static_cast<DirentNode *>(s.nodes[i])->getName(), f->getInodeNum());
+      delete s.nodes[i];
+      _held_nodes_num--;
+      _dropped_nodes_num++;
+    }
+  s.nodes.swap(kept);
+}
+
+/**
+ * A deleted file stays so : its nodes and names are freed, its inode
+ * number is kept to drop the nodes of it still to come
+ */
+void StreamAnalyzer::forgetInode(uint64_t ino)
+{
+  map<uint64_t, stream_inode_t>::iterator it = _inodes.find(ino);
+
+  for(int i=0; i<(int)it->second.nodes.size(); i++)
+  {
+    Chunk *c = it->second.nodes[i];
+    if(c->getType() == DIRENT_NODE)
+      forgetName(static_cast<DirentNode *>(c)->getName(), ino);
+    delete c;
+    _held_nodes_num--;
+    _dropped_nodes_num++;
+  }
+  _inodes.erase(it);
+  _deleted_inos.insert(ino);
+}
+
+void StreamAnalyzer::forgetName(string name, uint64_t ino)
+{
+  map<string, vector<uint64_t> >::iterator names = _names.find(name);
+
+  if(names == _names.end())
+    return;
+  names->second.erase(remove(names->second.begin(), names->second.end(), ino),
+    names->second.end());
+  if(names->second.empty())
+    _names.erase(names);
+}
+
+void StreamAnalyzer::printStats(string prefix)
+{
+  _os << prefix << " " << _chunks_num << " chunks, " << _data_nodes_num << " data nodes, "
+    << _dirent_nodes_num << " dirent nodes, " << _free_bytes << " free bytes, "
+    << _inodes.size() + _deleted_inos.size() << " inodes, " << _rows_num << " file rows, "
+    << _held_nodes_num << " nodes held, " << _dropped_nodes_num << " dropped" << endl;
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Most recent dirent of the nodes, NULL if none
+ */
+DirentNode *getLastDirent(vector<Chunk *> &nodes)
+{
+  DirentNode *last = NULL;
+
+  for(int i=0; i<(int)nodes.size(); i++)
+    if(nodes[i]->getType() == DIRENT_NODE)
+    {
+      DirentNode *dn = static_cast<DirentNode *>(nodes[i]);
+      if(last == NULL || dn->getVersionNum() > last->getVersionNum())
+	last = dn;
+    }
+
+  return last;
+}
+
+/**
+ * State of a file as File::set_valid_dirent finds it : -1 without a
+ * dirent, 1 if a more recent deletion dirent has the name of its most
+ * recent dirent, else 0
+ */
+int getDirentState(vector<Chunk *> &nodes, map<string, Chunk *> &deletions)
+{
+  DirentNode *last = getLastDirent(nodes);
+  map<string, Chunk *>::iterator it;
+
+  if(last == NULL)
+    return -1;
+
+  it = deletions.find(last->getName());
+  if(it != deletions.end() && static_cast<Node *>(it->second)->getVersionNum() >
+    last->getVersionNum())
+    return 1;
+
+  return 0;
+}
+
+/**
+ * True if the data nodes cover the file up to the size given by the most
+ * recent one, as File::finalize requires
+ */
+bool isFileComplete(vector<Chunk *> &nodes)
+{
+  vector<pair<uint32_t, uint32_t> > ranges;
+  DataNode *most_recent = NULL;
+  uint32_t covered = 0;
+
+  for(int i=0; i<(int)nodes.size(); i++)
+    if(nodes[i]->getType() == DATA_NODE)
+    {
+      DataNode *dn = static_cast<DataNode *>(nodes[i]);
+      if(most_recent == NULL || dn->getVersionNum() > most_recent->getVersionNum())
+	most_recent = dn;
+      if(dn->getDataSize() > 0)
+	ranges.push_back(make_pair(dn->getDataOffset(), dn->getDataOffset() + dn->getDataSize()));
+    }
+  if(most_recent == NULL)
+    return true;
+
+  sort(ranges.begin(), ranges.end());
+  for(int i=0; i<(int)ranges.size() && ranges[i].first <= covered; i++)
+    covered = max(covered, ranges[i].second);
+
+  return covered >= most_recent->getFileSize();
+}
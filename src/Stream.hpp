@@ -0,0 +1,71 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <deque>
+
+#include "ChunkModel.hpp"
+#include "File.hpp"
+
+/**
+ * Incremental analysis of a dump as it is read, for live jffs2dump
+ * pipes. Nodes are grouped by inode as they arrive, free space and
+ * summary chunks are only counted. An inode with no new node for window
+ * chunks is considered complete : its file row is printed ("F") and only
+ * its valid nodes are kept. If a later node changes it, its row is
+ * printed again ("U") once quiet. A file found deleted is forgotten but
+ * for its inode number, its later nodes being dropped, and only the most
+ * recent deletion dirent of each name is kept as it hides the older ones.
+ * Global figures are printed every interval chunks ("#"), and every
+ * pending file at the end of the input.
+ */
+class StreamAnalyzer
+{
+  public:
+    StreamAnalyzer(FlashGeometry &geometry, int window, int interval, std::ostream &os);
+    ~StreamAnalyzer();
+    int run(std::istream &in);
+
+  private:
+    typedef struct
+    {
+      std::vector<Chunk *> nodes;		// valid or not yet known obsolete
+      uint64_t last_seen;		// chunk count at the last node
+      bool pending;			// changed since its last row
+      bool emitted;
+    } stream_inode_t;
+
+    FlashGeometry _geometry;
+    int _window;
+    int _interval;
+    std::ostream &_os;
+
+    std::map<uint64_t, stream_inode_t> _inodes;	// deleted ones excluded
+    std::set<uint64_t> _deleted_inos;
+    std::map<std::string, Chunk *> _deletions;	// most recent dirent with ino 0 by name
+    std::map<std::string, std::vector<uint64_t> > _names;	// inodes by dirent name
+    std::deque<std::pair<uint64_t, uint64_t> > _recent;	// (chunk count, ino) of the last nodes
+
+    uint64_t _chunks_num;
+    uint64_t _data_nodes_num;
+    uint64_t _dirent_nodes_num;
+    uint64_t _free_bytes;
+    uint64_t _held_nodes_num;
+    uint64_t _dropped_nodes_num;	// known obsolete, freed
+    int _rows_num;
+
+    void addNode(Node *n);
+    void touch(uint64_t ino, stream_inode_t &s);
+    void emitQuietInodes();
+    int emitFile(uint64_t ino, stream_inode_t &s);
+    void dropNodes(stream_inode_t &s, File *f);
+    void forgetInode(uint64_t ino);
+    void forgetName(std::string name, uint64_t ino);
+    void printStats(std::string prefix);
+};
+
+#endif /* STREAM_HPP */
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <set>
+
+#include "Summary.hpp"
+
+using namespace std;
+
+#define HISTOGRAM_BAR_MAX_WIDTH			50
+
+/**************************** Dump summary ****************************/
+
+/**
+ * The valid nodes are the valid data nodes and the current dirents of
+ * the files in the set, every other node is obsolete
+ */
+int computeDumpSummary(vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry,
+  dump_summary_t &res)
+{
+  set<Node *> valid_nodes;
+
+  res.data_nodes_num = res.dirent_nodes_num = 0;
+  res.files_num = res.deleted_files_num = 0;
+  res.files_size = res.valid_bytes = res.obsolete_bytes = res.free_bytes = 0;
+  res.pages_num = res.min_pages_num = res.seq_read_cost = 0;
+  res.page_size = geometry.getFlashPageSize();
+
+  for(int i=0; i<fs.getFilesNum(); i++)
+  {
+    File *f = fs.getFile(i);
+    vector<DataNode *> &valid = f->getValidDataNodes();
+
+    if(f->getInodeNum() == 1)
+      continue;
+
+    res.files_num++;
+    if(f->isDeleted())
+    {
+      res.deleted_files_num++;
+      continue;
+    }
+
+    valid_nodes.insert(valid.begin(), valid.end());
+    valid_nodes.insert(f->getValidDirentNode());
+    res.files_size += f->getSize();
+    res.pages_num += f->getConcernedPages().getPagesNum();
+    res.min_pages_num += f->getTheoriticalPageNum();
+    res.seq_read_cost += f->getSequentialReadCost();
+  }
+
+  for(int i=0; i<(int)chunk_list.size(); i++)
+    switch(chunk_list[i]->getType())
+    {
+      case FREE_SPACE:
+	res.free_bytes += static_cast<FreeSpaceChunk *>(chunk_list[i])->getSize();
+	break;
+
+      case DATA_NODE:
+      case DIRENT_NODE:
+      {
+	Node *n = static_cast<Node *>(chunk_list[i]);
+	if(n->getType() == DATA_NODE)
+	  res.data_nodes_num++;
+	else
+	  res.dirent_nodes_num++;
+	if(valid_nodes.find(n) != valid_nodes.end())
+	  res.valid_bytes += n->getFlashSize();
+	else
+	  res.obsolete_bytes += n->getFlashSize();
+	break;
+      }
+
+      default:
+	break;
+    }
+
+  return 0;
+}
+
+/**
+ * Accumulate the figures of several dumps sharing the same page size,
+ * the partitions of a chip for instance
+ */
+void addDumpSummary(dump_summary_t &to, dump_summary_t &from)
+{
+  to.data_nodes_num += from.data_nodes_num;
+  to.dirent_nodes_num += from.dirent_nodes_num;
+  to.files_num += from.files_num;
+  to.deleted_files_num += from.deleted_files_num;
+  to.files_size += from.files_size;
+  to.valid_bytes += from.valid_bytes;
+  to.obsolete_bytes += from.obsolete_bytes;
+  to.free_bytes += from.free_bytes;
+  to.pages_num += from.pages_num;
+  to.min_pages_num += from.min_pages_num;
+  to.seq_read_cost += from.seq_read_cost;
+  to.page_size = from.page_size;
+}
+
+/**
+ * Share of the used flash space wasted by obsolete nodes, i.e. what the
+ * garbage collector has to reclaim
+ */
+double getGCPressure(dump_summary_t &s)
+{
+  if(s.valid_bytes + s.obsolete_bytes == 0)
+    return 0.0;
+  return (double)s.obsolete_bytes / (double)(s.valid_bytes + s.obsolete_bytes);
+}
+
+double getFragmentationFactor(dump_summary_t &s)
+{
+  if(s.min_pages_num == 0)
+    return 0.0;
+  return (double)s.pages_num / (double)s.min_pages_num;
+}
+
+/**
+ * Flash bytes read for one byte of file data, reading every file
+ * sequentially
+ */
+double getReadAmplification(dump_summary_t &s)
+{
+  if(s.files_size == 0)
+    return 0.0;
+  return ((double)s.seq_read_cost * s.page_size) / (double)s.files_size;
+}
+
+void printSummaryHeader(ostream &os)
+{
+  os << "dump,data_nodes,dirent_nodes,files,deleted_files,files_size,valid_bytes,"
+    "obsolete_bytes,free_bytes,gc_pressure,frag_factor,seq_read_cost,read_amplification" << endl;
+}
+
+void printSummaryRow(ostream &os, string name, dump_summary_t &s)
+{
+  os << name << "," << s.data_nodes_num << "," << s.dirent_nodes_num << ","
+    << s.files_num << "," << s.deleted_files_num << "," << s.files_size << ","
+    << s.valid_bytes << "," << s.obsolete_bytes << "," << s.free_bytes << ","
+    << getGCPressure(s) << "," << getFragmentationFactor(s) << ","
+    << s.seq_read_cost << "," << getReadAmplification(s) << endl;
+}
+
+/****************************** Tools *********************************/
+
+/**
+ * Nearest rank percentile, sorted_values must be sorted
+ */
+double getPercentile(vector<double> &sorted_values, double percent)
+{
+  int rank;
+
+  if(sorted_values.empty())
+    return 0.0;
+
+  rank = (int)((percent / 100.0) * sorted_values.size() + 0.5);
+  if(rank < 1)
+    rank = 1;
+  if(rank > (int)sorted_values.size())
+    rank = sorted_values.size();
+  return sorted_values[rank-1];
+}
+
+/**
+ * Print a text histogram, bounds are the limits between the bins
+ */
+void printHistogram(ostream &os, string title, vector<double> &values,
+  double *bounds, int bounds_num)
+{
+  vector<int> bins(bounds_num+1, 0);
+  int max_count = 1;
+
+  for(int i=0; i<(int)values.size(); i++)
+  {
+    int b = upper_bound(bounds, bounds+bounds_num, values[i]) - bounds;
+    bins[b]++;
+    max_count = max(max_count, bins[b]);
+  }
+
+  os << title << " :" << endl;
+  for(int i=0; i<=bounds_num; i++)
+  {
+    stringstream range;
+    if(i == 0)
+      range << "< " << bounds[0];
+    else if(i == bounds_num)
+      range << ">= " << bounds[bounds_num-1];
+    else
+      range << "[" << bounds[i-1] << ", " << bounds[i] << ")";
+
+    os << "  " << left << setw(14) << range.str() << right << setw(8) << bins[i] << " ";
+    for(int j=0; j<(bins[i]*HISTOGRAM_BAR_MAX_WIDTH)/max_count; j++)
+      os << "#";
+    os << endl;
+  }
+}
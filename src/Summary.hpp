@@ -0,0 +1,43 @@
+#ifndef SUMMARY_HPP
+#define SUMMARY_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "ChunkModel.hpp"
+#include "File.hpp"
+
+/**
+ * Global figures for one dump
+ */
+typedef struct
+{
+  int data_nodes_num;
+  int dirent_nodes_num;
+  int files_num;			// slash excluded
+  int deleted_files_num;
+  uint64_t files_size;			// sum of the non deleted files sizes
+  uint64_t valid_bytes;			// flash bytes used by valid nodes
+  uint64_t obsolete_bytes;		// flash bytes used by obsolete nodes
+  uint64_t free_bytes;			// flash bytes in free space chunks
+  int pages_num;			// flash pages holding valid data
+  int min_pages_num;			// minimal number of pages needed
+  int seq_read_cost;			// flash pages read reading every file
+  int page_size;			// flash page size of the dump
+} dump_summary_t;
+
+int computeDumpSummary(std::vector<Chunk *> &chunk_list, FileSet &fs, FlashGeometry &geometry,
+  dump_summary_t &res);
+void addDumpSummary(dump_summary_t &to, dump_summary_t &from);
+double getGCPressure(dump_summary_t &s);
+double getFragmentationFactor(dump_summary_t &s);
+double getReadAmplification(dump_summary_t &s);
+void printSummaryHeader(std::ostream &os);
+void printSummaryRow(std::ostream &os, std::string name, dump_summary_t &s);
+
+double getPercentile(std::vector<double> &sorted_values, double percent);
+void printHistogram(std::ostream &os, std::string title, std::vector<double> &values,
+  double *bounds, int bounds_num);
+
+#endif /* SUMMARY_HPP */
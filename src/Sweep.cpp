@@ -0,0 +1,255 @@
+#include <pthread.h>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+
+#include "Sweep.hpp"
+#include "PageSet.hpp"
+
+using namespace std;
+
+/**************************** GeometrySweep ***************************/
+
+GeometrySweep::GeometrySweep(FileSet &fs, vector<FlashGeometry> &geometries)
+{
+  for(int i=0; i<fs.getFilesNum(); i++)
+  {
+    File *f = fs.getFile(i);
+    vector<DataNode *> &valid = f->getValidDataNodes();
+    sweep_file_t sf;
+
+    if(f->isDeleted() || f->getSize() == 0)
+      continue;
+
+    sf.size = f->getSize();
+    for(int j=0; j<(int)valid.size(); j++)
+    {
+      sweep_extent_t e;
+      e.offset = valid[j]->getFlashAddr().getFlashOffset();
+      e.size = valid[j]->getFlashSize();
+      sf.valid.push_back(e);
+    }
+
+    sf.readpages.resize(f->getLinuxPagesNum());
+    for(int j=0; j<(int)sf.readpages.size(); j++)
+    {
+      vector<DataNode *> nodes = f->getDataNodesReadForLinuxPage(j);
+      for(int k=0; k<(int)nodes.size(); k++)
+      {
+	sweep_extent_t e;
+	e.offset = nodes[k]->getFlashAddr().getFlashOffset();
+	e.size = nodes[k]->getFlashSize();
+	sf.readpages[j].push_back(e);
+      }
+    }
+
+    _files.push_back(sf);
+  }
+
+  for(int i=0; i<(int)geometries.size(); i++)
+  {
+    sweep_result_t r;
+    r.geometry = geometries[i];
+    _results.push_back(r);
+  }
+}
+
+/**
+ * Evaluate every geometry with threads_num workers
+ */
+int GeometrySweep::run(int threads_num)
+{
+  vector<pthread_t> threads;
+
+  _next = 0;
+  pthread_mutex_init(&_lock, NULL);
+
+  if(threads_num < 1)
+    threads_num = 1;
+  if(threads_num > (int)_results.size())
+    threads_num = max(1, (int)_results.size());
+
+  for(int i=0; i<threads_num; i++)
+  {
+    pthread_t t;
+    if(pthread_create(&t, NULL, worker, this))
+    {
+      cerr << "Error creating sweep worker thread" << endl;
+      break;
+    }
+    threads.push_back(t);
+  }
+
+  for(int i=0; i<(int)threads.size(); i++)
+    pthread_join(threads[i], NULL);
+  pthread_mutex_destroy(&_lock);
+
+  if(threads.empty())
+    return -1;
+  return 0;
+}
+
+void *GeometrySweep::worker(void *arg)
+{
+  GeometrySweep *gs = (GeometrySweep *)arg;
+
+  while(true)
+  {
+    int i;
+
+    pthread_mutex_lock(&gs->_lock);
+    i = gs->_next++;
+    pthread_mutex_unlock(&gs->_lock);
+
+    if(i >= (int)gs->_results.size())
+      break;
+    gs->evaluate(gs->_results[i]);
+  }
+
+  return NULL;
+}
+
+/**
+ * Same accounting as the File metrics : a readpage reads every page of
+ * its nodes, a page shared by two consecutive nodes being read once, and
+ * the sequential read of a file does not read again the last page of the
+ * previous readpage. In the kernel readpage model a node spanning two
+ * linux pages is read again for the second.
+ */
+int GeometrySweep::evaluate(sweep_result_t &res)
+{
+  FlashGeometry &g = res.geometry;
+  PageSet all_pages;
+  bool kernel = (getReadpageModel() == READPAGE_KERNEL);
+
+  res.files_num = _files.size();
+  res.files_size = 0;
+  res.pages_num = res.min_pages_num = res.seq_read_cost = 0;
+  res.readpages_num = res.readpage_cost = res.max_readpage_cost = 0;
+
+  for(int i=0; i<(int)_files.size(); i++)
+  {
+    sweep_file_t &sf = _files[i];
+    PageSet pages;
+    int last_seq_page = -1;
+    uint64_t last_seq_node = (uint64_t)-1;
+
+    for(int j=0; j<(int)sf.valid.size(); j++)
+      if(sf.valid[j].size > 0)
+	pages.addRange(g.getPage(sf.valid[j].offset),
+	  g.getPage(sf.valid[j].offset + sf.valid[j].size - 1));
+    all_pages.unite(pages);
+
+    res.files_size += sf.size;
+    res.pages_num += pages.getPagesNum();
+    res.min_pages_num += getMinPagesNum(sf.size, g.getFlashPageSize());
+    res.readpages_num += sf.readpages.size();
+
+    for(int j=0; j<(int)sf.readpages.size(); j++)
+    {
+      int last_page = -1, cost = 0;
+
+      for(int k=0; k<(int)sf.readpages[j].size(); k++)
+      {
+	sweep_extent_t &e = sf.readpages[j][k];
+	int first = g.getPage(e.offset), last = g.getPage(e.offset + e.size - 1);
+
+	for(int p=first; p<=last; p++)
+	  if(p != last_page)
+	  {
+	    cost++;
+	    last_page = p;
+	  }
+
+	// a node spanning two linux pages is read once sequentially
+	if(!kernel && e.offset == last_seq_node)
+	  continue;
+	for(int p=first; p<=last; p++)
+	  if(p != last_seq_page)
+	  {
+	    res.seq_read_cost++;
+	    last_seq_page = p;
+	  }
+	last_seq_node = e.offset;
+      }
+      res.readpage_cost += cost;
+      res.max_readpage_cost = max(res.max_readpage_cost, cost);
+    }
+  }
+
+  res.blocks_num = all_pages.getBlocksNum(g.getNumPagesPerBlock());
+  return 0;
+}
+
+vector<sweep_result_t> & GeometrySweep::getResults()
+{
+  return _results;
+}
+
+ostream& operator<<(ostream& os, GeometrySweep& gs)
+{
+  os << "Geometry sweep over " << gs._files.size() << " files";
+  if(getReadpageModel() == READPAGE_KERNEL)
+    os << ", kernel readpage model";
+  os << " :" << endl;
+  os << "   page  ppb     pages  min pages   frag  seq. cost  read amp.  readpage avg  max"
+    "  blocks" << endl;
+  for(int i=0; i<(int)gs._results.size(); i++)
+  {
+    sweep_result_t &r = gs._results[i];
+    double frag = (r.min_pages_num) ? (double)r.pages_num / r.min_pages_num : 0.0;
+    double read_amp = (r.files_size) ?
+      (double)r.seq_read_cost * r.geometry.getFlashPageSize() / r.files_size : 0.0;
+    double readpage_avg = (r.readpages_num) ? (double)r.readpage_cost / r.readpages_num : 0.0;
+
+    os << setw(7) << r.geometry.getFlashPageSize() << setw(5) << r.geometry.getNumPagesPerBlock()
+      << setw(10) << r.pages_num << setw(11) << r.min_pages_num
+      << fixed << setprecision(3) << setw(7) << frag << setw(11) << r.seq_read_cost
+      << setw(11) << read_amp << setw(14) << readpage_avg << setw(5) << r.max_readpage_cost
+      << setw(8) << r.blocks_num << endl;
+    os.unsetf(ios::fixed);
+    os << setprecision(6);
+  }
+
+  return os;
+}
+
+/**
+ * Parse a list like 2048x64,4096x64,4096x128 (page size x pages per block)
+ */
+int parseGeometryList(char *list, uint64_t partition_offset, vector<FlashGeometry> &res)
+{
+  string content = list;
+  string item;
+
+  for(int i=0; i<(int)content.size(); i++)
+    if(content[i] == ',')
+      content[i] = ' ';
+
+  stringstream ss(content);
+  while(ss >> item)
+  {
+    char *end;
+    long page_size, pages_per_block = 0;
+
+    page_size = strtol(item.c_str(), &end, 10);
+    if(*end == 'x')
+      pages_per_block = strtol(end+1, &end, 10);
+
+    FlashGeometry g(page_size, pages_per_block, partition_offset);
+    if(*end != '\0' || !g.isValid())
+    {
+      cerr << "Error, invalid geometry : " << item << endl;
+      return -1;
+    }
+    res.push_back(g);
+  }
+
+  if(res.empty())
+  {
+    cerr << "Error, empty geometry list" << endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+
+#include "File.hpp"
+#include "FlashGeometry.hpp"
+
+/**
+ * Costs of all the files of a dump for one geometry
+ */
+typedef struct
+{
+  FlashGeometry geometry;
+  int files_num;			// non deleted files with data
+  uint64_t files_size;
+  int pages_num;			// flash pages holding valid data, per file
+  int min_pages_num;			// minimal number of pages needed
+  int seq_read_cost;			// flash pages read reading every file
+  int readpages_num;			// linux pages of all the files
+  int readpage_cost;			// flash pages read by all the readpages
+  int max_readpage_cost;		// worst single readpage
+  int blocks_num;			// erase blocks holding valid data
+} sweep_result_t;
+
+/**
+ * What-if evaluation of the file costs for several geometries from a
+ * single parse. The valid nodes and the nodes read per linux page do not
+ * depend on the geometry : they are extracted once, then each geometry
+ * only maps the node byte extents to its pages, in parallel.
+ */
+class GeometrySweep
+{
+  public:
+    GeometrySweep(FileSet &fs, std::vector<FlashGeometry> &geometries);
+    int run(int threads_num);
+    std::vector<sweep_result_t> &getResults();
+
+  private:
+    typedef struct
+    {
+      uint64_t offset;			// flash offset, partition offset included
+      uint32_t size;
+    } sweep_extent_t;
+
+    typedef struct
+    {
+      uint32_t size;
+      std::vector<sweep_extent_t> valid;	// valid data nodes
+      std::vector<std::vector<sweep_extent_t> > readpages;	// nodes read per linux page
+    } sweep_file_t;
+
+    std::vector<sweep_file_t> _files;
+    std::vector<sweep_result_t> _results;
+    int _next;				// next geometry to evaluate
+    pthread_mutex_t _lock;
+
+    int evaluate(sweep_result_t &res);
+    static void *worker(void *arg);
+
+  friend std::ostream& operator<<(std::ostream& os, GeometrySweep& gs);
+};
+
+int parseGeometryList(char *list, uint64_t partition_offset, std::vector<FlashGeometry> &res);
+
+#endif /* SWEEP_HPP */